@@ -33,6 +33,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <time.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -57,15 +59,24 @@
 #include <jvmticmlr.h>
 
 /* Internal tool includes */
-#include "jthread_map.h"
-#include "jthrowable_circular_buf.h"
+#include "exception_matcher.h"
+#include "worker_pool.h"
+#include "report_dispatcher.h"
+#include "rate_limiter.h"
+#include "fingerprint_set.h"
+#include "jni_ids.h"
+#include "class_location_cache.h"
+#include "frame_cache.h"
+#include "class_index.h"
+#include "debug_methods.h"
+#include "string_builder.h"
+#include "line_number_cache.h"
+#include "arena.h"
+#include "string_table.h"
 
 
 /* Configuration of processed JVMTI Events */
 
-/* Enables checks based on JVMTI_EVENT_VM_DEATH */
-/* #define ABRT_VM_DEATH_CHECK */
-
 /* Enables checks based on JVMTI_EVENT_VM_OBJECT_ALLOC */
 /* #define ABRT_OBJECT_ALLOCATION_SIZE_CHECK */
 
@@ -95,10 +106,12 @@
 #define MAX_REASON_MESSAGE_STRING_LENGTH 255
 
 /* Max. length of stack trace */
+#ifndef MAX_STACK_TRACE_STRING_LENGTH
 #define MAX_STACK_TRACE_STRING_LENGTH 10000
+#endif
 
-/* Depth of stack trace */
-#define MAX_STACK_TRACE_DEPTH 5
+/* Max. length of a source file name and a line number of a frame */
+#define MAX_SOURCE_STRING_LENGTH 256
 
 #define DEFAULT_THREAD_NAME "DefaultThread"
 
@@ -106,22 +119,87 @@
 #define FILENAME_TYPE_VALUE      "Java"
 #define FILENAME_ANALYZER_VALUE  "Java"
 
-/* Name of two methods from URL class */
-#define TO_EXTERNAL_FORM_METHOD_NAME "toExternalForm"
-#define GET_PATH_METHOD_NAME "getPath"
-
 /* Default main class name */
 #define UNKNOWN_CLASS_NAME "*unknown*"
 
 /* The standard stack trace caused by header */
 #define CAUSED_STACK_TRACE_HEADER "Caused by: "
 
-/* A number stored reported exceptions */
-#ifndef REPORTED_EXCEPTION_STACK_CAPACITY
-#define  REPORTED_EXCEPTION_STACK_CAPACITY 5
+/* Max. number of causes printed below an exception */
+#ifndef MAX_CAUSE_CHAIN_DEPTH
+#define MAX_CAUSE_CHAIN_DEPTH 32
+#endif
+
+/* Max. number of remembered fingerprints of reported exceptions */
+#ifndef REPORTED_EXCEPTION_FINGERPRINT_CAPACITY
+#define REPORTED_EXCEPTION_FINGERPRINT_CAPACITY 4096
+#endif
+
+/* A bit of exception object's tag marking already reported exceptions. The
+ * other bits hold the exception's fingerprint. */
+#define EXCEPTION_TAG_REPORTED ((jlong)1 << 62)
+
+/* A bit of class loader's tag in classLoaderEnv; the other bits hold a unique
+ * ID of the class loader. */
+#define CLASS_LOADER_TAG ((jlong)1 << 61)
+
+/* Max. number of remembered locations of classes */
+#ifndef CLASS_LOCATION_CACHE_CAPACITY
+#define CLASS_LOCATION_CACHE_CAPACITY 4096
+#endif
+
+/* Max. number of bytes of formatted frames kept for reuse */
+#ifndef FRAME_CACHE_MEMORY_LIMIT
+#define FRAME_CACHE_MEMORY_LIMIT (1024 * 1024)
+#endif
+
+/* Max. number of bytes of line number tables kept for reuse */
+#ifndef LINE_NUMBER_CACHE_MEMORY_LIMIT
+#define LINE_NUMBER_CACHE_MEMORY_LIMIT (512 * 1024)
+#endif
+
+/* Max. number of bytes of interned names of exception types */
+#ifndef SYMBOL_TABLE_MEMORY_LIMIT
+#define SYMBOL_TABLE_MEMORY_LIMIT (4 * 1024 * 1024)
+#endif
+
+/* Max. number of bytes of interned class names and class locations */
+#ifndef CLASS_LOCATION_STRINGS_MEMORY_LIMIT
+#define CLASS_LOCATION_STRINGS_MEMORY_LIMIT (4 * 1024 * 1024)
+#endif
+
+/* Number of frames from the top of the stack included in a fingerprint */
+#ifndef REPORTED_EXCEPTION_FINGERPRINT_DEPTH
+#define REPORTED_EXCEPTION_FINGERPRINT_DEPTH 8
+#endif
+
+/* Number of agent threads formatting and delivering reports */
+#ifndef REPORT_WORKER_COUNT
+#define REPORT_WORKER_COUNT 2
+#endif
+
+/* Max. number of reports waiting for a report worker */
+#ifndef REPORT_WORKER_QUEUE_CAPACITY
+#define REPORT_WORKER_QUEUE_CAPACITY 256
+#endif
+
+/* Max. number of reports waiting for delivery to a single destination */
+#ifndef REPORT_SINK_QUEUE_CAPACITY
+#define REPORT_SINK_QUEUE_CAPACITY 64
 #endif
 
 
+/*
+ * Values of JVMTI tags attached to exception classes. The tag caches the
+ * verdict of the 'caught' filter for all instances of the tagged class.
+ */
+enum {
+    EXCEPTION_CLASS_VERDICT_UNKNOWN = 0, ///< not tagged yet
+    EXCEPTION_CLASS_VERDICT_REPORT  = 1, ///< report instances even if caught
+    EXCEPTION_CLASS_VERDICT_IGNORE  = 2, ///< ignore caught instances
+};
+
+
 /*
  * This structure contains all useful information about JVM environment.
  * (note that these strings should be deallocated using jvmti_env->Deallocate()!)
@@ -173,21 +251,59 @@ typedef struct {
 
 /*
  * This structure is representation of a single report of an exception.
+ *
+ * Callbacks capture only the exception object, the method and the thread
+ * name. The texts are formatted later by a report worker.
+ *
+ * A pending report of an uncaught exception holds only a weak reference to
+ * the exception. Native code may catch the exception and drop it, hence the
+ * report does not keep the exception alive till the thread ends. The type
+ * name, the detail message and the frames are captured at throw time, so an
+ * uncaught exception collected before the thread ends is still reported.
+ *
+ * The texts live in the arena of the formatting thread and are released
+ * together once the report is dispatched.
  */
 typedef struct {
-    char *message;
-    char *stacktrace;
-    char *executable;
-    char *exception_type_name;
-    T_infoPair *additional_info;
-    jobject exception_object;
+    char *message;                           ///< allocated from the arena
+    char *stacktrace;                        ///< allocated from the arena
+    char *executable;                        ///< allocated from the arena
+    const char *exception_type_name;         ///< interned in symbols or exception_type_name_copy
+    char *exception_type_name_copy;          ///< mallocated type name if it could not be interned
+    T_infoPair *additional_info;             ///< allocated from the arena
+    jobject exception_object;                ///< global reference, weak if the report is pending
+    int pending;                             ///< the exception is not known to be uncaught yet
+    char *detail_message;                    ///< Throwable.detailMessage of a pending report or NULL
+    jvmtiFrameInfo *frames;                  ///< frames captured by JVMTI or NULL
+    jint frame_count;                        ///< number of captured frames
+    jmethodID method;                        ///< method where the exception was thrown or caught
+    int caught;                              ///< the exception was caught in the method
+    jlong fingerprint;                       ///< exception type and throw site for duplicate detection
+    uint64_t signature;                      ///< exception type and throw location for rate limiting
+    size_t suppressed;                       ///< number of similar reports suppressed before this one
+    char thread_name[MAX_THREAD_NAME_LENGTH];
 } T_exceptionReport;
 
 
 
+/*
+ * Agent's data of a single thread kept in JVMTI thread local storage.
+ *
+ * The structure is created when the thread throws its first exception and
+ * is accessed only by the thread itself.
+ */
+typedef struct {
+    jlong tid;                          ///< java.lang.Thread.getId()
+    T_exceptionReport *uncaught_report; ///< pending report of an uncaught exception
+    jvmtiFrameInfo *frames;             ///< buffer for capturing of stack traces
+} T_threadState;
+
+
+
 /* Global monitor lock */
 jrawMonitorID shared_lock;
 
+
 #if ABRT_GARBAGE_COLLECTION_TIMEOUT_CHECK
 /* GC checks monitor lock */
 jrawMonitorID gc_lock;
@@ -205,48 +321,82 @@ T_jvmEnvironment jvmEnvironment;
 /* Structure containing process properties. */
 T_processProperties processProperties;
 
-/* Map of buffer for already reported exceptions to prevent re-reporting */
-T_jthreadMap *threadMap;
-
-/* Map of uncaught exceptions. There should be only 1 per thread.*/
-T_jthreadMap *uncaughtExceptionMap;
+/* Fingerprints of already reported exceptions to prevent re-reporting */
+T_fingerprintSet *reportedExceptions;
 
 /* Configuration */
 T_configuration globalConfig;
 
-/* forward headers */
-static char* get_path_to_class(jvmtiEnv *jvmti_env, JNIEnv *jni_env, jclass class, char *class_name, const char *stringize_method_name);
-static void print_jvm_environment_variables_to_file(FILE *out);
-static char* format_class_name(char *class_signature, char replace_to);
-static int check_jvmti_error(jvmtiEnv *jvmti_env, jvmtiError error_code, const char *str);
-static jclass find_class_in_loaded_class(jvmtiEnv *jvmti_env, JNIEnv *jni_env, const char *searched_class_name);
+/* Compiled list of exception types reported even if caught */
+T_exceptionMatcher *caughtExceptionMatcher;
 
+/* Agent threads formatting reports */
+T_workerPool *reportWorkers;
 
+/* Delivers reports to all enabled destinations */
+T_reportDispatcher *reportDispatcher;
 
-/*
- * Frees memory of given array terminated by empty entry.
- */
-static void info_pair_vector_free(T_infoPair *pairs)
-{
-    if (NULL == pairs)
-    {
-        return;
-    }
+/* Limits rate of reports of the same exception, NULL if unlimited */
+T_rateLimiter *reportRateLimiter;
 
-    for (T_infoPair *iter = pairs; iter->label; ++iter)
-    {
-        free(iter->data);
-    }
+/* Interned names of exception types */
+T_stringTable *symbols;
 
-    free(pairs);
-}
+/* Interned class names and locations of classes, kept apart from symbols so
+ * that many loaded classes cannot exhaust the names of exception types */
+T_stringTable *classLocationStrings;
+
+/* Locations of classes on stack traces */
+T_classLocationCache *classLocations;
+
+/* Formatted frames of JVMTI stack traces */
+T_frameCache *frameCache;
+
+/* Line number tables of methods on JVMTI stack traces */
+T_lineNumberCache *lineNumbers;
+
+/* Loaded classes by their names */
+T_classIndex *loadedClasses;
+
+/* Non zero once all classes loaded before VMInit are in loadedClasses and
+ * debugMethods and ClassPrepare callback keeps them up to date */
+static int loadedClassesIndexed;
+
+/* Configured debug methods, NULL if there are none */
+T_debugMethods *debugMethods;
+
+/* The last assigned ID of a class loader */
+static jlong lastClassLoaderId;
+
+/* JVMTI environment tagging only class loaders. Tags and ObjectFree events of
+ * environments are independent, so tagged exceptions collected in the main
+ * environment do not raise ObjectFree events. NULL if class loaders cannot be
+ * identified. */
+static jvmtiEnv *classLoaderEnv;
+
+/* Numbers of exceptions referenced by reports. Global references keep the
+ * exceptions alive, weak references of pending reports do not. */
+static size_t heldExceptions;
+static size_t heldExceptionsPeak;
+static size_t pendingExceptions;
+static size_t pendingExceptionsPeak;
+
+/* forward headers */
+static int get_class_location(jvmtiEnv *jvmti_env, JNIEnv *jni_env, jclass class, const char *class_name, char **external_form, char **path);
+static void print_jvm_environment_variables_to_file(FILE *out);
+static char* format_class_name(char *class_signature, char replace_to);
+static int check_jvmti_error(jvmtiEnv *jvmti_env, jvmtiError error_code, const char *str);
+static jclass find_class_in_loaded_class(jvmtiEnv *jvmti_env, JNIEnv *jni_env, const char *searched_class_name);
+static void submit_exception_report(jvmtiEnv *jvmti_env, JNIEnv *jni_env, jlong tid, T_exceptionReport *report);
+static int exception_report_resolve(JNIEnv *jni_env, T_exceptionReport *report, jobject exception_object);
 
 
 
 /*
- * Converts given array terminated by empty entry into String.
+ * Converts given array terminated by empty entry into String allocated from
+ * an arena.
  */
-static char *info_pair_vector_to_string(T_infoPair *pairs)
+static char *info_pair_vector_to_string(T_arena *arena, T_infoPair *pairs)
 {
     if (NULL == pairs)
     {
@@ -264,25 +414,26 @@ static char *info_pair_vector_to_string(T_infoPair *pairs)
         return NULL;
     }
 
-    char *contents = (char *)malloc(required_bytes);
+    /* + 1 for the terminating null byte */
+    char *contents = (char *)arena_alloc(arena, required_bytes + 1);
     if (NULL == contents)
     {
-        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory");
         return NULL;
     }
 
-    size_t to_write = required_bytes;
+    size_t to_write = required_bytes + 1;
     char *pointer = contents;
     for (T_infoPair *iter = pairs; NULL != iter->label; ++iter)
     {
         const int written = snprintf(pointer, to_write, "%s = %s\n", iter->label, iter->data);
-        if (written < 0)
+        if (written < 0 || (size_t)written >= to_write)
         {
-            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": snprintf() failed to write to already malloced memory");
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": snprintf() failed to write to already allocated memory");
             break;
         }
 
         pointer += written;
+        to_write -= written;
     }
 
     return contents;
@@ -291,21 +442,46 @@ static char *info_pair_vector_to_string(T_infoPair *pairs)
 
 
 /*
- * Frees memory of given report structure.
+ * Counts a new reference to an exception and updates the peak
+ */
+static void count_exception_reference(size_t *count, size_t *peak)
+{
+    const size_t current = __sync_add_and_fetch(count, 1);
+    size_t old_peak = __sync_add_and_fetch(peak, 0);
+    while (current > old_peak && !__sync_bool_compare_and_swap(peak, old_peak, current))
+    {
+        old_peak = __sync_add_and_fetch(peak, 0);
+    }
+}
+
+
+
+/*
+ * Frees memory of given report structure and releases the exception object.
  */
-static void exception_report_free(T_exceptionReport *report)
+static void exception_report_free(JNIEnv *jni_env, T_exceptionReport *report)
 {
     if (NULL == report)
     {
         return;
     }
 
-    free(report->message);
-    free(report->stacktrace);
-    free(report->executable);
-    free(report->exception_type_name);
+    free(report->frames);
+    free(report->detail_message);
+    free(report->exception_type_name_copy);
+
+    if (NULL != report->exception_object && report->pending)
+    {
+        (*jni_env)->DeleteWeakGlobalRef(jni_env, report->exception_object);
+        __sync_sub_and_fetch(&pendingExceptions, 1);
+    }
+    else if (NULL != report->exception_object)
+    {
+        (*jni_env)->DeleteGlobalRef(jni_env, report->exception_object);
+        __sync_sub_and_fetch(&heldExceptions, 1);
+    }
 
-    info_pair_vector_free(report->additional_info);
+    free(report);
 }
 
 
@@ -492,11 +668,23 @@ static const char * null2empty(const char *str)
 }
 
 
-static char *get_exception_type_name(
+/*
+ * Returns the readable name of exception's type interned in symbols
+ *
+ * The table of symbols is limited. If it is full, the name is returned in a
+ * mallocated copy, so no report loses the name.
+ *
+ * @param copy Set to the returned name if it is the mallocated copy which the
+ *        caller must free; otherwise NULL
+ */
+static const char *get_exception_type_name(
         jvmtiEnv *jvmti_env,
         JNIEnv *jni_env,
-        jobject exception_object)
+        jobject exception_object,
+        char **copy)
 {
+    *copy = NULL;
+
     jclass exception_class = (*jni_env)->GetObjectClass(jni_env, exception_object);
 
     char *exception_name_ptr = NULL;
@@ -521,7 +709,22 @@ static char *get_exception_type_name(
         dest[0] = '\0';
     }
 
-    return exception_name_ptr;
+    /* All exceptions of the same type share the name */
+    const char *exception_name = string_table_intern(symbols, exception_name_ptr);
+    if (NULL == exception_name)
+    {
+        *copy = strdup(exception_name_ptr);
+        if (NULL == *copy)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": strdup(): out of memory");
+        }
+        exception_name = *copy;
+    }
+
+    error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)exception_name_ptr);
+    check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
+
+    return exception_name;
 }
 
 
@@ -529,33 +732,66 @@ static char *get_exception_type_name(
 /*
  * Returns non zero value if exception's type is intended to be reported even
  * if the exception was caught.
+ *
+ * The verdict is stored in a tag of the exception's class, hence the type name
+ * is resolved and compared only for the first instance of each class.
+ * *exception_type is not filled when the verdict is taken from the tag or if
+ * the name cannot be interned.
  */
 static int exception_is_intended_to_be_reported(
         jvmtiEnv *jvmti_env,
         JNIEnv *jni_env,
         jobject exception_object,
-        char **exception_type)
+        const char **exception_type)
 {
     int retval = 0;
 
     if (globalConfig.reportedCaughExceptionTypes != NULL)
     {
-        if (NULL == *exception_type)
+        /* GetObjectClass() throws nothing */
+        jclass exception_class = (*jni_env)->GetObjectClass(jni_env, exception_object);
+        jlong verdict = EXCEPTION_CLASS_VERDICT_UNKNOWN;
+
+        jvmtiError error_code = (*jvmti_env)->GetTag(jvmti_env, exception_class, &verdict);
+        if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+            verdict = EXCEPTION_CLASS_VERDICT_UNKNOWN;
+
+        if (EXCEPTION_CLASS_VERDICT_UNKNOWN != verdict)
         {
-            *exception_type = get_exception_type_name(jvmti_env, jni_env, exception_object);
-            if (NULL == *exception_type)
-                return 0;
+            (*jni_env)->DeleteLocalRef(jni_env, exception_class);
+            return EXCEPTION_CLASS_VERDICT_REPORT == verdict;
         }
 
-        /* special cases for selected exceptions */
-        for (char **cursor = globalConfig.reportedCaughExceptionTypes; *cursor; ++cursor)
+        /* A name which could not be interned is not passed to the caller */
+        char *exception_type_copy = NULL;
+        const char *exception_type_name = *exception_type;
+        if (NULL == exception_type_name)
         {
-            if (strcmp(*cursor, *exception_type) == 0)
+            exception_type_name = get_exception_type_name(jvmti_env, jni_env, exception_object, &exception_type_copy);
+            if (NULL == exception_type_name)
             {
-                retval = 1;
-                break;
+                (*jni_env)->DeleteLocalRef(jni_env, exception_class);
+                return 0;
             }
+
+            if (NULL == exception_type_copy)
+            {
+                *exception_type = exception_type_name;
+            }
+        }
+
+        /* special cases for selected exceptions */
+        if (NULL != caughtExceptionMatcher)
+        {
+            retval = exception_matcher_match_class(caughtExceptionMatcher, jvmti_env, jni_env, exception_class, exception_type_name);
         }
+        free(exception_type_copy);
+
+        verdict = retval ? EXCEPTION_CLASS_VERDICT_REPORT : EXCEPTION_CLASS_VERDICT_IGNORE;
+        error_code = (*jvmti_env)->SetTag(jvmti_env, exception_class, verdict);
+        check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
+
+        (*jni_env)->DeleteLocalRef(jni_env, exception_class);
     }
 
     return retval;
@@ -617,13 +853,11 @@ static void add_process_properties_data(problem_data_t *pd)
 /*
  * Add additional debug info item.
  */
-static void add_additional_info_data(problem_data_t *pd, T_infoPair *additional_info)
+static void add_additional_info_data(problem_data_t *pd, const char *additional_info)
 {
-    char *contents = info_pair_vector_to_string(additional_info);
-    if (NULL != contents)
+    if (NULL != additional_info)
     {
-        problem_data_add_text_editable(pd, "java_custom_debug_info", contents);
-        free(contents);
+        problem_data_add_text_editable(pd, "java_custom_debug_info", additional_info);
     }
 }
 
@@ -637,7 +871,8 @@ static void register_abrt_event(
         const char *executable,
         const char *message,
         const char *backtrace,
-        T_infoPair *additional_info)
+        const char *additional_info,
+        size_t suppressed)
 {
     if ((globalConfig.reportErrosTo & ED_ABRT) == 0)
     {
@@ -667,6 +902,12 @@ static void register_abrt_event(
     add_jvm_environment_data(pd);
     add_process_properties_data(pd);
     add_additional_info_data(pd, additional_info);
+    if (0 != suppressed)
+    {
+        char suppressed_str[sizeof(size_t) * 3 + 1];
+        snprintf(suppressed_str, sizeof(suppressed_str), "%zu", suppressed);
+        problem_data_add_text_noteditable(pd, "java_suppressed_reports", suppressed_str);
+    }
     problem_data_add_text_noteditable(pd, "abrt-java-connector", VERSION);
 
     /* sends problem data to abrtd over the socket */
@@ -678,156 +919,470 @@ static void register_abrt_event(
 
 
 /*
- * Report a stack trace to all systems
+ * Writes a report to syslog
  */
-static void report_stacktrace(
-        const char *executable,
-        const char *message,
-        const char *stacktrace,
-        T_infoPair *additional_info)
+static void deliver_to_syslog(const T_dispatchedReport *report)
 {
-    if (globalConfig.reportErrosTo & ED_SYSLOG)
+    VERBOSE_PRINT("Reporting stack trace to syslog\n");
+    if (0 != report->suppressed)
     {
-        VERBOSE_PRINT("Reporting stack trace to syslog\n");
-        syslog(LOG_ERR, "%s\n%s", message, stacktrace);
+        syslog(LOG_ERR, "%s (%zu similar reports suppressed)\n%s", report->message, report->suppressed, report->stacktrace);
     }
-
-#if HAVE_SYSTEMD_JOURNAL
-    if (globalConfig.reportErrosTo & ED_JOURNALD)
+    else
     {
-        VERBOSE_PRINT("Reporting stack trace to JournalD\n");
-        sd_journal_send("MESSAGE=%s", message,
-                        "PRIORITY=%d", LOG_ERR,
-                        "STACK_TRACE=%s", stacktrace ? stacktrace : "no stack trace",
-                        NULL);
-
+        syslog(LOG_ERR, "%s\n%s", report->message, report->stacktrace);
     }
+}
+
+
+
+#if HAVE_SYSTEMD_JOURNAL
+/*
+ * Writes a report to systemd-journald
+ */
+static void deliver_to_journald(const T_dispatchedReport *report)
+{
+    VERBOSE_PRINT("Reporting stack trace to JournalD\n");
+    sd_journal_send("MESSAGE=%s", report->message,
+                    "PRIORITY=%d", LOG_ERR,
+                    "STACK_TRACE=%s", report->stacktrace ? report->stacktrace : "no stack trace",
+                    "SUPPRESSED_REPORTS=%zu", report->suppressed,
+                    NULL);
+}
 #endif
 
-    log_print("%s\n", message);
 
-    if (stacktrace)
+
+/*
+ * Writes a report to the log file
+ */
+static void deliver_to_log(const T_dispatchedReport *report)
+{
+    log_print("%s\n", report->message);
+
+    if (report->stacktrace)
     {
-        log_print("%s", stacktrace);
+        log_print("%s", report->stacktrace);
     }
-    if (executable)
+    if (report->executable)
     {
-        log_print("executable: %s\n", executable);
+        log_print("executable: %s\n", report->executable);
     }
-    if (additional_info)
+    if (report->additional_info)
     {
-        char *info = info_pair_vector_to_string(additional_info);
-        if (NULL != info)
-        {
-            log_print("%s\n", info);
-        }
-        free(info);
+        log_print("%s\n", report->additional_info);
     }
+    if (report->suppressed)
+    {
+        log_print("suppressed similar reports: %zu\n", report->suppressed);
+    }
+}
+
 
-    if (NULL != stacktrace)
+
+/*
+ * Submits a report to ABRT
+ */
+static void deliver_to_abrt(const T_dispatchedReport *report)
+{
+    if (NULL != report->stacktrace)
     {
         VERBOSE_PRINT("Reporting stack trace to ABRT");
-        register_abrt_event(executable, message, stacktrace, additional_info);
+        register_abrt_event(report->executable, report->message, report->stacktrace, report->additional_info, report->suppressed);
     }
 }
 
 
 
 /*
- * Returns logical true if exception occurred and clears it.
+ * Creates the report dispatcher with a sink for each enabled destination
  */
-static inline int check_and_clear_exception(
-        JNIEnv     *jni_env)
+static T_reportDispatcher *create_report_dispatcher(void)
 {
-        if ((*jni_env)->ExceptionOccurred(jni_env))
-        {
-#ifdef VERBOSE
-            (*jni_env)->ExceptionDescribe(jni_env);
+    T_reportDispatcher *dispatcher = report_dispatcher_new(REPORT_SINK_QUEUE_CAPACITY,
+            globalConfig.overflowPolicy, globalConfig.overflowTimeout);
+    if (NULL == dispatcher)
+    {
+        return NULL;
+    }
+
+    int error = 0;
+    if (globalConfig.reportErrosTo & ED_SYSLOG)
+    {
+        error |= report_dispatcher_add_sink(dispatcher, "syslog", &deliver_to_syslog);
+    }
+
+#if HAVE_SYSTEMD_JOURNAL
+    if (globalConfig.reportErrosTo & ED_JOURNALD)
+    {
+        error |= report_dispatcher_add_sink(dispatcher, "journald", &deliver_to_journald);
+    }
 #endif
-            (*jni_env)->ExceptionClear(jni_env);
-            return 1;
-        }
 
-        return 0;
+    if (DISABLED_LOG_OUTPUT != globalConfig.outputFileName)
+    {
+        error |= report_dispatcher_add_sink(dispatcher, "log", &deliver_to_log);
+    }
+
+    if (globalConfig.reportErrosTo & ED_ABRT)
+    {
+        error |= report_dispatcher_add_sink(dispatcher, "abrt", &deliver_to_abrt);
+    }
+
+    if (error)
+    {
+        report_dispatcher_free(dispatcher);
+        return NULL;
+    }
+
+    if (report_dispatcher_start(dispatcher))
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Some reports will be delivered synchronously.\n");
+    }
+
+    return dispatcher;
 }
 
 
 
 /*
- * Print a message when any JVM TI error occurs.
+ * Report a stack trace to all systems
  */
-static void print_jvmti_error(
-            jvmtiEnv   *jvmti_env,
-            jvmtiError  error_code,
-            const char *str)
+static void report_stacktrace(
+        T_arena    *arena,
+        const char *executable,
+        const char *message,
+        const char *stacktrace,
+        T_infoPair *additional_info,
+        int uncaught,
+        size_t suppressed)
 {
-    char *errnum_str;
-    const char *msg_str = str == NULL ? "" : str;
-    char *msg_err = NULL;
-    errnum_str = NULL;
-
-    /* try to convert error number to string */
-    (void)(*jvmti_env)->GetErrorName(jvmti_env, error_code, &errnum_str);
-    msg_err = errnum_str == NULL ? "Unknown" : errnum_str;
-    fprintf(stderr, "ERROR: JVMTI: %d(%s): %s\n", error_code, msg_err, msg_str);
-
-    if (NULL != errnum_str)
-        (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)errnum_str);
+    char *info = info_pair_vector_to_string(arena, additional_info);
+
+    const T_dispatchedReport report = {
+        .executable = executable,
+        .message = message,
+        .stacktrace = stacktrace,
+        .additional_info = info,
+        .uncaught = uncaught,
+        .suppressed = suppressed,
+    };
+
+    report_dispatcher_dispatch(reportDispatcher, &report);
 }
 
 
-static int get_tid(
-        JNIEnv   *jni_env,
-        jthread  thr,
-        jlong    *tid)
+
+/*
+ * Returns non zero value if too many reports with the same signature were
+ * submitted recently. Otherwise increases *suppressed by the number of
+ * reports suppressed since the last passed one.
+ *
+ * Must be called only for reports which are not duplicates, so that
+ * duplicates do not take tokens of new reports.
+ */
+static int report_rate_exceeded(uint64_t signature, size_t *suppressed)
 {
-    jclass thread_class = (*jni_env)->GetObjectClass(jni_env, thr);
-    if (NULL == thread_class)
+    size_t limited = 0;
+    if (NULL == reportRateLimiter || rate_limiter_acquire(reportRateLimiter, signature, &limited))
     {
-        VERBOSE_PRINT("Cannot get class of thread object\n");
-        return 1;
+        *suppressed += limited;
+        return 0;
     }
 
-    jmethodID get_id = (*jni_env)->GetMethodID(jni_env, thread_class, "getId", "()J" );
-    if (check_and_clear_exception(jni_env) || NULL == get_id)
+    VERBOSE_PRINT("Too many similar reports, suppressing the report\n");
+    return 1;
+}
+
+
+
+/*
+ * Remembers the fingerprint of an exception which is going to be reported
+ *
+ * @param suppressed Increased by the number of duplicates suppressed since
+ *        the fingerprint was remembered last time
+ * @returns Non zero value if the fingerprint was not remembered yet or its
+ *          remembrance expired; otherwise 0
+ */
+static int remember_reported_fingerprint(jlong fingerprint, size_t *suppressed)
+{
+    size_t duplicates = 0;
+    if (!fingerprint_set_insert(reportedExceptions, (uint64_t)fingerprint, &duplicates))
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of java/lang/Thread.getId()J\n");
-        return 1;
+        VERBOSE_PRINT("The exception was already reported!\n");
+        return 0;
     }
 
-    /* Thread.getId() throws nothing */
-    *tid = (*jni_env)->CallLongMethod(jni_env, thr, get_id);
-
-    return 0;
+    *suppressed += duplicates;
+    return 1;
 }
 
 
 
 /*
- * Takes information about an exception and returns human readable string
- * describing the exception's occurrence.
+ * Returns the number of seconds a reported failure is remembered for
  *
- * Cuts the description to not exceed MAX_REASON_MESSAGE_STRING_LENGTH
- * characters.
+ * Without the rate limiter the same failure is reported only once. With the
+ * limiter a failure is reported again after the limiter's period and the
+ * report counts the duplicates suppressed in the meantime, hence repeated
+ * failures still reach the limiter.
  */
-static char *format_exception_reason_message(
-        int caught,
-        const char *exception_fqdn,
-        const char *class_fqdn,
-        const char *method)
+static unsigned get_reported_exception_ttl(void)
 {
-    const char *exception_name = exception_fqdn;
-    const char *class_name = class_fqdn;
-    const char *prefix = caught ? "Caught" : "Uncaught";
-
-    char *message = (char*)calloc(MAX_REASON_MESSAGE_STRING_LENGTH + 1, sizeof(char));
-    if (message == NULL)
+    if (globalConfig.rateLimit <= 0)
     {
-        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc(): out of memory");
-        return NULL;
+        return 0;
     }
 
-    while (1)
+    const double period = 1.0 / globalConfig.rateLimit;
+    if (period >= (double)UINT32_MAX)
+    {
+        return 0;
+    }
+
+    const unsigned ttl = (unsigned)period;
+    return ttl < period ? ttl + 1 : ttl;
+}
+
+
+
+/*
+ * Prints agent's counters
+ */
+static void print_statistics(void)
+{
+    FILE *out = get_log_file();
+    if (NULL == out)
+    {
+        out = stderr;
+    }
+
+    fprintf(out, "abrt-java-connector statistics:\n");
+
+    const size_t sinks = report_dispatcher_sink_count(reportDispatcher);
+    for (size_t i = 0; i < sinks; ++i)
+    {
+        T_reportSinkStatistics stats;
+        report_dispatcher_sink_statistics(reportDispatcher, i, &stats);
+        fprintf(out, "  sink %s: delivered %zu, dropped %zu\n", stats.name, stats.delivered, stats.dropped);
+    }
+
+    if (NULL != reportWorkers)
+    {
+        size_t dropped = 0;
+        worker_pool_statistics(reportWorkers, &dropped);
+        fprintf(out, "  report workers: dropped %zu\n", dropped);
+    }
+
+    size_t hits = 0;
+    size_t evictions = 0;
+    fingerprint_set_statistics(reportedExceptions, &hits, &evictions);
+    fprintf(out, "  duplicates: suppressed %zu, evicted fingerprints %zu\n", hits, evictions);
+
+    fprintf(out, "  exceptions: held %zu (peak %zu), pending %zu (peak %zu)\n",
+            __sync_add_and_fetch(&heldExceptions, 0), __sync_add_and_fetch(&heldExceptionsPeak, 0),
+            __sync_add_and_fetch(&pendingExceptions, 0), __sync_add_and_fetch(&pendingExceptionsPeak, 0));
+
+    if (NULL != reportRateLimiter)
+    {
+        size_t passed = 0;
+        size_t suppressed = 0;
+        rate_limiter_statistics(reportRateLimiter, &passed, &suppressed);
+        fprintf(out, "  rate limiter: passed %zu, suppressed %zu\n", passed, suppressed);
+    }
+
+    if (NULL != symbols)
+    {
+        size_t misses = 0;
+        size_t memory = 0;
+        string_table_statistics(symbols, &hits, &misses, &memory);
+        fprintf(out, "  symbols: shared %zu, interned %zu, memory %zu B\n", hits, misses, memory);
+    }
+
+    if (NULL != classLocationStrings)
+    {
+        size_t misses = 0;
+        size_t memory = 0;
+        string_table_statistics(classLocationStrings, &hits, &misses, &memory);
+        fprintf(out, "  class location strings: shared %zu, interned %zu, memory %zu B\n", hits, misses, memory);
+    }
+
+    if (NULL != classLocations)
+    {
+        size_t misses = 0;
+        class_location_cache_statistics(classLocations, &hits, &misses);
+        fprintf(out, "  class locations: cached %zu, resolved %zu\n", hits, misses);
+    }
+
+    if (NULL != frameCache)
+    {
+        size_t misses = 0;
+        size_t memory = 0;
+        frame_cache_statistics(frameCache, &hits, &misses, &memory);
+        fprintf(out, "  frames: cached %zu, formatted %zu, memory %zu B\n", hits, misses, memory);
+    }
+
+    if (NULL != lineNumbers)
+    {
+        size_t misses = 0;
+        size_t memory = 0;
+        line_number_cache_statistics(lineNumbers, &hits, &misses, &memory);
+        fprintf(out, "  line numbers: cached %zu, resolved %zu, memory %zu B\n", hits, misses, memory);
+    }
+
+    const size_t methods = NULL != debugMethods ? debug_methods_count(debugMethods) : 0;
+    for (size_t i = 0; i < methods; ++i)
+    {
+        T_debugMethodStatistics stats;
+        debug_methods_statistics(debugMethods, i, &stats);
+        fprintf(out, "  debug method %s: called %zu, failed %zu, cached %zu, timed out %zu, latency avg %" PRIu64 " us, max %" PRIu64 " us\n",
+                stats.label, stats.calls, stats.failures, stats.cached, stats.timeouts,
+                0 == stats.calls ? 0 : stats.total_latency / stats.calls, stats.max_latency);
+    }
+}
+
+
+
+/*
+ * Returns logical true if exception occurred and clears it.
+ */
+static inline int check_and_clear_exception(
+        JNIEnv     *jni_env)
+{
+        if ((*jni_env)->ExceptionOccurred(jni_env))
+        {
+#ifdef VERBOSE
+            (*jni_env)->ExceptionDescribe(jni_env);
+#endif
+            (*jni_env)->ExceptionClear(jni_env);
+            return 1;
+        }
+
+        return 0;
+}
+
+
+
+/*
+ * Print a message when any JVM TI error occurs.
+ */
+static void print_jvmti_error(
+            jvmtiEnv   *jvmti_env,
+            jvmtiError  error_code,
+            const char *str)
+{
+    char *errnum_str;
+    const char *msg_str = str == NULL ? "" : str;
+    char *msg_err = NULL;
+    errnum_str = NULL;
+
+    /* try to convert error number to string */
+    (void)(*jvmti_env)->GetErrorName(jvmti_env, error_code, &errnum_str);
+    msg_err = errnum_str == NULL ? "Unknown" : errnum_str;
+    fprintf(stderr, "ERROR: JVMTI: %d(%s): %s\n", error_code, msg_err, msg_str);
+
+    if (NULL != errnum_str)
+        (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)errnum_str);
+}
+
+
+static int get_tid(
+        JNIEnv   *jni_env,
+        jthread  thr,
+        jlong    *tid)
+{
+    const T_jniIds *ids = jni_ids_get(jni_env);
+    if (NULL == ids)
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of java/lang/Thread.getId()J\n");
+        return 1;
+    }
+
+    /* Thread.getId() throws nothing */
+    *tid = (*jni_env)->CallLongMethod(jni_env, thr, ids->thread_get_id);
+
+    return 0;
+}
+
+
+
+/*
+ * Returns agent's data of the current thread
+ *
+ * @param thread The current thread
+ * @param create Create the data if the thread has none yet
+ * @returns The thread's data; NULL if the thread has no data or on errors
+ */
+static T_threadState *get_thread_state(
+        jvmtiEnv *jvmti_env,
+        JNIEnv   *jni_env,
+        jthread   thread,
+        int       create)
+{
+    T_threadState *state = NULL;
+
+    /* NULL stands for the current thread and saves a handle resolution */
+    jvmtiError error_code = (*jvmti_env)->GetThreadLocalStorage(jvmti_env, NULL, (void **)&state);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+    {
+        return NULL;
+    }
+
+    if (NULL != state || !create)
+    {
+        return state;
+    }
+
+    state = (T_threadState *)calloc(1, sizeof(*state));
+    if (NULL == state)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc(): out of memory\n");
+        return NULL;
+    }
+
+    if (get_tid(jni_env, thread, &(state->tid)))
+    {
+        VERBOSE_PRINT("Cannot get thread's ID.\n");
+    }
+
+    error_code = (*jvmti_env)->SetThreadLocalStorage(jvmti_env, NULL, state);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+    {
+        free(state);
+        return NULL;
+    }
+
+    return state;
+}
+
+
+
+/*
+ * Takes information about an exception and returns human readable string
+ * describing the exception's occurrence.
+ *
+ * Cuts the description to not exceed MAX_REASON_MESSAGE_STRING_LENGTH
+ * characters.
+ */
+static char *format_exception_reason_message(
+        T_arena *arena,
+        int caught,
+        const char *exception_fqdn,
+        const char *class_fqdn,
+        const char *method)
+{
+    const char *exception_name = exception_fqdn;
+    const char *class_name = class_fqdn;
+    const char *prefix = caught ? "Caught" : "Uncaught";
+
+    /* snprintf() always terminates the message, no need to zero it */
+    char *message = (char*)arena_alloc(arena, MAX_REASON_MESSAGE_STRING_LENGTH + 1);
+    if (message == NULL)
+    {
+        return NULL;
+    }
+
+    while (1)
     {
         const int message_len = snprintf(message, MAX_REASON_MESSAGE_STRING_LENGTH,
                 "%s exception %s in method %s%s%s()", prefix,
@@ -837,7 +1392,6 @@ static char *format_exception_reason_message(
         if (message_len <= 0)
         {
             fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": snprintf(): can't print reason message to memory on stack\n");
-            free(message);
             return NULL;
         }
         else if (message_len >= MAX_REASON_MESSAGE_STRING_LENGTH)
@@ -995,6 +1549,26 @@ static void exit_critical_section(
 
 
 
+/*
+ * Enables or disables delivery of JVMTI_EVENT_EXCEPTION_CATCH for a single
+ * thread.
+ *
+ * The event is needed only while a thread has a pending uncaught exception
+ * report, so it is not enabled globally.
+ */
+static void set_exception_catch_notification_mode(
+            jvmtiEnv *jvmti_env,
+            jthread thread,
+            jvmtiEventMode mode)
+{
+    jvmtiError error_code;
+
+    error_code = (*jvmti_env)->SetEventNotificationMode(jvmti_env, mode, JVMTI_EVENT_EXCEPTION_CATCH, thread);
+    check_jvmti_error(jvmti_env, error_code, "Cannot set exception catch event notification");
+}
+
+
+
 /*
  * Get a name for a given jthread.
  */
@@ -1129,11 +1703,13 @@ static void string_replace(char *string_to_replace, char old_char, char new_char
 
 
 /*
- * Appends '.' and returns the result a newly mallocated memory
+ * Appends '.' and returns the result in a newly allocated memory
+ *
+ * @param arena Arena the result is allocated from or NULL to malloc it
  */
-static char * create_updated_class_name(char *class_name)
+static char * create_updated_class_name(T_arena *arena, char *class_name)
 {
-    char *upd_class_name = (char*)malloc(strlen(class_name)+2);
+    char *upd_class_name = (char*)(NULL != arena ? arena_alloc(arena, strlen(class_name)+2) : malloc(strlen(class_name)+2));
     if (NULL == upd_class_name)
     {
         fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory");
@@ -1219,7 +1795,7 @@ static char *get_main_class(
     }
 
     /* add '.' at the end of class name */
-    char *upd_class_name = create_updated_class_name(class_name);
+    char *upd_class_name = create_updated_class_name(/*malloc*/NULL, class_name);
 
     (*jvmti_env)->Deallocate(jvmti_env, (unsigned char*)class_name);
 
@@ -1229,7 +1805,8 @@ static char *get_main_class(
         return NULL;
     }
 
-    char *path_to_class = get_path_to_class(jvmti_env, jni_env, cls, upd_class_name, GET_PATH_METHOD_NAME);
+    char *path_to_class = NULL;
+    get_class_location(jvmti_env, jni_env, cls, upd_class_name, /*external form*/NULL, &path_to_class);
 
     free(upd_class_name);
 
@@ -1338,102 +1915,65 @@ static void print_jvm_environment_variables_to_file(FILE *out)
 
 
 /*
- * Goes throw the list of FQDN static methods returning java.Lang.String, tries
- * to call them and returns their results in an array terminated by empty
- * entry.
+ * Goes throw the list of FQDN static methods returning java.Lang.String, gets
+ * their results and returns them in an array terminated by empty entry.
+ *
+ * Only methods of already loaded classes are called as we don't want to use
+ * Class Loader to find the class on disk. This approach ensures that the
+ * debug method is called only for relevant applications.
+ *
+ * The methods are called on their own agent thread and a report waits for
+ * each of them only for a limited time.
  */
 static T_infoPair *collect_additional_debug_information(
         jvmtiEnv *jvmti_env,
-        JNIEnv   *jni_env)
+        JNIEnv   *jni_env,
+        T_arena  *arena)
 {
-    if (NULL == globalConfig.fqdnDebugMethods)
+    if (NULL == debugMethods)
     {
         return NULL;
     }
 
-    size_t cnt = 0;
-    const char *const *iter = (const char *const *)globalConfig.fqdnDebugMethods;
-    for ( ; NULL != *iter; ++iter)
-    {
-        ++cnt;
-    }
-
-    T_infoPair *ret_val = (T_infoPair *)malloc(sizeof(*ret_val) * (cnt + 1));
+    const size_t cnt = debug_methods_count(debugMethods);
+    T_infoPair *ret_val = (T_infoPair *)arena_alloc(arena, sizeof(*ret_val) * (cnt + 1));
     if (NULL == ret_val)
     {
-        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory");
         return NULL;
     }
 
     T_infoPair *info = ret_val;
-    iter = (const char *const *)globalConfig.fqdnDebugMethods;
-    for( ; NULL != *iter; ++iter)
+    for (size_t i = 0; i < cnt; ++i)
     {
-        char *debug_class_name_str = strdup(*iter);
-        if (debug_class_name_str == NULL)
-        {
-            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": strdup(): out of memory");
-            /* We want to finish this method call */
-            break;
-        }
-
-        /* name.space.class.method -> name.space.class + method
-         */
-        char *debug_method_name = strrchr(debug_class_name_str, '.');
-        if (NULL == debug_method_name)
-        {
-            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Debug method '%s' is not in FQDN format\n", debug_class_name_str);
-            goto next_debug_method;
-        }
-
-        debug_method_name[0] = '\0';
-        ++debug_method_name;
-
-        /* Try to find instance of Class class for the debug class name.
-         * Looks only in the list of already loaded classes as we don't
-         * want to use Class Loader to find the class on disk. This
-         * approache ensures that the debug method is called only for
-         * relevant applications.
-         */
-        jclass debug_class = find_class_in_loaded_class(jvmti_env, jni_env, debug_class_name_str);
-        if (NULL == debug_class)
-        {
-            VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not find class of '%s'\n", *iter);
-            goto next_debug_method;
-        }
-
-        jmethodID debug_method = (*jni_env)->GetStaticMethodID(jni_env, debug_class, debug_method_name, "()Ljava/lang/String;");
-        if (check_and_clear_exception(jni_env) || NULL == debug_method)
-        {
-            VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not find debug method '%s'\n", *iter);
-            goto next_debug_method;
-        }
+        const char *label = NULL;
+        jclass debug_class = NULL;
+        jmethodID debug_method = NULL;
 
-        jstring debug_string = (*jni_env)->CallStaticObjectMethod(jni_env, debug_class, debug_method);
-        if (check_and_clear_exception(jni_env))
+        if (debug_methods_get(debugMethods, jni_env, i, &label, &debug_class, &debug_method)
+            && !__sync_add_and_fetch(&loadedClassesIndexed, 0))
         {
-            VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Exception occurred in debug method '%s'\n", *iter);
-            goto next_debug_method;
+            /* ClassPrepare callback does not resolve the methods yet */
+            jclass loaded_class = find_class_in_loaded_class(jvmti_env, jni_env, debug_methods_class_name(debugMethods, i));
+            if (NULL != loaded_class)
+            {
+                debug_methods_resolve(debugMethods, jvmti_env, jni_env, debug_methods_class_name(debugMethods, i), loaded_class);
+                (*jni_env)->DeleteLocalRef(jni_env, loaded_class);
+            }
         }
 
-        info->label = *iter;
+        if (NULL != debug_class)
         {
-            char *tmp = (char*)(*jni_env)->GetStringUTFChars(jni_env, debug_string, NULL);
-            info->data = strdup(tmp);
-            (*jni_env)->ReleaseStringUTFChars(jni_env, debug_string, tmp);
+            (*jni_env)->DeleteLocalRef(jni_env, debug_class);
         }
 
+        info->label = label;
+        info->data = debug_methods_invoke(debugMethods, i, arena);
         if (NULL == info->data)
         {
-            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": strdup(): out of memory");
-            /* We want to finish this method call */
-            break;
+            continue;
         }
 
         ++info;
-
-next_debug_method:
-        free(debug_class_name_str);
     }
 
     /* stop */
@@ -1446,287 +1986,437 @@ next_debug_method:
 
 
 /*
- * Called right after JVM started up.
+ * Adds a class to the index of loaded classes and resolves debug methods
+ * declared by the class.
  */
-static void JNICALL callback_on_vm_init(
+static void index_loaded_class(
             jvmtiEnv *jvmti_env,
             JNIEnv   *jni_env,
-            jthread   thread)
+            jclass    class)
 {
-    char tname[MAX_THREAD_NAME_LENGTH];
+    char *class_signature = NULL;
+    jvmtiError error_code = (*jvmti_env)->GetClassSignature(jvmti_env, class, &class_signature, NULL);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+    {
+        return;
+    }
 
-    enter_critical_section(jvmti_env, shared_lock);
+    /* Arrays and primitive types are never looked up */
+    if ('L' == class_signature[0])
+    {
+        const char *class_name = format_class_name(class_signature, '\0');
 
-    INFO_PRINT("Got VM init event\n");
-    get_thread_name(jvmti_env , thread, tname, sizeof(tname));
-    INFO_PRINT("callbackVMInit:  %s thread\n", tname);
+        if (NULL != loadedClasses)
+            class_index_add(loadedClasses, jni_env, class_name, class);
 
-    fill_jvm_environment(jvmti_env);
-    fill_process_properties(jvmti_env, jni_env);
-#if PRINT_JVM_ENVIRONMENT_VARIABLES == 1
-    print_jvm_environment_variables();
-    print_process_properties();
-#endif
-    exit_critical_section(jvmti_env, shared_lock);
+        if (NULL != debugMethods)
+            debug_methods_resolve(debugMethods, jvmti_env, jni_env, class_name, class);
+    }
+
+    error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)class_signature);
+    check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
 }
 
 
 
-#if ABRT_VM_DEATH_CHECK
 /*
- * Called before JVM shuts down.
+ * Starts maintaining the index of loaded classes and the debug methods.
+ *
+ * New classes are added by ClassPrepare callback and classes loaded before
+ * are taken from JVMTI::GetLoadedClasses().
  */
-static void JNICALL callback_on_vm_death(
+static void index_loaded_classes(
             jvmtiEnv *jvmti_env,
-            JNIEnv   *env __UNUSED_VAR)
+            JNIEnv   *jni_env)
 {
-    enter_critical_section(jvmti_env, shared_lock);
-    INFO_PRINT("Got VM Death event\n");
-    exit_critical_section(jvmti_env, shared_lock);
-}
-#endif /* ABRT_VM_DEATH_CHECK */
+    /* Enabled first, so no class is missed. Already indexed classes are
+     * ignored. */
+    jvmtiError error_code = (*jvmti_env)->SetEventNotificationMode(jvmti_env, JVMTI_ENABLE, JVMTI_EVENT_CLASS_PREPARE, (jthread)NULL);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+    {
+        return;
+    }
+
+    jint num_classes = 0;
+    jclass *loaded_classes = NULL;
+    error_code = (*jvmti_env)->GetLoadedClasses(jvmti_env, &num_classes, &loaded_classes);
+    if (check_jvmti_error(jvmti_env, error_code, "jvmtiEnv::GetLoadedClasses()"))
+    {
+        return;
+    }
 
+    for (jint i = 0; i < num_classes; ++i)
+    {
+        index_loaded_class(jvmti_env, jni_env, loaded_classes[i]);
+        (*jni_env)->DeleteLocalRef(jni_env, loaded_classes[i]);
+    }
 
+    (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)loaded_classes);
 
-/*
- * Former callback_on_thread_start but it is not necessary to create an empty
- * structures and waste CPU time because it is more likely that no exception
- * will occur during the thread's lifetime. So, we converted the callback to a
- * function which can be used for initialization of the internal structures.
- */
-static T_jthrowableCircularBuf *create_exception_buf_for_thread(
-            JNIEnv   *jni_env,
-            jlong tid)
-{
-    T_jthrowableCircularBuf *threads_exc_buf = jthrowable_circular_buf_new(jni_env, REPORTED_EXCEPTION_STACK_CAPACITY);
-    if (NULL == threads_exc_buf)
+    if (NULL != loadedClasses)
     {
-        fprintf(stderr, "Cannot enable check for already reported exceptions. Disabling reporting to ABRT in current thread!");
-        return NULL;
+        VERBOSE_PRINT("Indexed %zu loaded classes\n", class_index_size(loadedClasses));
     }
 
-    jthread_map_push(threadMap, tid, (void *)threads_exc_buf);
-    return threads_exc_buf;
+    __sync_add_and_fetch(&loadedClassesIndexed, 1);
 }
 
 
 
 /*
- * Called before thread end.
+ * Called when a class is prepared, i.e. before any code of the class runs.
  */
-static void JNICALL callback_on_thread_end(
-            jvmtiEnv *jvmti_env __UNUSED_VAR,
+static void JNICALL callback_on_class_prepare(
+            jvmtiEnv *jvmti_env,
             JNIEnv   *jni_env,
-            jthread  thread)
+            jthread   thread __UNUSED_VAR,
+            jclass    klass)
 {
-    INFO_PRINT("ThreadEnd\n");
-    if (NULL == threadMap)
-    {
-        return;
-    }
+    index_loaded_class(jvmti_env, jni_env, klass);
+}
+
+
+
+/*
+ * Called right after JVM started up.
+ */
+static void JNICALL callback_on_vm_init(
+            jvmtiEnv *jvmti_env,
+            JNIEnv   *jni_env,
+            jthread   thread)
+{
+    char tname[MAX_THREAD_NAME_LENGTH];
+
+    enter_critical_section(jvmti_env, shared_lock);
+
+    INFO_PRINT("Got VM init event\n");
+    get_thread_name(jvmti_env , thread, tname, sizeof(tname));
+    INFO_PRINT("callbackVMInit:  %s thread\n", tname);
 
-    if (!jthread_map_empty(threadMap) || !jthread_map_empty(uncaughtExceptionMap))
+    /* The classes can be surely found now */
+    if (NULL == jni_ids_get(jni_env))
     {
-        jlong tid = 0;
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot resolve IDs of Java methods used in reports\n");
+    }
 
-        if (get_tid(jni_env, thread, &tid))
-        {
-            VERBOSE_PRINT("Cannot free thread's exception buffer because cannot get TID");
-            return;
-        }
+    fill_jvm_environment(jvmti_env);
+    fill_process_properties(jvmti_env, jni_env);
+#if PRINT_JVM_ENVIRONMENT_VARIABLES == 1
+    print_jvm_environment_variables();
+    print_process_properties();
+#endif
+    exit_critical_section(jvmti_env, shared_lock);
+
+    if (NULL != loadedClasses || NULL != debugMethods)
+    {
+        index_loaded_classes(jvmti_env, jni_env);
+    }
 
-        T_exceptionReport *rpt = (T_exceptionReport *)jthread_map_pop(uncaughtExceptionMap, tid);
-        T_jthrowableCircularBuf *threads_exc_buf = (T_jthrowableCircularBuf *)jthread_map_pop(threadMap, tid);
+    if (NULL != debugMethods && 0 != debug_methods_start(debugMethods, jvmti_env, jni_env))
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot start a thread for debug methods. Debug methods will not be called.\n");
+    }
 
-        if (NULL != rpt)
-        {
-            if (NULL == threads_exc_buf || NULL == jthrowable_circular_buf_find(threads_exc_buf, rpt->exception_object))
-            {
-                report_stacktrace(NULL != rpt->executable ? rpt->executable : processProperties.main_class,
-                                  NULL != rpt->message ? rpt->message : "Uncaught exception",
-                                  rpt->stacktrace, rpt->additional_info);
-            }
+    /* Agent threads can be started only in the live phase. Reports are
+     * processed on the throwing threads until the workers are running. */
+    if (NULL != reportWorkers && 0 == worker_pool_start(reportWorkers, jvmti_env, jni_env))
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot start report workers. Reports will be processed synchronously.\n");
+    }
+}
 
-            exception_report_free(rpt);
-        }
 
-        if (threads_exc_buf != NULL)
+
+/*
+ * Called before JVM shuts down.
+ */
+static void JNICALL callback_on_vm_death(
+            jvmtiEnv *jvmti_env,
+            JNIEnv   *jni_env)
+{
+    INFO_PRINT("Got VM Death event\n");
+
+    /* Deliver all queued reports before JVM disappears */
+    worker_pool_stop(reportWorkers, jvmti_env, jni_env);
+    debug_methods_stop(debugMethods, jvmti_env, jni_env);
+    report_dispatcher_stop(reportDispatcher);
+    exception_matcher_release_classes(caughtExceptionMatcher, jni_env);
+
+    if (globalConfig.statistics)
+    {
+        print_statistics();
+    }
+}
+
+
+
+/*
+ * Called before thread end.
+ */
+static void JNICALL callback_on_thread_end(
+            jvmtiEnv *jvmti_env,
+            JNIEnv   *jni_env,
+            jthread  thread)
+{
+    INFO_PRINT("ThreadEnd\n");
+
+    /* Threads which have never thrown an exception have no data */
+    T_threadState *thread_state = get_thread_state(jvmti_env, jni_env, thread, /*create*/0);
+    if (NULL == thread_state)
+    {
+        return;
+    }
+
+    jvmtiError error_code = (*jvmti_env)->SetThreadLocalStorage(jvmti_env, NULL, NULL);
+    check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
+
+    const jlong tid = thread_state->tid;
+    T_exceptionReport *rpt = thread_state->uncaught_report;
+    free(thread_state->frames);
+    free(thread_state);
+
+    if (NULL != rpt)
+    {
+        set_exception_catch_notification_mode(jvmti_env, thread, JVMTI_DISABLE);
+
+        /* Only confirmed uncaught exceptions are formatted */
+        if (0 == exception_report_resolve(jni_env, rpt, /*no local reference*/NULL)
+            && !fingerprint_set_contains(reportedExceptions, rpt->fingerprint)
+            && remember_reported_fingerprint(rpt->fingerprint, &(rpt->suppressed))
+            && !report_rate_exceeded(rpt->signature, &(rpt->suppressed)))
         {
-            jthrowable_circular_buf_free(threads_exc_buf);
+            submit_exception_report(jvmti_env, jni_env, tid, rpt);
+            rpt = NULL;
         }
+
+        exception_report_free(jni_env, rpt);
     }
 }
 
 
-#ifdef GENERATE_JVMTI_STACK_TRACE
 /*
  * Get line number for given method and location in this method.
+ *
+ * @param loader_id ID of the class loader of method's class if the line
+ *        number table can be cached; otherwise NULL
+ * @returns The line number or -1 if it is not known
  */
 static int get_line_number(
-            jvmtiEnv  *jvmti_env,
-            jmethodID  method,
-            jlocation  location)
-{
-    int count;
-    int line_number = 0;
-    int i;
-    jvmtiLineNumberEntry *location_table;
+            jvmtiEnv       *jvmti_env,
+            jmethodID       method,
+            jlocation       location,
+            const uint64_t *loader_id)
+{
+    jint count = 0;
+    int line_number = -1;
+    jvmtiLineNumberEntry *location_table = NULL;
     jvmtiError error_code;
 
-    /* how can we recognize an illegal value of the location variable.
-     * Documentation says:
+    /* Documentation says:
      *   A 64 bit value, representing a monotonically increasing executable
      *   position within a method. -1 indicates a native method.
-     *
-     * we use 0 for now.
      */
-    if (NULL == method || 0 == location)
+    if (NULL == method || location < 0)
     {
         return -1;
     }
 
+    /* Tables are cached only for classes with a known loader, but a cached
+     * table is valid for any caller */
+    if (NULL != lineNumbers && 0 == line_number_cache_get(lineNumbers, method, location, &line_number))
+    {
+        return line_number;
+    }
+
     /* read table containing line numbers and instruction indexes */
     error_code = (*jvmti_env)->GetLineNumberTable(jvmti_env, method, &count, &location_table);
     /* it is possible, that we are unable to read the table -> missing debuginfo etc. */
     if (error_code != JVMTI_ERROR_NONE)
     {
-        if (location_table != NULL)
+        /* remember methods without line numbers too */
+        if (NULL != lineNumbers && NULL != loader_id
+                && (JVMTI_ERROR_ABSENT_INFORMATION == error_code || JVMTI_ERROR_NATIVE_METHOD == error_code))
         {
-            (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)location_table);
+            line_number_cache_put(lineNumbers, method, *loader_id, NULL, 0);
         }
+
         return -1;
     }
 
-    /* iterate over the read table */
-    for (i = 0; i < count - 1; i++)
+    T_lineNumber *table = (0 < count ? (T_lineNumber *)malloc(count * sizeof(*table)) : NULL);
+    if (NULL == table)
     {
-        jvmtiLineNumberEntry entry1 = location_table[i];
-        jvmtiLineNumberEntry entry2 = location_table[i+1];
-        /* entry1 and entry2 are copies allocated on the stack:          */
-        /*   how can we recognize that location_table[i] is valid value? */
-        /*                                                               */
-        /* we hope that all array values are valid for now               */
-
-        /* if location is between entry1 (including) and entry2 (excluding), */
-        /* we are on the right line */
-        if (location >= entry1.start_location && location < entry2.start_location)
+        /* the entries are ordered by start_location; the line of the location
+         * is the line of the last entry starting before or at the location */
+        for (jint i = 0; i < count && location_table[i].start_location <= location; ++i)
         {
-            line_number = entry1.line_number;
-            break;
+            line_number = location_table[i].line_number;
         }
     }
-
-    /* last instruction is handled specifically */
-    if (location >= location_table[count-1].start_location)
+    else
     {
-        line_number = location_table[count-1].line_number;
+        for (jint i = 0; i < count; ++i)
+        {
+            table[i].start_location = location_table[i].start_location;
+            table[i].line_number = location_table[i].line_number;
+        }
+
+        line_number_table_sort(table, (size_t)count);
+        line_number = line_number_table_find(table, (size_t)count, location);
+
+        if (NULL != lineNumbers && NULL != loader_id)
+        {
+            line_number_cache_put(lineNumbers, method, *loader_id, table, (size_t)count);
+        }
+
+        free(table);
     }
 
     /* memory deallocation */
     (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)location_table);
     return line_number;
 }
-#endif /* GENERATE_JVMTI_STACK_TRACE */
 
 
 
 /*
- * Return path to given class using given class loader.
+ * Converts a URL to a string by calling one of its methods.
+ *
+ * @returns Mallocated string; NULL on errors
  */
-static char* get_path_to_class_class_loader(
-            jvmtiEnv *jvmti_env __UNUSED_VAR,
+static char *url_to_string(
             JNIEnv   *jni_env,
-            jclass    class_loader,
-            char     *class_name,
-            const char *stringize_method_name)
+            jobject   url,
+            jmethodID to_string)
 {
-    char *out = NULL;
-    jclass class_loader_class = NULL;
-
-    char *upd_class_name = (char*)malloc(strlen(class_name) + sizeof("class") + 1);
-    if (NULL == upd_class_name)
+    jstring jstr = (jstring)(*jni_env)->CallObjectMethod(jni_env, url, to_string);
+    if (check_and_clear_exception(jni_env) || jstr ==  NULL)
     {
-        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory");
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Failed to convert an URL object to a string\n");
         return NULL;
     }
 
-    strcpy(upd_class_name, class_name);
-    strcat(upd_class_name, "class");
-
-    /* find ClassLoader class */
-    class_loader_class = (*jni_env)->FindClass(jni_env, "java/lang/ClassLoader");
-    if (check_and_clear_exception(jni_env) || class_loader_class ==  NULL)
+    /* convert Java String into C char* */
+    const char *str = (*jni_env)->GetStringUTFChars(jni_env, jstr, NULL);
+    char *out = NULL;
+    if (NULL != str)
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get class of java/lang/ClassLoader\n");
-        free(upd_class_name);
-        return NULL;
+        out = strdup(str);
+        if (out == NULL)
+        {
+            fprintf(stderr, "strdup(): out of memory");
+        }
+
+        (*jni_env)->ReleaseStringUTFChars(jni_env, jstr, str);
     }
 
-    /* find method ClassLoader.getResource() */
-    jmethodID get_resource = (*jni_env)->GetMethodID(jni_env, class_loader_class, "getResource", "(Ljava/lang/String;)Ljava/net/URL;");
-    if (check_and_clear_exception(jni_env) || get_resource ==  NULL)
+    (*jni_env)->DeleteLocalRef(jni_env, jstr);
+    return out;
+}
+
+
+
+/*
+ * Resolves location of given class using given class loader.
+ *
+ * @param external_form Filled with mallocated URL.toExternalForm() of the
+ *        class file or NULL
+ * @param path Filled with mallocated URL.getPath() of the class file or NULL
+ */
+static void resolve_class_location(
+            JNIEnv     *jni_env,
+            jobject     class_loader,
+            const char *class_name,
+            char      **external_form,
+            char      **path)
+{
+    *external_form = NULL;
+    *path = NULL;
+
+    const T_jniIds *ids = jni_ids_get(jni_env);
+    if (NULL == ids)
     {
         VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of java/lang/ClassLoader.getResource(Ljava/lang/String;)Ljava/net/URL;\n");
-        free(upd_class_name);
-        (*jni_env)->DeleteLocalRef(jni_env, class_loader_class);
-        return NULL;
+        return;
+    }
+
+    char *upd_class_name = (char*)malloc(strlen(class_name) + sizeof("class") + 1);
+    if (NULL == upd_class_name)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory");
+        return;
     }
 
+    strcpy(upd_class_name, class_name);
+    strcat(upd_class_name, "class");
+
     /* convert new class name into a Java String */
     jstring j_class_name = (*jni_env)->NewStringUTF(jni_env, upd_class_name);
     free(upd_class_name);
     if (check_and_clear_exception(jni_env))
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not allocate a new UTF string for '%s'\n", upd_class_name);
-        goto get_path_to_class_class_loader_lcl_refs_cleanup;
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not allocate a new UTF string for '%sclass'\n", class_name);
+        return;
     }
 
     /* call method ClassLoader.getResource(className) */
-    jobject url = (*jni_env)->CallObjectMethod(jni_env, class_loader, get_resource, j_class_name);
+    jobject url = (*jni_env)->CallObjectMethod(jni_env, class_loader, ids->class_loader_get_resource, j_class_name);
     if (check_and_clear_exception(jni_env) || NULL == url)
     {
         VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get a resource of %s\n", class_name);
-        goto get_path_to_class_class_loader_lcl_refs_cleanup;
+        goto resolve_class_location_lcl_refs_cleanup;
     }
 
-    /* find method URL.toString() */
-    jclass url_class = (*jni_env)->FindClass(jni_env, "java/net/URL");
-    if (check_and_clear_exception(jni_env) || NULL == url_class)
+    *external_form = url_to_string(jni_env, url, ids->url_to_external_form);
+    *path = url_to_string(jni_env, url, ids->url_get_path);
+
+    (*jni_env)->DeleteLocalRef(jni_env, url);
+
+resolve_class_location_lcl_refs_cleanup:
+    (*jni_env)->DeleteLocalRef(jni_env, j_class_name);
+}
+
+
+
+/*
+ * Returns a unique ID of a class loader stored in the class loader's tag in
+ * classLoaderEnv.
+ *
+ * The ID is assigned on the first call for each class loader.
+ *
+ * @returns The ID; 0 on errors
+ */
+static jlong get_class_loader_id(
+            jobject   class_loader)
+{
+    jvmtiEnv *jvmti_env = classLoaderEnv;
+    if (NULL == jvmti_env)
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get class of java/net/URL\n");
-        goto get_path_to_class_class_loader_lcl_refs_cleanup;
+        return 0;
     }
 
-    jmethodID to_external_form = (*jni_env)->GetMethodID(jni_env, url_class, stringize_method_name, "()Ljava/lang/String;");
-    if (check_and_clear_exception(jni_env) || NULL == to_external_form)
+    jlong tag = 0;
+    jvmtiError error_code = (*jvmti_env)->GetTag(jvmti_env, class_loader, &tag);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of java/net/URL.%s()Ljava/lang/String;\n", stringize_method_name);
-        goto get_path_to_class_class_loader_lcl_refs_cleanup;
+        return 0;
     }
 
-    /* call method URL.toString() */
-    jstring jstr = (jstring)(*jni_env)->CallObjectMethod(jni_env, url, to_external_form);
-    if (check_and_clear_exception(jni_env) || jstr ==  NULL)
+    if (0 != (tag & CLASS_LOADER_TAG))
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Failed to convert an URL object to a string\n");
-        goto get_path_to_class_class_loader_lcl_refs_cleanup;
+        return tag;
     }
 
-    /* convert Java String into C char* */
-    char *str = (char*)(*jni_env)->GetStringUTFChars(jni_env, jstr, NULL);
-    out = strdup(str);
-    if (out == NULL)
+    /* Two threads may tag the same loader concurrently, the locations cached
+     * with the overwritten ID are evicted as unused */
+    tag = CLASS_LOADER_TAG | __sync_add_and_fetch(&lastClassLoaderId, 1);
+    error_code = (*jvmti_env)->SetTag(jvmti_env, class_loader, tag);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
     {
-        fprintf(stderr, "strdup(): out of memory");
+        return 0;
     }
 
-    /* cleanup */
-    (*jni_env)->ReleaseStringUTFChars(jni_env, jstr, str);
-
-get_path_to_class_class_loader_lcl_refs_cleanup:
-    (*jni_env)->DeleteLocalRef(jni_env, class_loader_class);
-    (*jni_env)->DeleteLocalRef(jni_env, j_class_name);
-    return out;
+    return tag;
 }
 
 
@@ -1738,49 +2428,66 @@ static jobject get_system_class_loader(
             jvmtiEnv *jvmti_env __UNUSED_VAR,
             JNIEnv   *jni_env)
 {
-    jobject system_class_loader = NULL;
-
-    jclass class_loader_class = (*jni_env)->FindClass(jni_env, "java/lang/ClassLoader");
-    if (check_and_clear_exception(jni_env) || NULL == class_loader_class)
-    {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get class of java/lang/ClassLoader\n");
-        return NULL;
-    }
-
-    jmethodID get_system_class_loader_smethod =(*jni_env)->GetStaticMethodID(jni_env, class_loader_class, "getSystemClassLoader", "()Ljava/lang/ClassLoader;");
-    if (check_and_clear_exception(jni_env) || NULL == get_system_class_loader_smethod)
+    const T_jniIds *ids = jni_ids_get(jni_env);
+    if (NULL == ids)
     {
         VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not find method java.lang.ClassLoader.getSystemClassLoader()Ljava/lang/ClassLoader;\n");
-        goto get_system_class_loader_cleanup;
+        return NULL;
     }
 
-    system_class_loader = (*jni_env)->CallStaticObjectMethod(jni_env, class_loader_class, get_system_class_loader_smethod);
+    jobject system_class_loader = (*jni_env)->CallStaticObjectMethod(jni_env, ids->class_loader_class, ids->class_loader_get_system_class_loader);
     if (check_and_clear_exception(jni_env))
     {
         VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Exception occurred: Cannot get the system class loader\n");
-        goto get_system_class_loader_cleanup;
+        return NULL;
     }
 
-get_system_class_loader_cleanup:
-    (*jni_env)->DeleteLocalRef(jni_env, class_loader_class);
     return system_class_loader;
 }
 
 
 
 /*
- * Return path to given class.
+ * Return location of given class.
+ *
+ * Locations are cached per class loader and class name. Classes loaded by
+ * the bootstrap class loader are looked up in the system class loader.
+ *
+ * @param class_name Class name in the form returned by
+ *        create_updated_class_name()
+ * @param external_form Filled with mallocated URL.toExternalForm() of the
+ *        class file or NULL. Can be NULL if the caller is not interested.
+ * @param path Filled with mallocated URL.getPath() of the class file or
+ *        NULL. Can be NULL if the caller is not interested.
+ * @returns 0 if at least one of the requested forms was found; otherwise
+ *          non zero value
  */
-static char* get_path_to_class(
-            jvmtiEnv *jvmti_env,
-            JNIEnv   *jni_env,
-            jclass    class,
-            char     *class_name,
-            const char *stringize_method_name)
+static int get_class_location(
+            jvmtiEnv   *jvmti_env,
+            JNIEnv     *jni_env,
+            jclass      class,
+            const char *class_name,
+            char      **external_form,
+            char      **path)
 {
+    char *found_external_form = NULL;
+    char *found_path = NULL;
+
     jobject class_loader = NULL;
     (*jvmti_env)->GetClassLoader(jvmti_env, class, &class_loader);
 
+    /* the bootstrap class loader has ID 0 */
+    const jlong loader_id = NULL == class_loader ? 0 : get_class_loader_id(class_loader);
+
+    /* locations of loaders which could not be tagged would never be invalidated */
+    const int cacheable = NULL != classLocations && (NULL == class_loader || 0 != loader_id);
+
+    if (cacheable
+        && 0 == class_location_cache_get(classLocations, (uint64_t)loader_id, class_name, &found_external_form, &found_path))
+    {
+        goto get_class_location_exit;
+    }
+
     /* class is loaded using boot classloader */
     if (class_loader == NULL)
     {
@@ -1790,11 +2497,31 @@ static char* get_path_to_class(
         if (NULL == class_loader)
         {
             VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Cannot get the system class loader.");
-            return NULL;
+            return 1;
         }
     }
 
-    return get_path_to_class_class_loader(jvmti_env, jni_env, class_loader, class_name, stringize_method_name);
+    resolve_class_location(jni_env, class_loader, class_name, &found_external_form, &found_path);
+
+    if (cacheable)
+    {
+        class_location_cache_put(classLocations, (uint64_t)loader_id, class_name, found_external_form, found_path);
+    }
+
+    (*jni_env)->DeleteLocalRef(jni_env, class_loader);
+
+get_class_location_exit:
+    if (NULL != external_form)
+        *external_form = found_external_form;
+    else
+        free(found_external_form);
+
+    if (NULL != path)
+        *path = found_path;
+    else
+        free(found_path);
+
+    return (NULL == external_form || NULL == found_external_form) && (NULL == path || NULL == found_path);
 }
 
 
@@ -1803,7 +2530,8 @@ static char* get_path_to_class(
  * Looks up a Class instance of given class name in the list of already loaded
  * classes.
  *
- * Calls toString() method for each entry in the result to
+ * Looks into the index of loaded classes once it is complete. Otherwise,
+ * calls getName() method for each entry in the result to
  * JVMTI::GetLoadedClasses() and compares its result to the given class name.
  */
 static jclass find_class_in_loaded_class(
@@ -1811,6 +2539,11 @@ static jclass find_class_in_loaded_class(
             JNIEnv     *jni_env,
             const char *searched_class_name)
 {
+    if (NULL != loadedClasses && __sync_add_and_fetch(&loadedClassesIndexed, 0))
+    {
+        return class_index_find(loadedClasses, jni_env, searched_class_name);
+    }
+
     jclass result = NULL;
     jint num_classes = 0;
     jclass *loaded_classes;
@@ -1820,24 +2553,16 @@ static jclass find_class_in_loaded_class(
         return NULL;
     }
 
-    jclass class_class = (*jni_env)->FindClass(jni_env, "java/lang/Class");
-    if (check_and_clear_exception(jni_env) || NULL == class_class)
-    {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get class of java/lang/Class\n");
-        goto find_class_in_loaded_class_cleanup;
-    }
-
-    jmethodID get_name_method = (*jni_env)->GetMethodID(jni_env, class_class, "getName", "()Ljava/lang/String;");
-    if (check_and_clear_exception(jni_env) || NULL == get_name_method)
+    const T_jniIds *ids = jni_ids_get(jni_env);
+    if (NULL == ids)
     {
         VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of java/lang/Class.getName()Ljava/lang/String;\n");
-        (*jni_env)->DeleteLocalRef(jni_env, class_class);
         goto find_class_in_loaded_class_cleanup;
     }
 
     for (jint i = 0; NULL == result && i < num_classes; ++i)
     {
-        jobject class_name = (*jni_env)->CallObjectMethod(jni_env, loaded_classes[i], get_name_method);
+        jobject class_name = (*jni_env)->CallObjectMethod(jni_env, loaded_classes[i], ids->class_get_name);
         if (check_and_clear_exception(jni_env) || NULL == class_name)
         {
             VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get name of a loaded class\n");
@@ -1865,434 +2590,1398 @@ find_class_in_loaded_class_cleanup:
 
 
 /*
- * Print one method from stack frame.
+ * Returns non zero value if a class can be unloaded while its class loader
+ * is still alive (VM anonymous and hidden classes, e.g. lambdas).
+ *
+ * Their names contain a number after '/' or '.' which cannot start a Java
+ * identifier.
  */
-static int print_stack_trace_element(
-            jvmtiEnv       *jvmti_env,
-            JNIEnv         *jni_env,
-            jobject         stack_frame,
-            char           *stack_trace_str,
-            unsigned        max_length,
-            char           **class_fs_path)
+static int class_can_be_unloaded_alone(
+            const char *class_signature)
 {
-    jclass stack_frame_class = (*jni_env)->GetObjectClass(jni_env, stack_frame);
-    jmethodID get_class_name_method = (*jni_env)->GetMethodID(jni_env, stack_frame_class, "getClassName", "()Ljava/lang/String;");
-    if (check_and_clear_exception(jni_env) || get_class_name_method == NULL)
+    for (const char *c = class_signature; '\0' != *c; ++c)
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of $(Frame class).getClassName()Ljava/lang/String;\n");
-        (*jni_env)->DeleteLocalRef(jni_env, stack_frame_class);
-        return -1;
+        if (('/' == c[0] || '.' == c[0]) && '0' <= c[1] && c[1] <= '9')
+        {
+            return 1;
+        }
     }
 
-    jstring class_name_of_frame_method = (*jni_env)->CallObjectMethod(jni_env, stack_frame, get_class_name_method);
-    if (check_and_clear_exception(jni_env) || class_name_of_frame_method == NULL)
-    {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get class name of a class on a frame\n");
-        (*jni_env)->DeleteLocalRef(jni_env, stack_frame_class);
-        return -1;
-    }
+    return 0;
+}
 
-    char *cls_name_str = (char*)(*jni_env)->GetStringUTFChars(jni_env, class_name_of_frame_method, NULL);
-    string_replace(cls_name_str, '.', '/');
-    jclass class_of_frame_method = (*jni_env)->FindClass(jni_env, cls_name_str);
-    char *class_location = NULL;
 
-    if (check_and_clear_exception(jni_env) || NULL == class_of_frame_method)
-    {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get class of %s. Try more hard by searching in the loaded classes.\n", cls_name_str);
-        string_replace(cls_name_str, '/', '.');
-        class_of_frame_method = find_class_in_loaded_class(jvmti_env, jni_env, cls_name_str);
-        string_replace(cls_name_str, '.', '/');
-    }
 
-    if (NULL != class_of_frame_method)
+/*
+ * Gets ID of the class loader of a class whose frames and line numbers can be
+ * cached.
+ *
+ * Cached data are invalidated together with the class loader of the declaring
+ * class, hence data of classes which can be unloaded earlier are not cached.
+ *
+ * @param loader_id Filled with the ID; the bootstrap class loader has ID 0
+ * @returns 0 if data of the class can be cached; otherwise non zero value
+ */
+static int get_cacheable_class_loader_id(
+            jvmtiEnv   *jvmti_env,
+            JNIEnv     *jni_env,
+            jclass      declaring_class,
+            const char *declaring_class_signature,
+            uint64_t   *loader_id)
+{
+    if (class_can_be_unloaded_alone(declaring_class_signature))
     {
-        char *updated_cls_name_str = create_updated_class_name(cls_name_str);
-        if (updated_cls_name_str != NULL)
-        {
-            class_location = get_path_to_class(jvmti_env, jni_env, class_of_frame_method, updated_cls_name_str, TO_EXTERNAL_FORM_METHOD_NAME);
-
-            if (NULL != class_fs_path)
-            {
-                *class_fs_path = get_path_to_class(jvmti_env, jni_env, class_of_frame_method, updated_cls_name_str, GET_PATH_METHOD_NAME);
-                if (NULL != *class_fs_path)
-                    *class_fs_path = extract_fs_path(*class_fs_path);
-            }
-
-            free(updated_cls_name_str);
-        }
-        (*jni_env)->DeleteLocalRef(jni_env, class_of_frame_method);
+        return 1;
     }
-    (*jni_env)->ReleaseStringUTFChars(jni_env, class_name_of_frame_method, cls_name_str);
 
-    jmethodID to_string_method = (*jni_env)->GetMethodID(jni_env, stack_frame_class, "toString", "()Ljava/lang/String;");
-    (*jni_env)->DeleteLocalRef(jni_env, stack_frame_class);
-    if (check_and_clear_exception(jni_env) || to_string_method == NULL)
+    jobject class_loader = NULL;
+    jvmtiError error_code = (*jvmti_env)->GetClassLoader(jvmti_env, declaring_class, &class_loader);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of $(Frame class).toString()Ljava/lang/String;\n");
-        return -1;
+        return 1;
     }
 
-    jobject orig_str = (*jni_env)->CallObjectMethod(jni_env, stack_frame, to_string_method);
-    if (check_and_clear_exception(jni_env) || NULL == orig_str)
+    if (NULL == class_loader)
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get a string representation of a class on a frame\n");
-        (*jni_env)->DeleteLocalRef(jni_env, orig_str);
-        return -1;
+        *loader_id = 0;
+        return 0;
     }
 
-    char *str = (char*)(*jni_env)->GetStringUTFChars(jni_env, orig_str, NULL);
-    int wrote = snprintf(stack_trace_str, max_length, "\tat %s [%s]\n", str, class_location == NULL ? "unknown" : class_location);
-    if (wrote > 0 && stack_trace_str[wrote-1] != '\n')
-    {   /* the length limit was reached and frame is printed only partially */
-        /* so in order to not show partial frames clear current frame's data */
-        VERBOSE_PRINT("Too many frames or too long frame. Finishing stack trace generation.");
-        stack_trace_str[0] = '\0';
-        wrote = 0;
+    *loader_id = (uint64_t)get_class_loader_id(class_loader);
+    (*jni_env)->DeleteLocalRef(jni_env, class_loader);
+    return 0 == *loader_id;
+}
+
+
+
+/*
+ * Prints one frame captured by JVMTI GetStackTrace() in the same format as
+ * print_stack_trace_element() prints StackTraceElement.
+ *
+ * @param class_fs_path Filled with a file system path of the declaring class
+ *        if not NULL
+ * @returns 1 if the frame was appended, 0 if the stack trace is full or -1 if
+ *          the frame cannot be formatted
+ */
+static int print_one_method_from_stack(
+            jvmtiEnv        *jvmti_env,
+            JNIEnv          *jni_env,
+            jvmtiFrameInfo   stack_frame,
+            T_stringBuilder *stack_trace,
+            char           **class_fs_path)
+{
+    jvmtiError  error_code;
+    jclass      declaring_class = NULL;
+    char       *method_name = NULL;
+    char       *declaring_class_name = NULL;
+    char       *source_file_name = NULL;
+    char       *class_location = NULL;
+    char        source[MAX_SOURCE_STRING_LENGTH];
+    char        buf[1000];
+    int         appended = -1;
+
+    /* Repeated frames are only copied */
+    if (NULL != frameCache && NULL == class_fs_path)
+    {
+        const size_t length = frame_cache_get(frameCache, stack_frame.method, stack_frame.location, buf, sizeof(buf));
+        if (0 != length && length < sizeof(buf))
+        {
+            return !string_builder_append(stack_trace, buf);
+        }
+    }
+
+    /* Fails if the class has been unloaded since the frame was captured */
+    error_code = (*jvmti_env)->GetMethodName(jvmti_env, stack_frame.method, &method_name, NULL, NULL);
+    if (error_code != JVMTI_ERROR_NONE)
+    {
+        return -1;
+    }
+    error_code = (*jvmti_env)->GetMethodDeclaringClass(jvmti_env, stack_frame.method, &declaring_class);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+        goto print_one_method_from_stack_cleanup;
+
+    error_code = (*jvmti_env)->GetClassSignature(jvmti_env, declaring_class, &declaring_class_name, NULL);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+        goto print_one_method_from_stack_cleanup;
+
+    uint64_t loader_id = 0;
+    const int cacheable = (NULL != frameCache || NULL != lineNumbers)
+            && 0 == get_cacheable_class_loader_id(jvmti_env, jni_env, declaring_class, declaring_class_name, &loader_id);
+
+    /* Ljava/lang/String; -> java/lang/String. */
+    char *updated_class_name = format_class_name_for_JNI_call(declaring_class_name);
+    get_class_location(jvmti_env, jni_env, declaring_class, updated_class_name, &class_location, class_fs_path);
+    if (NULL != class_fs_path && NULL != *class_fs_path)
+    {
+        *class_fs_path = extract_fs_path(*class_fs_path);
+    }
+
+    /* java/lang/String. -> java.lang.String. */
+    string_replace(updated_class_name, '/', '.');
+
+    /* The same forms as StackTraceElement.toString() prints */
+    if (stack_frame.location < 0)
+    {
+        snprintf(source, sizeof(source), "Native Method");
+    }
+    else if (JVMTI_ERROR_NONE != (*jvmti_env)->GetSourceFileName(jvmti_env, declaring_class, &source_file_name))
+    {
+        /* compiled without debug information */
+        source_file_name = NULL;
+        snprintf(source, sizeof(source), "Unknown Source");
+    }
+    else
+    {
+        const int line_number = get_line_number(jvmti_env, stack_frame.method, stack_frame.location, cacheable ? &loader_id : NULL);
+        if (line_number >= 0)
+        {
+            snprintf(source, sizeof(source), "%s:%d", source_file_name, line_number);
+        }
+        else
+        {
+            snprintf(source, sizeof(source), "%s", source_file_name);
+        }
+    }
+
+    const char *location = (NULL == class_location ? "unknown" : class_location);
+    const int wrote = snprintf(buf, sizeof(buf), "\tat %s%s(%s) [%s]\n", updated_class_name, method_name, source, location);
+    if (wrote > 0 && (size_t)wrote < sizeof(buf))
+    {
+        appended = !string_builder_append(stack_trace, buf);
+        if (NULL != frameCache && cacheable)
+        {
+            frame_cache_put(frameCache, stack_frame.method, stack_frame.location, loader_id, buf);
+        }
+    }
+    else
+    {   /* Too long frames are not cached */
+        appended = !string_builder_printf(stack_trace, "\tat %s%s(%s) [%s]\n", updated_class_name, method_name, source, location);
+    }
+
+    if (!appended)
+    {
+        VERBOSE_PRINT("Too many frames or too long frame. Finishing stack trace generation.");
+    }
+
+print_one_method_from_stack_cleanup:
+    /* cleanup */
+    free(class_location);
+    if (NULL != declaring_class)
+    {
+        (*jni_env)->DeleteLocalRef(jni_env, declaring_class);
+    }
+    if (NULL != method_name)
+    {
+        error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char*)method_name);
+        check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
+    }
+    if (NULL != declaring_class_name)
+    {
+        error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char*)declaring_class_name);
+        check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
+    }
+    if (NULL != source_file_name)
+    {
+        error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char*)source_file_name);
+        check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
+    }
+
+    return appended;
+}
+
+
+
+/*
+ * Print one method from stack frame.
+ *
+ * @returns 1 if the frame was appended, 0 if the stack trace is full or -1 on
+ *          error
+ */
+static int print_stack_trace_element(
+            jvmtiEnv        *jvmti_env,
+            JNIEnv          *jni_env,
+            jobject          stack_frame,
+            T_stringBuilder *stack_trace,
+            T_arena         *arena,
+            char           **class_fs_path)
+{
+    const T_jniIds *ids = jni_ids_get(jni_env);
+    if (NULL == ids)
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of $(Frame class).getClassName()Ljava/lang/String;\n");
+        return -1;
+    }
+
+    jstring class_name_of_frame_method = (*jni_env)->CallObjectMethod(jni_env, stack_frame, ids->stack_trace_element_get_class_name);
+    if (check_and_clear_exception(jni_env) || class_name_of_frame_method == NULL)
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get class name of a class on a frame\n");
+        return -1;
+    }
+
+    char *cls_name_str = (char*)(*jni_env)->GetStringUTFChars(jni_env, class_name_of_frame_method, NULL);
+    string_replace(cls_name_str, '.', '/');
+    jclass class_of_frame_method = (*jni_env)->FindClass(jni_env, cls_name_str);
+    char *class_location = NULL;
+
+    if (check_and_clear_exception(jni_env) || NULL == class_of_frame_method)
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get class of %s. Try more hard by searching in the loaded classes.\n", cls_name_str);
+        string_replace(cls_name_str, '/', '.');
+        class_of_frame_method = find_class_in_loaded_class(jvmti_env, jni_env, cls_name_str);
+        string_replace(cls_name_str, '.', '/');
+    }
+
+    if (NULL != class_of_frame_method)
+    {
+        const T_arenaMark mark = arena_mark(arena);
+        char *updated_cls_name_str = create_updated_class_name(arena, cls_name_str);
+        if (updated_cls_name_str != NULL)
+        {
+            /* Both forms come from a single ClassLoader.getResource() */
+            get_class_location(jvmti_env, jni_env, class_of_frame_method, updated_cls_name_str, &class_location, class_fs_path);
+
+            if (NULL != class_fs_path && NULL != *class_fs_path)
+            {
+                *class_fs_path = extract_fs_path(*class_fs_path);
+            }
+        }
+        arena_release(arena, mark);
+        (*jni_env)->DeleteLocalRef(jni_env, class_of_frame_method);
+    }
+    (*jni_env)->ReleaseStringUTFChars(jni_env, class_name_of_frame_method, cls_name_str);
+    (*jni_env)->DeleteLocalRef(jni_env, class_name_of_frame_method);
+
+    jobject orig_str = (*jni_env)->CallObjectMethod(jni_env, stack_frame, ids->stack_trace_element_to_string);
+    if (check_and_clear_exception(jni_env) || NULL == orig_str)
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get a string representation of a class on a frame\n");
+        free(class_location);
+        return -1;
+    }
+
+    char *str = (char*)(*jni_env)->GetStringUTFChars(jni_env, orig_str, NULL);
+    /* The builder never keeps a partially appended frame */
+    int appended = !string_builder_printf(stack_trace, "\tat %s [%s]\n", str, class_location == NULL ? "unknown" : class_location);
+    if (!appended)
+    {
+        VERBOSE_PRINT("Too many frames or too long frame. Finishing stack trace generation.");
+    }
+    (*jni_env)->ReleaseStringUTFChars(jni_env, orig_str, str);
+    (*jni_env)->DeleteLocalRef(jni_env, orig_str);
+    free(class_location);
+    return appended;
+}
+
+
+
+/*
+ * Frames of one exception on a stack trace
+ */
+typedef struct {
+    const jvmtiFrameInfo *frames;     ///< frames captured by JVMTI or NULL
+    jobjectArray elements;            ///< Throwable.getStackTrace() if frames is NULL
+    jint count;                       ///< number of frames
+} T_traceFrames;
+
+
+
+/*
+ * An exception already printed on a stack trace
+ */
+typedef struct {
+    jobject exception;                ///< reference to the exception
+    jint hash;                        ///< identity hash code of the exception
+} T_printedException;
+
+
+
+/*
+ * Gets frames of an exception from Throwable.getStackTrace()
+ *
+ * @param trace Filled with a local reference to the frames; no frames on
+ *        errors
+ * @returns 0 on success; otherwise non zero value
+ */
+static int get_stack_trace_elements(
+            JNIEnv          *jni_env,
+            const T_jniIds  *ids,
+            jobject          exception,
+            T_traceFrames   *trace)
+{
+    trace->frames = NULL;
+    trace->elements = (jobjectArray)(*jni_env)->CallObjectMethod(jni_env, exception, ids->throwable_get_stack_trace);
+    trace->count = 0;
+
+    if (check_and_clear_exception(jni_env) || NULL == trace->elements)
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get a stack trace from an exception object\n");
+        trace->elements = NULL;
+        return 1;
+    }
+
+    trace->count = (*jni_env)->GetArrayLength(jni_env, trace->elements);
+    return 0;
+}
+
+
+
+/*
+ * Compares a class signature (Ljava/lang/String;) with a class name
+ * (java.lang.String)
+ */
+static int class_signature_equals_name(
+            const char *signature,
+            const char *name)
+{
+    /* arrays do not declare methods */
+    if ('L' != *signature)
+    {
+        return 0;
+    }
+
+    for (++signature; '\0' != *name; ++signature, ++name)
+    {
+        if (('/' == *signature ? '.' : *signature) != *name)
+        {
+            return 0;
+        }
+    }
+
+    return 0 == strcmp(signature, ";");
+}
+
+
+
+/*
+ * Compares a StackTraceElement with a frame captured by JVMTI the same way
+ * StackTraceElement.equals() compares elements, except the module and the
+ * class loader.
+ *
+ * @returns Non zero value if both refer to the same line of the same method
+ */
+static int stack_trace_element_equals_frame(
+            jvmtiEnv       *jvmti_env,
+            JNIEnv         *jni_env,
+            const T_jniIds *ids,
+            jobject         element,
+            jvmtiFrameInfo  frame)
+{
+    const jint element_line_number = (*jni_env)->CallIntMethod(jni_env, element, ids->stack_trace_element_get_line_number);
+    if (check_and_clear_exception(jni_env))
+    {
+        return 0;
+    }
+
+    /* StackTraceElement uses -2 for native methods */
+    const int frame_line_number = frame.location < 0 ? -2 : get_line_number(jvmti_env, frame.method, frame.location, NULL);
+    if (element_line_number != frame_line_number)
+    {
+        return 0;
+    }
+
+    int equal = 0;
+    char *method_name = NULL;
+    jclass declaring_class = NULL;
+    char *class_signature = NULL;
+
+    if (JVMTI_ERROR_NONE != (*jvmti_env)->GetMethodName(jvmti_env, frame.method, &method_name, NULL, NULL)
+            || JVMTI_ERROR_NONE != (*jvmti_env)->GetMethodDeclaringClass(jvmti_env, frame.method, &declaring_class)
+            || JVMTI_ERROR_NONE != (*jvmti_env)->GetClassSignature(jvmti_env, declaring_class, &class_signature, NULL))
+    {
+        goto stack_trace_element_equals_frame_cleanup;
+    }
+
+    jstring element_method_name = (*jni_env)->CallObjectMethod(jni_env, element, ids->stack_trace_element_get_method_name);
+    if (check_and_clear_exception(jni_env) || NULL == element_method_name)
+    {
+        goto stack_trace_element_equals_frame_cleanup;
+    }
+
+    const char *str = (*jni_env)->GetStringUTFChars(jni_env, element_method_name, NULL);
+    equal = NULL != str && 0 == strcmp(str, method_name);
+    if (NULL != str)
+    {
+        (*jni_env)->ReleaseStringUTFChars(jni_env, element_method_name, str);
+    }
+    (*jni_env)->DeleteLocalRef(jni_env, element_method_name);
+
+    if (!equal)
+    {
+        goto stack_trace_element_equals_frame_cleanup;
+    }
+
+    jstring element_class_name = (*jni_env)->CallObjectMethod(jni_env, element, ids->stack_trace_element_get_class_name);
+    if (check_and_clear_exception(jni_env) || NULL == element_class_name)
+    {
+        equal = 0;
+        goto stack_trace_element_equals_frame_cleanup;
+    }
+
+    str = (*jni_env)->GetStringUTFChars(jni_env, element_class_name, NULL);
+    equal = NULL != str && class_signature_equals_name(class_signature, str);
+    if (NULL != str)
+    {
+        (*jni_env)->ReleaseStringUTFChars(jni_env, element_class_name, str);
+    }
+    (*jni_env)->DeleteLocalRef(jni_env, element_class_name);
+
+stack_trace_element_equals_frame_cleanup:
+    if (NULL != class_signature)
+    {
+        (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)class_signature);
+    }
+    if (NULL != declaring_class)
+    {
+        (*jni_env)->DeleteLocalRef(jni_env, declaring_class);
+    }
+    if (NULL != method_name)
+    {
+        (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)method_name);
+    }
+
+    return equal;
+}
+
+
+
+/*
+ * Compares the i-th frame of a stack trace with the j-th frame of another
+ * stack trace
+ *
+ * @returns Non zero value if the frames are equal
+ */
+static int stack_trace_frames_equal(
+            jvmtiEnv            *jvmti_env,
+            JNIEnv              *jni_env,
+            const T_jniIds      *ids,
+            const T_traceFrames *trace,
+            jint                 i,
+            const T_traceFrames *other,
+            jint                 j)
+{
+    if (NULL != trace->frames && NULL != other->frames)
+    {
+        return trace->frames[i].method == other->frames[j].method
+            && trace->frames[i].location == other->frames[j].location;
+    }
+
+    if (NULL == trace->frames && NULL == other->frames)
+    {
+        jobject element = (*jni_env)->GetObjectArrayElement(jni_env, trace->elements, i);
+        jobject other_element = (*jni_env)->GetObjectArrayElement(jni_env, other->elements, j);
+
+        int equal = (*jni_env)->CallBooleanMethod(jni_env, element, ids->stack_trace_element_equals, other_element);
+        if (check_and_clear_exception(jni_env))
+        {
+            equal = 0;
+        }
+
+        (*jni_env)->DeleteLocalRef(jni_env, other_element);
+        (*jni_env)->DeleteLocalRef(jni_env, element);
+        return equal;
+    }
+
+    /* Frames of the top most exception captured by JVMTI and frames of its
+     * cause */
+    if (NULL != trace->frames)
+    {
+        return stack_trace_frames_equal(jvmti_env, jni_env, ids, other, j, trace, i);
+    }
+
+    jobject element = (*jni_env)->GetObjectArrayElement(jni_env, trace->elements, i);
+    const int equal = stack_trace_element_equals_frame(jvmti_env, jni_env, ids, element, other->frames[j]);
+    (*jni_env)->DeleteLocalRef(jni_env, element);
+    return equal;
+}
+
+
+
+/*
+ * Counts frames a stack trace shares with the stack trace of the enclosing
+ * exception. The frames are compared from the bottom of the stack and only
+ * till the first difference.
+ *
+ * @param enclosing The stack trace of the enclosing exception or NULL
+ * @returns Number of the common frames
+ */
+static jint count_frames_in_common(
+            jvmtiEnv            *jvmti_env,
+            JNIEnv              *jni_env,
+            const T_jniIds      *ids,
+            const T_traceFrames *trace,
+            const T_traceFrames *enclosing)
+{
+    if (NULL == enclosing)
+    {
+        return 0;
+    }
+
+    jint m = trace->count - 1;
+    jint n = enclosing->count - 1;
+    while (m >= 0 && n >= 0 && stack_trace_frames_equal(jvmti_env, jni_env, ids, trace, m, enclosing, n))
+    {
+        --m;
+        --n;
+    }
+
+    return trace->count - 1 - m;
+}
+
+
+
+/*
+ * Appends the string representation of an exception
+ *
+ * @param format A format with a single %s replaced by Throwable.toString()
+ * @returns 1 if the string was appended, 0 if the stack trace is full or -1
+ *          on error
+ */
+static int print_exception_string(
+            JNIEnv          *jni_env,
+            const T_jniIds  *ids,
+            jobject          exception,
+            const char      *format,
+            T_stringBuilder *stack_trace)
+{
+    /* Throwable's methods are virtual, overrides are called */
+    jobject exception_str = (*jni_env)->CallObjectMethod(jni_env, exception, ids->throwable_to_string);
+    if (check_and_clear_exception(jni_env) || exception_str == NULL)
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get a string representation of a class on a frame\n");
+        return -1;
+    }
+
+    char *str = (char*)(*jni_env)->GetStringUTFChars(jni_env, exception_str, NULL);
+    const int appended = !string_builder_printf(stack_trace, format, str);
+    (*jni_env)->ReleaseStringUTFChars(jni_env, exception_str, str);
+    (*jni_env)->DeleteLocalRef(jni_env, exception_str);
+
+    return appended;
+}
+
+
+
+/*
+ * Generates standard Java exception stack trace with file system path to the file
+ *
+ * Frames shared with the stack trace of the enclosing exception are replaced
+ * by "... N more" line as Throwable.printStackTrace() does.
+ *
+ * @param exception The exception or NULL if it has been collected
+ * @param exception_string Printed instead of exception.toString() if the
+ *        exception has been collected
+ * @param trace Frames of the exception
+ * @param enclosing Frames of the enclosing exception or NULL
+ * @param arena Arena for temporary data
+ * @returns Number of appended characters or -1 on error
+ */
+static int print_exception_stack_trace(
+            jvmtiEnv        *jvmti_env,
+            JNIEnv          *jni_env,
+            jobject          exception,
+            const char      *exception_string,
+            const T_traceFrames *trace,
+            const T_traceFrames *enclosing,
+            T_stringBuilder *stack_trace,
+            T_arena         *arena,
+            char           **executable)
+{
+    const T_jniIds *ids = jni_ids_get(jni_env);
+    if (NULL == ids)
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of $(Exception class).toString()Ljava/lang/String;\n");
+        return -1;
+    }
+
+    const size_t begin = string_builder_length(stack_trace);
+    const int appended = NULL != exception
+        ? print_exception_string(jni_env, ids, exception, "%s\n", stack_trace)
+        : !string_builder_printf(stack_trace, "%s\n", exception_string);
+    if (appended < 0)
+    {
+        return -1;
+    }
+
+    if (!appended)
+    {
+        VERBOSE_PRINT("Too long exception string. Not generating stack trace at all.");
+        return 0;
+    }
+
+    const jint in_common = count_frames_in_common(jvmti_env, jni_env, ids, trace, enclosing);
+    const jint printed = trace->count - in_common;
+    jint i = 0;
+    for (; i < printed; ++i)
+    {
+        char **class_fs_path = ((NULL != executable && trace->count - 1 == i) ? executable : NULL);
+        if (NULL != trace->frames)
+        {
+            const int frame_appended = print_one_method_from_stack(jvmti_env, jni_env, trace->frames[i], stack_trace, class_fs_path);
+            if (frame_appended == 0)
+            {   /* the length limit was reached */
+                break;
+            }
+            /* frames of unloaded classes are skipped */
+            continue;
+        }
+
+        /* Throws only ArrayIndexOutOfBoundsException and this should not happen */
+        jobject frame_element = (*jni_env)->GetObjectArrayElement(jni_env, trace->elements, i);
+        const int frame_appended = print_stack_trace_element(jvmti_env, jni_env, frame_element, stack_trace, arena, class_fs_path);
+        (*jni_env)->DeleteLocalRef(jni_env, frame_element);
+
+        if (frame_appended <= 0)
+        {   /* <  0 : the frame cannot be formatted */
+            /* == 0 : the length limit was reached and no more */
+            /* frames can be added to the stack trace */
+            break;
+        }
+    }
+
+    if (0 != in_common && printed == i)
+    {
+        string_builder_printf(stack_trace, "\t... %d more\n", (int)in_common);
+    }
+
+    return (int)(string_builder_length(stack_trace) - begin);
+}
+
+
+
+/*
+ * Checks whether an exception has already been printed and remembers it if
+ * it has not
+ *
+ * @param printed Already printed exceptions
+ * @param count Number of the printed exceptions, incremented if the exception
+ *        is remembered
+ * @returns Non zero value if the exception has already been printed
+ */
+static int exception_already_printed(
+            jvmtiEnv           *jvmti_env,
+            JNIEnv             *jni_env,
+            T_printedException *printed,
+            size_t             *count,
+            jobject             exception)
+{
+    /* Objects with different identity hash codes cannot be identical */
+    jint hash = 0;
+    jvmtiError error_code = (*jvmti_env)->GetObjectHashCode(jvmti_env, exception, &hash);
+    check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
+
+    for (size_t i = 0; i < *count; ++i)
+    {
+        if (printed[i].hash == hash && (*jni_env)->IsSameObject(jni_env, printed[i].exception, exception))
+        {
+            return 1;
+        }
+    }
+
+    printed[*count].exception = exception;
+    printed[*count].hash = hash;
+    ++(*count);
+    return 0;
+}
+
+
+
+/*
+ * Generates stack trace of an exception and its causes
+ *
+ * The chain of causes is walked up to MAX_CAUSE_CHAIN_DEPTH causes and stops
+ * at a cause which has already been printed.
+ *
+ * @param exception The exception or NULL if it has been collected; only the
+ *        captured frames are printed then, without causes
+ * @param exception_string String representation of a collected exception
+ * @param frames Frames of the exception captured by JVMTI or NULL to get the
+ *        frames from Throwable.getStackTrace()
+ * @param frame_count Number of the captured frames
+ * @param arena Arena the stack trace is allocated from
+ */
+static char *generate_thread_stack_trace(
+            jvmtiEnv *jvmti_env,
+            JNIEnv   *jni_env,
+            char     *thread_name,
+            jobject  exception,
+            const char *exception_string,
+            const jvmtiFrameInfo *frames,
+            jint     frame_count,
+            T_arena  *arena,
+            char     **executable)
+{
+    const T_jniIds *ids = jni_ids_get(jni_env);
+    if (NULL == ids)
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of $(Exception class).getCause()Ljava/lang/Throwable;\n");
+        return NULL;
+    }
+
+    /* The builder of the thread keeps its memory between reports */
+    T_stringBuilder *stack_trace = string_builder_thread_local(MAX_STACK_TRACE_STRING_LENGTH);
+    if (NULL == stack_trace)
+    {
+        return NULL;
+    }
+
+    if (string_builder_printf(stack_trace, "Exception in thread \"%s\" ", thread_name))
+    {
+        VERBOSE_PRINT("Too long thread name. Not generating stack trace at all.");
+        return NULL;
+    }
+
+    T_traceFrames enclosing = { frames, NULL, frame_count };
+    if (NULL == frames && NULL != exception)
+    {
+        get_stack_trace_elements(jni_env, ids, exception, &enclosing);
+    }
+
+    int exception_wrote = print_exception_stack_trace(jvmti_env,
+            jni_env,
+            exception,
+            exception_string,
+            &enclosing,
+            /*top most*/NULL,
+            stack_trace,
+            arena,
+            executable);
+
+    if (exception_wrote <= 0)
+    {
+        if (NULL != enclosing.elements)
+        {
+            (*jni_env)->DeleteLocalRef(jni_env, enclosing.elements);
+        }
+        return NULL;
+    }
+
+    if (NULL == exception)
+    {
+        return string_builder_finish_in(stack_trace, arena);
+    }
+
+    /* The printed causes are kept referenced to be recognized */
+    (*jni_env)->EnsureLocalCapacity(jni_env, MAX_CAUSE_CHAIN_DEPTH + 16);
+    T_printedException printed[MAX_CAUSE_CHAIN_DEPTH + 1];
+    size_t printed_count = 0;
+    exception_already_printed(jvmti_env, jni_env, printed, &printed_count, exception);
+
+    jobject cause = (*jni_env)->CallObjectMethod(jni_env, exception, ids->throwable_get_cause);
+    if (check_and_clear_exception(jni_env))
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Failed to get an inner exception of the top most one;\n");
+        cause = NULL;
+    }
+
+    while (NULL != cause)
+    {
+        if (printed_count > MAX_CAUSE_CHAIN_DEPTH)
+        {
+            VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Too many inner exceptions. Not printing the others.\n");
+            (*jni_env)->DeleteLocalRef(jni_env, cause);
+            break;
+        }
+
+        if (exception_already_printed(jvmti_env, jni_env, printed, &printed_count, cause))
+        {
+            /* The same form as Throwable.printStackTrace() prints */
+            print_exception_string(jni_env, ids, cause, CAUSED_STACK_TRACE_HEADER "[CIRCULAR REFERENCE: %s]\n", stack_trace);
+            (*jni_env)->DeleteLocalRef(jni_env, cause);
+            break;
+        }
+
+        const size_t cause_begin = string_builder_length(stack_trace);
+        if (string_builder_append(stack_trace, CAUSED_STACK_TRACE_HEADER))
+        {
+            VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Full exception stack trace buffer. Cannot add a cause.");
+            break;
+        }
+
+        /* Frames of causes are gone, only the cause objects know them */
+        T_traceFrames trace;
+        get_stack_trace_elements(jni_env, ids, cause, &trace);
+
+        const int cause_wrote = print_exception_stack_trace(jvmti_env,
+                jni_env,
+                cause,
+                /*Not collected*/NULL,
+                &trace,
+                &enclosing,
+                stack_trace,
+                arena,
+                /*No executable*/NULL);
+
+        if (NULL != enclosing.elements)
+        {
+            (*jni_env)->DeleteLocalRef(jni_env, enclosing.elements);
+        }
+        enclosing = trace;
+
+        if (cause_wrote <= 0)
+        {   /* <  0 : the cause cannot be formatted */
+            /* == 0 : the length limit was reached and no more */
+            /* cause can be added to the stack trace */
+            string_builder_truncate(stack_trace, cause_begin);
+            break;
+        }
+
+        cause = (*jni_env)->CallObjectMethod(jni_env, cause, ids->throwable_get_cause);
+        if (check_and_clear_exception(jni_env))
+        {
+            VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Failed to get an inner exception of another inner one;\n");
+            break;
+        }
     }
-    (*jni_env)->ReleaseStringUTFChars(jni_env, orig_str, str);
-    (*jni_env)->DeleteLocalRef(jni_env, orig_str);
-    return wrote;
+
+    if (NULL != enclosing.elements)
+    {
+        (*jni_env)->DeleteLocalRef(jni_env, enclosing.elements);
+    }
+
+    /* The top most exception is referenced by the caller */
+    for (size_t i = 1; i < printed_count; ++i)
+    {
+        (*jni_env)->DeleteLocalRef(jni_env, printed[i].exception);
+    }
+
+    return string_builder_finish_in(stack_trace, arena);
 }
 
 
 
+
 /*
- * Generates standard Java exception stack trace with file system path to the file
+ * Mixes the type of an exception into a hash
  */
-static int print_exception_stack_trace(
+static uint64_t hash_exception_class(
             jvmtiEnv *jvmti_env,
             JNIEnv   *jni_env,
-            jobject   exception,
-            char     *stack_trace_str,
-            size_t    max_stack_trace_lenght,
-            char     **executable)
+            jobject   exception_object,
+            uint64_t  hash)
 {
+    jclass exception_class = (*jni_env)->GetObjectClass(jni_env, exception_object);
+    char *class_signature_ptr = NULL;
 
-    jclass exception_class = (*jni_env)->GetObjectClass(jni_env, exception);
-    jmethodID to_string_method = (*jni_env)->GetMethodID(jni_env, exception_class, "toString", "()Ljava/lang/String;");
-    if (check_and_clear_exception(jni_env) || to_string_method == NULL)
+    jvmtiError error_code = (*jvmti_env)->GetClassSignature(jvmti_env, exception_class, &class_signature_ptr, NULL);
+    (*jni_env)->DeleteLocalRef(jni_env, exception_class);
+    if (!check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of $(Exception class).toString()Ljava/lang/String;\n");
-        (*jni_env)->DeleteLocalRef(jni_env, exception_class);
-        return -1;
+        hash = rate_limiter_hash(hash, class_signature_ptr, strlen(class_signature_ptr));
+
+        error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)class_signature_ptr);
+        check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
     }
 
-    jobject exception_str = (*jni_env)->CallObjectMethod(jni_env, exception, to_string_method);
-    if (check_and_clear_exception(jni_env) || exception_str == NULL)
+    return hash;
+}
+
+
+
+/*
+ * Computes a signature of an exception from its type and throw location
+ */
+static uint64_t get_exception_signature(
+            jvmtiEnv *jvmti_env,
+            JNIEnv   *jni_env,
+            jobject   exception_object,
+            jmethodID method,
+            jlocation location)
+{
+    uint64_t signature = hash_exception_class(jvmti_env, jni_env, exception_object, RATE_LIMITER_HASH_INIT);
+
+    /* method IDs are valid until the class is unloaded */
+    signature = rate_limiter_hash(signature, &method, sizeof(method));
+    signature = rate_limiter_hash(signature, &location, sizeof(location));
+
+    return signature;
+}
+
+
+
+/*
+ * Computes a fingerprint of an exception from its type and the frames on the
+ * top of the stack where it was thrown for the first time.
+ *
+ * The fingerprint is stored in the exception's tag, so a re-thrown exception
+ * keeps its original fingerprint.
+ *
+ * @param reported Set to non zero value if the exception object has already
+ *        been reported (see @mark_exception_reported)
+ */
+static jlong get_exception_fingerprint(
+            jvmtiEnv *jvmti_env,
+            JNIEnv   *jni_env,
+            jthread   thread,
+            jobject   exception_object,
+            int      *reported)
+{
+    jlong fingerprint = 0;
+
+    jvmtiError error_code = (*jvmti_env)->GetTag(jvmti_env, exception_object, &fingerprint);
+    if (!check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)) && 0 != fingerprint)
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get a string representation of a class on a frame\n");
-        (*jni_env)->DeleteLocalRef(jni_env, exception_class);
-        return -1;
+        *reported = 0 != (fingerprint & EXCEPTION_TAG_REPORTED);
+        return fingerprint & ~EXCEPTION_TAG_REPORTED;
     }
 
-    char *str = (char*)(*jni_env)->GetStringUTFChars(jni_env, exception_str, NULL);
-    int wrote = snprintf(stack_trace_str, max_stack_trace_lenght, "%s\n", str);
-    if (wrote < 0 )
-    {   /* this should never happen, snprintf() usually works w/o errors */
-        return -1;
+    *reported = 0;
+
+    uint64_t hash = hash_exception_class(jvmti_env, jni_env, exception_object, RATE_LIMITER_HASH_INIT);
+
+    jvmtiFrameInfo frames[REPORTED_EXCEPTION_FINGERPRINT_DEPTH];
+    jint count = 0;
+    error_code = (*jvmti_env)->GetStackTrace(jvmti_env, thread, 0, REPORTED_EXCEPTION_FINGERPRINT_DEPTH, frames, &count);
+    if (!check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+    {
+        for (jint i = 0; i < count; ++i)
+        {
+            hash = rate_limiter_hash(hash, &(frames[i].method), sizeof(frames[i].method));
+            hash = rate_limiter_hash(hash, &(frames[i].location), sizeof(frames[i].location));
+        }
     }
-    if (wrote > 0 && stack_trace_str[wrote-1] != '\n')
+
+    /* 0 means no tag */
+    fingerprint = (jlong)hash & ~(EXCEPTION_TAG_REPORTED | CLASS_LOADER_TAG);
+    if (0 == fingerprint)
     {
-        VERBOSE_PRINT("Too long exception string. Not generating stack trace at all.");
-        /* in order to not show partial exception clear current frame's data */
-        stack_trace_str[0] = '\0';
-        return 0;
+        fingerprint = 1;
     }
 
-    (*jni_env)->ReleaseStringUTFChars(jni_env, exception_str, str);
-    (*jni_env)->DeleteLocalRef(jni_env, exception_str);
+    error_code = (*jvmti_env)->SetTag(jvmti_env, exception_object, fingerprint);
+    check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
+
+    return fingerprint;
+}
 
-    jmethodID get_stack_trace_method = (*jni_env)->GetMethodID(jni_env, exception_class, "getStackTrace", "()[Ljava/lang/StackTraceElement;");
-    (*jni_env)->DeleteLocalRef(jni_env, exception_class);
 
-    if (check_and_clear_exception(jni_env) || get_stack_trace_method == NULL)
+
+/*
+ * Marks an exception object as reported. Re-thrown exceptions are then
+ * recognized by a single GetTag() call.
+ */
+static void mark_exception_reported(
+            jvmtiEnv *jvmti_env,
+            jobject   exception_object,
+            jlong     fingerprint)
+{
+    /* A collected exception cannot be re-thrown */
+    if (NULL == exception_object)
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of $(Exception class).getStackTrace()[Ljava/lang/StackTraceElement;\n");
-        return wrote;
+        return;
     }
 
-    jobject stack_trace_array = (*jni_env)->CallObjectMethod(jni_env, exception, get_stack_trace_method);
-    if (check_and_clear_exception(jni_env) || stack_trace_array ==  NULL)
+    jvmtiError error_code = (*jvmti_env)->SetTag(jvmti_env, exception_object, fingerprint | EXCEPTION_TAG_REPORTED);
+    check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
+}
+
+
+
+/*
+ * Returns a copy of Throwable.detailMessage of an exception
+ *
+ * The field is read directly, no Java code is run. Overrides of getMessage()
+ * are therefore not honored.
+ *
+ * @returns Mallocated string; NULL if the exception has no message or on
+ *          errors
+ */
+static char *get_exception_detail_message(
+            JNIEnv   *jni_env,
+            jobject   exception_object)
+{
+    const T_jniIds *ids = jni_ids_get(jni_env);
+    if (NULL == ids || NULL == ids->throwable_detail_message)
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get a stack trace from an exception object\n");
-        return wrote;
+        return NULL;
     }
 
-    jint array_size = (*jni_env)->GetArrayLength(jni_env, stack_trace_array);
-    for (jint i = 0; i < array_size; ++i)
+    jstring jstr = (jstring)(*jni_env)->GetObjectField(jni_env, exception_object, ids->throwable_detail_message);
+    if (NULL == jstr)
     {
-        /* Throws only ArrayIndexOutOfBoundsException and this should not happen */
-        jobject frame_element = (*jni_env)->GetObjectArrayElement(jni_env, stack_trace_array, i);
-
-        const int frame_wrote = print_stack_trace_element(jvmti_env,
-                jni_env,
-                frame_element,
-                stack_trace_str + wrote,
-                max_stack_trace_lenght - wrote,
-                ((NULL != executable && array_size - 1 == i) ? executable : NULL));
-
-        (*jni_env)->DeleteLocalRef(jni_env, frame_element);
+        return NULL;
+    }
 
-        if (frame_wrote <= 0)
-        {   /* <  0 : this should never happen, snprintf() usually works w/o errors */
-            /* == 0 : wrote nothing: the length limit was reached and no more */
-            /* frames can be added to the stack trace */
-            break;
+    const char *str = (*jni_env)->GetStringUTFChars(jni_env, jstr, NULL);
+    char *out = NULL;
+    if (NULL != str)
+    {
+        out = strdup(str);
+        if (out == NULL)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": strdup(): out of memory");
         }
 
-        wrote += frame_wrote;
+        (*jni_env)->ReleaseStringUTFChars(jni_env, jstr, str);
     }
+    check_and_clear_exception(jni_env);
 
-    (*jni_env)->DeleteLocalRef(jni_env, stack_trace_array);
-
-    return wrote;
+    (*jni_env)->DeleteLocalRef(jni_env, jstr);
+    return out;
 }
 
-static char *generate_thread_stack_trace(
+
+
+/*
+ * Captures data required for a report of an exception
+ *
+ * Doesn't call any Java method. The texts are formatted later by
+ * exception_report_format().
+ *
+ * @param exception_type_name Already resolved exception type name interned
+ *        in symbols or NULL
+ * @param pending Hold only a weak reference to the exception until
+ *        exception_report_resolve() is called; the data needed for a report
+ *        of a collected exception are captured too
+ */
+static T_exceptionReport *exception_report_new(
             jvmtiEnv *jvmti_env,
             JNIEnv   *jni_env,
-            char     *thread_name,
-            jobject  exception,
-            char     **executable)
+            jthread   thread,
+            jmethodID method,
+            int       caught,
+            jobject   exception_object,
+            const char *exception_type_name,
+            int       pending)
 {
-    char  *stack_trace_str;
-    /* allocate string which will contain stack trace */
-    stack_trace_str = (char*)calloc(MAX_STACK_TRACE_STRING_LENGTH + 1, sizeof(char));
-    if (stack_trace_str == NULL)
+    T_exceptionReport *report = (T_exceptionReport *)calloc(1, sizeof(*report));
+    if (NULL == report)
     {
         fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc(): out of memory");
         return NULL;
     }
 
-    int wrote = snprintf(stack_trace_str, MAX_STACK_TRACE_STRING_LENGTH, "Exception in thread \"%s\" ", thread_name);
-    int exception_wrote = print_exception_stack_trace(jvmti_env,
-            jni_env,
-            exception,
-            stack_trace_str + wrote,
-            MAX_STACK_TRACE_STRING_LENGTH - wrote,
-            executable);
-
-    if (exception_wrote <= 0)
+    report->pending = pending;
+    report->exception_object = pending
+        ? (*jni_env)->NewWeakGlobalRef(jni_env, exception_object)
+        : (*jni_env)->NewGlobalRef(jni_env, exception_object);
+    if (NULL == report->exception_object)
     {
-        free(stack_trace_str);
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": %s(): out of memory", pending ? "NewWeakGlobalRef" : "NewGlobalRef");
+        free(report);
         return NULL;
     }
 
-    wrote += exception_wrote;
+    if (pending)
+    {
+        count_exception_reference(&pendingExceptions, &pendingExceptionsPeak);
 
-    /* GetObjectClass() throws nothing */
-    jclass exception_class = (*jni_env)->GetObjectClass(jni_env, exception);
-    if (NULL == exception_class)
+        /* The exception may be collected before the thread ends */
+        if (NULL == exception_type_name)
+        {
+            exception_type_name = get_exception_type_name(jvmti_env, jni_env, exception_object, &(report->exception_type_name_copy));
+        }
+        report->detail_message = get_exception_detail_message(jni_env, exception_object);
+    }
+    else
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Cannot get class of an object\n");
-        return stack_trace_str;
+        count_exception_reference(&heldExceptions, &heldExceptionsPeak);
     }
 
-    jmethodID get_cause_method = (*jni_env)->GetMethodID(jni_env, exception_class, "getCause", "()Ljava/lang/Throwable;");
-    (*jni_env)->DeleteLocalRef(jni_env, exception_class);
+    report->exception_type_name = exception_type_name;
+    report->method = method;
+    report->caught = caught;
+    get_thread_name(jvmti_env, thread, report->thread_name, sizeof(report->thread_name));
 
-    if (check_and_clear_exception(jni_env) || NULL == get_cause_method)
-    {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of $(Exception class).getCause()Ljava/lang/Throwable;\n");
-        return stack_trace_str;
-    }
+    return report;
+}
 
-    jobject cause = (*jni_env)->CallObjectMethod(jni_env, exception, get_cause_method);
-    if (check_and_clear_exception(jni_env))
+
+
+/*
+ * Replaces the weak reference of a pending report by a global reference
+ *
+ * A collected exception is not a caught one. The report then holds no
+ * reference and is formatted from the data captured at throw time.
+ *
+ * @param exception_object A local reference to the exception if the caller
+ *        has one; otherwise NULL
+ * @returns 0 on success; otherwise non zero value on errors
+ */
+static int exception_report_resolve(
+            JNIEnv   *jni_env,
+            T_exceptionReport *report,
+            jobject   exception_object)
+{
+    if (!report->pending)
     {
-        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Failed to get an inner exception of the top most one;\n");
-        return stack_trace_str;
+        return 0;
     }
 
-    while (NULL != cause)
+    /* A global reference made from a cleared weak reference is NULL */
+    jobject global = (*jni_env)->NewGlobalRef(jni_env, NULL != exception_object ? exception_object : report->exception_object);
+    if (NULL == global
+        && (NULL != exception_object || !(*jni_env)->IsSameObject(jni_env, report->exception_object, NULL)))
     {
-        if ((size_t)(MAX_STACK_TRACE_STRING_LENGTH - wrote) < (sizeof(CAUSED_STACK_TRACE_HEADER) - 1))
-        {
-            VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Full exception stack trace buffer. Cannot add a cause.");
-            (*jni_env)->DeleteLocalRef(jni_env, cause);
-            break;
-        }
-
-        strcat(stack_trace_str + wrote, CAUSED_STACK_TRACE_HEADER);
-        wrote += sizeof(CAUSED_STACK_TRACE_HEADER) - 1;
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": NewGlobalRef(): out of memory");
+        return 1;
+    }
 
-        const int cause_wrote = print_exception_stack_trace(jvmti_env,
-                jni_env,
-                cause,
-                stack_trace_str + wrote,
-                MAX_STACK_TRACE_STRING_LENGTH - wrote,
-                /*No executable*/NULL);
+    (*jni_env)->DeleteWeakGlobalRef(jni_env, report->exception_object);
+    __sync_sub_and_fetch(&pendingExceptions, 1);
+    report->exception_object = global;
+    report->pending = 0;
 
-        if (cause_wrote <= 0)
-        {   /* <  0 : this should never happen, snprintf() usually works w/o errors */
-            /* == 0 : wrote nothing: the length limit was reached and no more */
-            /* cause can be added to the stack trace */
-            break;
-        }
+    if (NULL == global)
+    {
+        VERBOSE_PRINT("The pending exception has been collected, reporting the captured data\n");
+        return 0;
+    }
 
-        wrote += cause_wrote;
+    count_exception_reference(&heldExceptions, &heldExceptionsPeak);
 
-        jobject next_cause = (*jni_env)->CallObjectMethod(jni_env, cause, get_cause_method);
-        (*jni_env)->DeleteLocalRef(jni_env, cause);
-        if (check_and_clear_exception(jni_env))
-        {
-            VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Failed to get an inner exception of another inner one;\n");
-            return stack_trace_str;
-        }
-        cause = next_cause;
+    /* The captured data are needed only for a collected exception */
+    free(report->detail_message);
+    report->detail_message = NULL;
+    if (STACK_TRACE_JVMTI != globalConfig.stackTraceMode)
+    {
+        free(report->frames);
+        report->frames = NULL;
+        report->frame_count = 0;
     }
 
-    return stack_trace_str;
+    return 0;
 }
 
-#ifdef GENERATE_JVMTI_STACK_TRACE
+
+
 /*
- * Print one method from stack frame.
+ * Captures frames of the current thread for a report if stack traces are
+ * captured by JVMTI or if the exception may be collected before the report is
+ * formatted
+ *
+ * A single GetStackTrace() call fills the thread's preallocated buffer and
+ * only the filled frames are copied to the report. The report falls back to
+ * Throwable.getStackTrace() if the frames cannot be captured.
  */
-static void print_one_method_from_stack(
-            jvmtiEnv       *jvmti_env,
-            JNIEnv         *jni_env,
-            jvmtiFrameInfo  stack_frame,
-            char           *stack_trace_str)
+static void exception_report_capture_frames(
+            jvmtiEnv *jvmti_env,
+            jthread   thread,
+            T_threadState *thread_state,
+            T_exceptionReport *report)
 {
-    jvmtiError  error_code;
-    jclass      declaring_class;
-    char       *method_name = NULL;
-    char       *declaring_class_name = NULL;
-    char       *source_file_name = NULL;
-
-    error_code = (*jvmti_env)->GetMethodName(jvmti_env, stack_frame.method, &method_name, NULL, NULL);
-    if (error_code != JVMTI_ERROR_NONE)
+    if (STACK_TRACE_JVMTI != globalConfig.stackTraceMode && !report->pending)
     {
         return;
     }
-    error_code = (*jvmti_env)->GetMethodDeclaringClass(jvmti_env, stack_frame.method, &declaring_class);
-    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
-        goto print_one_method_from_stack_cleanup;
 
-    error_code = (*jvmti_env)->GetClassSignature(jvmti_env, declaring_class, &declaring_class_name, NULL);
-    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
-        goto print_one_method_from_stack_cleanup;
+    if (NULL == thread_state->frames)
+    {
+        thread_state->frames = (jvmtiFrameInfo *)malloc(sizeof(*thread_state->frames) * globalConfig.stackTraceDepth);
+        if (NULL == thread_state->frames)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory");
+            return;
+        }
+    }
 
-    if (error_code != JVMTI_ERROR_NONE)
+    jint count = 0;
+    jvmtiError error_code = (*jvmti_env)->GetStackTrace(jvmti_env, thread, 0, globalConfig.stackTraceDepth, thread_state->frames, &count);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)) || count < 1)
     {
         return;
     }
-    char *updated_class_name = format_class_name_for_JNI_call(declaring_class_name);
-    int line_number = get_line_number(jvmti_env, stack_frame.method, stack_frame.location);
-    if (declaring_class != NULL)
+
+    report->frames = (jvmtiFrameInfo *)malloc(sizeof(*report->frames) * count);
+    if (NULL == report->frames)
     {
-        error_code = (*jvmti_env)->GetSourceFileName(jvmti_env, declaring_class, &source_file_name);
-        if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
-            goto print_one_method_from_stack_cleanup;
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory");
+        return;
     }
 
-    char buf[1000];
-    char line_number_buf[20];
-    if (line_number >= 0)
+    memcpy(report->frames, thread_state->frames, sizeof(*report->frames) * count);
+    report->frame_count = count;
+}
+
+
+
+/*
+ * Formats the string representation of a collected exception in the same
+ * form as Throwable.toString() does
+ *
+ * @returns The string allocated from the arena; NULL if the exception has not
+ *          been collected
+ */
+static const char *exception_report_collected_string(
+            const T_exceptionReport *report,
+            T_arena  *arena)
+{
+    if (NULL != report->exception_object)
     {
-        sprintf(line_number_buf, "%d", line_number);
+        return NULL;
     }
-    else
+
+    const char *type_name = NULL != report->exception_type_name ? report->exception_type_name : "java.lang.Throwable";
+    if (NULL == report->detail_message)
     {
-        strcpy(line_number_buf, "Unknown location");
+        return type_name;
     }
 
-    char *class_location = get_path_to_class(jvmti_env, jni_env, declaring_class, updated_class_name, TO_EXTERNAL_FORM_METHOD_NAME);
-    sprintf(buf, "\tat %s%s(%s:%s) [%s]\n", updated_class_name, method_name, source_file_name, line_number_buf, class_location == NULL ? "unknown" : class_location);
-    free(class_location);
-    strncat(stack_trace_str, buf, MAX_STACK_TRACE_STRING_LENGTH - strlen(stack_trace_str) - 1);
-
-#ifdef VERBOSE
-    if (line_number >= 0)
+    const size_t size = strlen(type_name) + strlen(report->detail_message) + sizeof(": ");
+    char *string = (char *)arena_alloc(arena, size);
+    if (NULL == string)
     {
-        printf("\tat %s%s(%s:%d location)\n", updated_class_name, method_name, source_file_name, line_number);
+        return type_name;
     }
-    else
+
+    snprintf(string, size, "%s: %s", type_name, report->detail_message);
+    return string;
+}
+
+
+
+/*
+ * Formats the reason message, the stack trace and the additional information
+ * of a captured exception
+ *
+ * @param arena Arena the texts are allocated from
+ */
+static void exception_report_format(
+            jvmtiEnv *jvmti_env,
+            JNIEnv   *jni_env,
+            T_exceptionReport *report,
+            T_arena  *arena)
+{
+    jvmtiError error_code;
+    jclass method_class = NULL;
+    char *method_name_ptr = NULL;
+    char *class_signature_ptr = NULL;
+    /* Paths of classes are mallocated by the cache of class locations */
+    char *executable = NULL;
+
+    if (NULL == report->exception_type_name && NULL != report->exception_object)
+        report->exception_type_name = get_exception_type_name(jvmti_env, jni_env, report->exception_object, &(report->exception_type_name_copy));
+
+    error_code = (*jvmti_env)->GetMethodName(jvmti_env, report->method, &method_name_ptr, NULL, NULL);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+        goto exception_report_format_stack_trace;
+
+    error_code = (*jvmti_env)->GetMethodDeclaringClass(jvmti_env, report->method, &method_class);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+        goto exception_report_format_stack_trace;
+
+    error_code = (*jvmti_env)->GetClassSignature(jvmti_env, method_class, &class_signature_ptr, NULL);
+    (*jni_env)->DeleteLocalRef(jni_env, method_class);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+        goto exception_report_format_stack_trace;
+
+    /* readable class name */
+    char *class_name_ptr = format_class_name(class_signature_ptr, '\0');
+    if (NULL != report->exception_type_name)
     {
-        printf("\tat %s%s(%s:Unknown location)\n", updated_class_name, method_name, source_file_name);
+        report->message = format_exception_reason_message(arena, report->caught,
+                report->exception_type_name, class_name_ptr, method_name_ptr);
     }
-#endif
 
-print_one_method_from_stack_cleanup:
-    /* cleanup */
-    if (NULL != method_name)
+exception_report_format_stack_trace:
+    report->stacktrace = generate_thread_stack_trace(jvmti_env, jni_env, report->thread_name, report->exception_object,
+            exception_report_collected_string(report, arena), report->frames, report->frame_count, arena,
+            (globalConfig.executableFlags & ABRT_EXECUTABLE_THREAD) ? &executable : NULL);
+
+    if (NULL != executable)
     {
-        error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char*)method_name);
-        check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
+        report->executable = arena_strdup(arena, executable);
+        free(executable);
     }
-    if (NULL != declaring_class_name)
+
+    report->additional_info = collect_additional_debug_information(jvmti_env, jni_env, arena);
+
+    /* cleapup */
+    if (method_name_ptr != NULL)
     {
-        error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char*)declaring_class_name);
+        error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)method_name_ptr);
         check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
     }
-    if (NULL != source_file_name)
+    if (class_signature_ptr != NULL)
     {
-        error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char*)source_file_name);
+        error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)class_signature_ptr);
         check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
     }
 }
-#endif /* GENERATE_JVMTI_STACK_TRACE */
 
 
-#ifdef GENERATE_JVMTI_STACK_TRACE
+
 /*
- * Print stack trace for given thread.
+ * Formats and delivers a captured exception report. Runs on report workers.
  */
-static char *generate_stack_trace(
+static void JNICALL process_exception_report(
             jvmtiEnv *jvmti_env,
             JNIEnv   *jni_env,
-            jthread   thread,
-            char     *thread_name,
-            char     *exception_class_name)
+            void     *job)
 {
-    jvmtiError     error_code;
-    jvmtiFrameInfo stack_frames[MAX_STACK_TRACE_DEPTH];
+    T_exceptionReport *report = (T_exceptionReport *)job;
 
-    char  *stack_trace_str;
-    char  buf[1000];
-    int count = -1;
-    int i;
-
-    /* allocate string which will contain stack trace */
-    stack_trace_str = (char*)calloc(MAX_STACK_TRACE_STRING_LENGTH + 1, sizeof(char));
-    if (stack_trace_str == NULL)
+    /* All texts of the report are released at once after the dispatcher
+     * has copied them */
+    T_arena *arena = arena_thread_local();
+    if (NULL == arena)
     {
-        fprintf(stderr, "calloc(): out of memory");
-        return NULL;
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": can not format a report without memory\n");
+        exception_report_free(jni_env, report);
+        return;
     }
 
-    /* get stack trace */
-    error_code = (*jvmti_env)->GetStackTrace(jvmti_env, thread, 0, MAX_STACK_TRACE_DEPTH, stack_frames, &count);
-    VERBOSE_PRINT("Number of records filled: %d\n", count);
-    /* error or is stack trace empty? */
-    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__))
-            || count < 1)
-    {
-        free(stack_trace_str);
-        return NULL;
-    }
+    const T_arenaMark mark = arena_mark(arena);
+    exception_report_format(jvmti_env, jni_env, report, arena);
 
-    sprintf(buf, "Exception in thread \"%s\" %s\n", thread_name, exception_class_name);
-    strncat(stack_trace_str, buf, MAX_STACK_TRACE_STRING_LENGTH - strlen(stack_trace_str) - 1);
+    report_stacktrace(arena,
+            NULL != report->executable ? report->executable : processProperties.main_class,
+            NULL != report->message ? report->message : (report->caught ? "Caught exception" : "Uncaught exception"),
+            report->stacktrace,
+            report->additional_info,
+            /*uncaught?*/!report->caught,
+            report->suppressed);
 
-    /* print content of stack frames */
-    for (i = 0; i < count; i++) {
-        jvmtiFrameInfo stack_frame = stack_frames[i];
-        print_one_method_from_stack(jvmti_env, jni_env, stack_frame, stack_trace_str);
-    }
+    arena_release(arena, mark);
+    exception_report_free(jni_env, report);
+}
+
+
+
+/*
+ * Releases a report left queued when the report workers are stopped
+ */
+static void discard_exception_report(
+            JNIEnv   *jni_env,
+            void     *job)
+{
+    exception_report_free(jni_env, (T_exceptionReport *)job);
+}
+
+
+
+/*
+ * Hands a captured exception report over to a report worker. The report is
+ * processed on the current thread only if the workers are not running. The
+ * report is dropped if the queue of its worker is full, so the throwing
+ * thread is never held up by formatting.
+ */
+static void submit_exception_report(
+            jvmtiEnv *jvmti_env,
+            JNIEnv   *jni_env,
+            jlong     tid,
+            T_exceptionReport *report)
+{
+    mark_exception_reported(jvmti_env, report->exception_object, report->fingerprint);
 
-    VERBOSE_PRINT(
-    "Exception Stack Trace\n"
-    "=====================\n"
-    "Stack Trace Depth: %d\n"
-    "%s\n", count, stack_trace_str);
+    /* Reports of a thread are always processed by the same worker to keep
+     * their order */
+    switch (worker_pool_submit(reportWorkers, tid, report))
+    {
+        case WORKER_POOL_QUEUED:
+            break;
 
+        case WORKER_POOL_FULL:
+            VERBOSE_PRINT("The queue of the report worker is full, dropping the report\n");
+            exception_report_free(jni_env, report);
+            break;
 
-    return stack_trace_str;
+        case WORKER_POOL_NOT_RUNNING:
+            VERBOSE_PRINT("No report worker is available, processing the report synchronously\n");
+            process_exception_report(jvmti_env, jni_env, report);
+            break;
+    }
 }
-#endif /* GENERATE_JVMTI_STACK_TRACE */
 
 
 
@@ -2304,7 +3993,7 @@ static void JNICALL callback_on_exception(
             JNIEnv* jni_env,
             jthread thr,
             jmethodID method,
-            jlocation location __UNUSED_VAR,
+            jlocation location,
             jobject exception_object,
             jmethodID catch_method,
             jlocation catch_location __UNUSED_VAR)
@@ -2313,155 +4002,91 @@ static void JNICALL callback_on_exception(
     if (NULL != catch_method && NULL == globalConfig.reportedCaughExceptionTypes)
         return;
 
-    char *exception_type_name = NULL;
+    /* Exceptions thrown while formatting reports are not reported */
+    if (worker_pool_is_worker_thread())
+        return;
 
-    /* all operations should be processed in critical section */
-    enter_critical_section(jvmti_env, shared_lock);
+    const char *exception_type_name = NULL;
 
-    /* readable class names */
-    if (catch_method == NULL || exception_is_intended_to_be_reported(jvmti_env, jni_env, exception_object, &exception_type_name))
+    /* The checks below do not need the global lock. The configuration is
+     * read-only, JVMTI functions are thread safe and the set of reported
+     * exceptions is lock free. */
+    if (NULL != catch_method && !exception_is_intended_to_be_reported(jvmti_env, jni_env, exception_object, &exception_type_name))
     {
-        char tname[MAX_THREAD_NAME_LENGTH];
-        get_thread_name(jvmti_env, thr, tname, sizeof(tname));
-
-        jlong tid = 0;
-        T_jthrowableCircularBuf *threads_exc_buf = NULL;
-
-        if (NULL != threadMap && 0 == get_tid(jni_env, thr, &tid))
-        {
-            threads_exc_buf = (T_jthrowableCircularBuf *)jthread_map_get(threadMap, tid);
-            VERBOSE_PRINT("Got circular buffer for thread %p\n", (void *)threads_exc_buf);
-        }
-        else
-        {
-            VERBOSE_PRINT("Cannot get thread's ID. Disabling reporting to ABRT.");
-        }
-
-        if (NULL == threads_exc_buf || NULL == jthrowable_circular_buf_find(threads_exc_buf, exception_object))
-        {
-            jvmtiError error_code;
-            jclass method_class;
-            char *method_name_ptr = NULL;
-            char *method_signature_ptr = NULL;
-            char *class_name_ptr = NULL;
-            char *class_signature_ptr = NULL;
-
-            error_code = (*jvmti_env)->GetMethodName(jvmti_env, method, &method_name_ptr, &method_signature_ptr, NULL);
-            if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
-                goto callback_on_exception_cleanup;
-
-            error_code = (*jvmti_env)->GetMethodDeclaringClass(jvmti_env, method, &method_class);
-            if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
-                goto callback_on_exception_cleanup;
-
-            error_code = (*jvmti_env)->GetClassSignature(jvmti_env, method_class, &class_signature_ptr, NULL);
-            if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
-                goto callback_on_exception_cleanup;
-
-            class_name_ptr = format_class_name(class_signature_ptr, '.');
-
-            /* Remove trailing '.' */
-            const ssize_t class_name_len = strlen(class_name_ptr);
-            if (class_name_len > 0)
-                class_name_ptr[class_name_len - 1] = '\0';
-
-            if (NULL == exception_type_name)
-                exception_type_name = get_exception_type_name(jvmti_env, jni_env, exception_object);
-
-            char *message = format_exception_reason_message(/*caught?*/NULL != catch_method,
-                    exception_type_name, class_name_ptr, method_name_ptr);
-
-            char *executable = NULL;
-            char *stack_trace_str = generate_thread_stack_trace(jvmti_env, jni_env, tname, exception_object,
-                    (globalConfig.executableFlags & ABRT_EXECUTABLE_THREAD) ? &executable : NULL);
-
-            T_infoPair *additional_info = collect_additional_debug_information(jvmti_env, jni_env);
-
-            const char *report_message = message;
-            if (NULL == report_message)
-                report_message = (NULL != catch_method) ? "Caught exception" : "Uncaught exception";
-
-            if (NULL == catch_method)
-            {   /* Postpone reporting of uncaught exceptions as they may be caught by a native function */
-                T_exceptionReport *rpt = malloc(sizeof(*rpt));
-                if (NULL == rpt)
-                {
-                    fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory");
-                }
-                else
-                {
-                    rpt->message = message;
-                    message = NULL;
-
-                    rpt->exception_type_name = exception_type_name;
-                    exception_type_name = NULL;
-
-                    rpt->stacktrace = stack_trace_str;
-                    stack_trace_str = NULL;
-
-                    rpt->executable = executable;
-                    executable = NULL;
-
-                    rpt->additional_info = additional_info;
-                    additional_info = NULL;
+        return;
+    }
 
-                    rpt->exception_object = exception_object;
+    int reported = 0;
+    const jlong fingerprint = get_exception_fingerprint(jvmti_env, jni_env, thr, exception_object, &reported);
+    if (reported || fingerprint_set_contains(reportedExceptions, fingerprint))
+    {
+        VERBOSE_PRINT("The exception was already reported!\n");
+        return;
+    }
 
-                    jthread_map_push(uncaughtExceptionMap, tid, (T_exceptionReport *)rpt);
-                }
-            }
-            else
-            {
-                report_stacktrace(NULL != executable ? executable : processProperties.main_class,
-                        report_message,
-                        stack_trace_str,
-                        additional_info);
+    T_threadState *thread_state = get_thread_state(jvmti_env, jni_env, thr, /*create*/1);
+    if (NULL == thread_state)
+    {
+        VERBOSE_PRINT("Cannot get thread's data.\n");
+        return;
+    }
 
-                if (NULL == threads_exc_buf)
-                    threads_exc_buf = create_exception_buf_for_thread(jni_env, tid);
+    if (NULL == catch_method && NULL != thread_state->uncaught_report)
+    {
+        VERBOSE_PRINT("The thread has already a pending uncaught exception\n");
+        return;
+    }
 
-                if (NULL != threads_exc_buf)
-                {
-                    VERBOSE_PRINT("Pushing to circular buffer\n");
-                    jthrowable_circular_buf_push(threads_exc_buf, exception_object);
-                }
-            }
+    /* Another thread might have reported the same exception in the meantime.
+     * Duplicates are sorted out before the rate limiter takes a token. */
+    size_t suppressed = 0;
+    if (NULL != catch_method && !remember_reported_fingerprint(fingerprint, &suppressed))
+    {
+        return;
+    }
 
-            free(executable);
-            free(message);
-            free(stack_trace_str);
-            info_pair_vector_free(additional_info);
+    uint64_t signature = 0;
+    if (NULL != reportRateLimiter)
+    {
+        signature = get_exception_signature(jvmti_env, jni_env, exception_object, method, location);
 
-callback_on_exception_cleanup:
-        /* cleapup */
-            if (method_name_ptr != NULL)
-            {
-                error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)method_name_ptr);
-                check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
-            }
-            if (method_signature_ptr != NULL)
-            {
-                error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)method_signature_ptr);
-                check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
-            }
-            if (class_signature_ptr != NULL)
-            {
-                error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)class_signature_ptr);
-                check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
-            }
-        }
-        else
+        /* Uncaught exceptions are limited once they are resolved */
+        if (NULL != catch_method && report_rate_exceeded(signature, &suppressed))
         {
-            VERBOSE_PRINT("The exception was already reported!\n");
+            return;
         }
     }
 
-    if (NULL != exception_type_name)
+    /* Only the raw data are captured here, the report is formatted and
+     * delivered by a report worker. */
+    T_exceptionReport *rpt = exception_report_new(jvmti_env, jni_env, thr, method,
+            /*caught?*/NULL != catch_method, exception_object, exception_type_name,
+            /*pending?*/NULL == catch_method);
+
+    if (NULL == rpt)
+    {
+        return;
+    }
+
+    rpt->fingerprint = fingerprint;
+    rpt->signature = signature;
+    rpt->suppressed = suppressed;
+    exception_report_capture_frames(jvmti_env, thr, thread_state, rpt);
+
+    if (NULL != catch_method)
     {
-        free(exception_type_name);
+        submit_exception_report(jvmti_env, jni_env, thread_state->tid, rpt);
+        return;
     }
 
-    exit_critical_section(jvmti_env, shared_lock);
+    /* Postpone reporting of uncaught exceptions as they may be caught by a
+     * native function. The report is formatted only when the thread ends
+     * without catching the exception. Only the thread itself touches its
+     * data, no lock is needed. */
+    thread_state->uncaught_report = rpt;
+
+    /* Watch the thread's catch blocks until the report is resolved */
+    set_exception_catch_notification_mode(jvmti_env, thr, JVMTI_ENABLE);
 }
 
 
@@ -2476,131 +4101,44 @@ static void JNICALL callback_on_exception_catch(
             jlocation location __UNUSED_VAR,
             jobject   exception_object)
 {
-    if (jthread_map_empty(uncaughtExceptionMap))
-        return;
-
-    /* all operations should be processed in critical section */
-    enter_critical_section(jvmti_env, shared_lock);
-
-    jclass class;
-
-    jlong tid = 0;
-
-    if (get_tid(jni_env, thread, &tid))
-    {
-        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot clear uncaught exceptions");
-        goto callback_on_exception_catch_exit;
-    }
-
-    T_exceptionReport *rpt = (T_exceptionReport *)jthread_map_get(uncaughtExceptionMap, tid);
-    if (NULL == rpt)
-    {
-        goto callback_on_exception_catch_exit;
-    }
-
-    jclass object_class = (*jni_env)->FindClass(jni_env, "java/lang/Object");
-    if (check_and_clear_exception(jni_env) || NULL == object_class)
+    /* The event is enabled only for threads with a pending report, but
+     * another agent environment could have enabled it too */
+    T_threadState *thread_state = get_thread_state(jvmti_env, jni_env, thread, /*create*/0);
+    if (NULL == thread_state || NULL == thread_state->uncaught_report)
     {
-        VERBOSE_PRINT("Cannot find java/lang/Object class");
-        goto callback_on_exception_catch_exit;
+        return;
     }
 
-    jmethodID equal_method = (*jni_env)->GetMethodID(jni_env, object_class, "equals", "(Ljava/lang/Object;)Z");
-    if (check_and_clear_exception(jni_env) || NULL == equal_method)
-    {
-        VERBOSE_PRINT("Cannot find java.lang.Object.equals(Ljava/lang/Object;)Z method");
-        (*jni_env)->DeleteLocalRef(jni_env, object_class);
-        goto callback_on_exception_catch_exit;
-    }
+    T_exceptionReport *rpt = thread_state->uncaught_report;
 
-    jboolean equal_objects = (*jni_env)->CallBooleanMethod(jni_env, exception_object, equal_method, rpt->exception_object);
-    if (check_and_clear_exception(jni_env) || !equal_objects)
+    /* Identity, not java.lang.Object.equals(); no Java code is run */
+    if (!(*jni_env)->IsSameObject(jni_env, exception_object, rpt->exception_object))
     {
-        VERBOSE_PRINT("Cannot determine whether the caught exception is also the uncaught exception");
-        (*jni_env)->DeleteLocalRef(jni_env, object_class);
-        goto callback_on_exception_catch_exit;
+        VERBOSE_PRINT("The caught exception is not the uncaught exception");
+        return;
     }
 
-    /* Faster than get()-pop() approach is faster because it is search-and-search-free but
-     * pop()-push() approach is search-free-and-search-malloc
-     *
-     * JVM always catches java.security.PrivilegedActionException while
+    /* JVM always catches java.security.PrivilegedActionException while
      * handling uncaught java.lang.ClassNotFoundException throw by
      * initialization of the system (native) class loader.
      */
-    jthread_map_pop(uncaughtExceptionMap, tid);
+    thread_state->uncaught_report = NULL;
+    set_exception_catch_notification_mode(jvmti_env, thread, JVMTI_DISABLE);
 
-    if (exception_is_intended_to_be_reported(jvmti_env, jni_env, rpt->exception_object, &(rpt->exception_type_name)))
+    if (0 == exception_report_resolve(jni_env, rpt, exception_object)
+        && exception_is_intended_to_be_reported(jvmti_env, jni_env, rpt->exception_object, &(rpt->exception_type_name))
+        && !fingerprint_set_contains(reportedExceptions, rpt->fingerprint)
+        && remember_reported_fingerprint(rpt->fingerprint, &(rpt->suppressed))
+        && !report_rate_exceeded(rpt->signature, &(rpt->suppressed)))
     {
-        jlong tid = 0;
-        T_jthrowableCircularBuf *threads_exc_buf = NULL;
-
-        if (NULL != threadMap && 0 == get_tid(jni_env, thread, &tid))
-        {
-            threads_exc_buf = (T_jthrowableCircularBuf *)jthread_map_get(threadMap, tid);
-            VERBOSE_PRINT("Got circular buffer for thread %p\n", (void *)threads_exc_buf);
-        }
-        else
-        {
-            VERBOSE_PRINT("Cannot get thread's ID. Disabling reporting to ABRT.");
-        }
-
-        if (NULL == threads_exc_buf || NULL == jthrowable_circular_buf_find(threads_exc_buf, rpt->exception_object))
-        {
-            char *method_name_ptr = NULL;
-            char *method_signature_ptr = NULL;
-            char *class_signature_ptr = NULL;
-
-            jvmtiError error_code;
-
-            /* retrieve all required informations */
-            error_code = (*jvmti_env)->GetMethodName(jvmti_env, method, &method_name_ptr, &method_signature_ptr, NULL);
-            if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
-                goto callback_on_exception_catch_cleanup;
-
-            error_code = (*jvmti_env)->GetMethodDeclaringClass(jvmti_env, method, &class);
-            if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
-                goto callback_on_exception_catch_cleanup;
-
-            error_code = (*jvmti_env)->GetClassSignature(jvmti_env, class, &class_signature_ptr, NULL);
-            if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
-                goto callback_on_exception_catch_cleanup;
-
-            /* readable class name */
-            char *class_name_ptr = format_class_name(class_signature_ptr, '\0');
-            char *message = format_exception_reason_message(/*caught*/1, rpt->exception_type_name,  class_name_ptr, method_name_ptr);
-            report_stacktrace(NULL != rpt->executable ? rpt->executable : processProperties.main_class,
-                              NULL != message ? message : "Caught exception",
-                              rpt->stacktrace, rpt->additional_info);
-
-            if (NULL == threads_exc_buf)
-                threads_exc_buf = create_exception_buf_for_thread(jni_env, tid);
-
-            if (NULL != threads_exc_buf)
-            {
-                VERBOSE_PRINT("Pushing to circular buffer\n");
-                jthrowable_circular_buf_push(threads_exc_buf, rpt->exception_object);
-            }
-
-callback_on_exception_catch_cleanup:
-            /* cleapup */
-            if (method_name_ptr != NULL)
-            {
-                error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)method_name_ptr);
-                check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
-            }
-            if (class_signature_ptr != NULL)
-            {
-                error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)class_signature_ptr);
-                check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
-            }
-        }
+        /* The exception is reported as caught in the catching method */
+        rpt->method = method;
+        rpt->caught = 1;
+        submit_exception_report(jvmti_env, jni_env, thread_state->tid, rpt);
+        rpt = NULL;
     }
 
-    exception_report_free(rpt);
-
-callback_on_exception_catch_exit:
-    exit_critical_section(jvmti_env, shared_lock);
+    exception_report_free(jni_env, rpt);
 }
 
 
@@ -2652,6 +4190,82 @@ static void JNICALL callback_on_object_free(
 
 
 
+/**
+ * Called when a class loader tagged in classLoaderEnv is freed.
+ *
+ * Only JVMTI functions allowed in ObjectFree callback can be called here.
+ */
+static void JNICALL callback_on_class_loader_free(
+            jvmtiEnv *jvmti_env __UNUSED_VAR,
+            jlong tag)
+{
+    /* A collected class loader, its classes are gone too */
+    if (0 != (tag & CLASS_LOADER_TAG))
+    {
+        if (NULL != classLocations)
+            class_location_cache_invalidate_loader(classLocations, (uint64_t)tag);
+
+        if (NULL != frameCache)
+            frame_cache_invalidate_loader(frameCache, (uint64_t)tag);
+
+        if (NULL != lineNumbers)
+            line_number_cache_invalidate_loader(lineNumbers, (uint64_t)tag);
+    }
+}
+
+
+
+/**
+ * Called when a class is being loaded or redefined.
+ *
+ * Classes can be redefined by other agents, a debugger or
+ * java.lang.instrument. Methods of a redefined class keep their IDs but may
+ * get new line numbers, hence frames and tables cached for the methods are
+ * dropped. Class data are never modified.
+ */
+static void JNICALL callback_on_class_file_load_hook(
+            jvmtiEnv            *jvmti_env,
+            JNIEnv              *jni_env __UNUSED_VAR,
+            jclass               class_being_redefined,
+            jobject              loader __UNUSED_VAR,
+            const char          *name __UNUSED_VAR,
+            jobject              protection_domain __UNUSED_VAR,
+            jint                 class_data_len __UNUSED_VAR,
+            const unsigned char *class_data __UNUSED_VAR,
+            jint                *new_class_data_len __UNUSED_VAR,
+            unsigned char      **new_class_data __UNUSED_VAR)
+{
+    /* A newly loaded class has nothing cached */
+    if (NULL == class_being_redefined)
+    {
+        return;
+    }
+
+    jint method_count = 0;
+    jmethodID *methods = NULL;
+    jvmtiError error_code = (*jvmti_env)->GetClassMethods(jvmti_env, class_being_redefined, &method_count, &methods);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+    {
+        return;
+    }
+
+    VERBOSE_PRINT("Class %s is being redefined, dropping its cached frames\n", NULL == name ? "(unknown)" : name);
+
+    for (jint i = 0; i < method_count; ++i)
+    {
+        if (NULL != frameCache)
+            frame_cache_invalidate_method(frameCache, methods[i]);
+
+        if (NULL != lineNumbers)
+            line_number_cache_invalidate_method(lineNumbers, methods[i]);
+    }
+
+    error_code = (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)methods);
+    check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__));
+}
+
+
+
 #if ABRT_GARBAGE_COLLECTION_TIMEOUT_CHECK
 /**
  * Called on GC start.
@@ -2803,10 +4417,8 @@ jvmtiError register_all_callback_functions(jvmtiEnv *jvmti_env)
     /* JVMTI_EVENT_VM_INIT */
     callbacks.VMInit = &callback_on_vm_init;
 
-#if ABRT_VM_DEATH_CHECK
     /* JVMTI_EVENT_VM_DEATH */
     callbacks.VMDeath = &callback_on_vm_death;
-#endif /* ABRT_VM_DEATH_CHECK */
 
     /* JVMTI_EVENT_THREAD_END */
     callbacks.ThreadEnd = &callback_on_thread_end;
@@ -2817,6 +4429,9 @@ jvmtiError register_all_callback_functions(jvmtiEnv *jvmti_env)
     /* JVMTI_EVENT_EXCEPTION_CATCH */
     callbacks.ExceptionCatch = &callback_on_exception_catch;
 
+    /* JVMTI_EVENT_CLASS_PREPARE is enabled in VMInit callback */
+    callbacks.ClassPrepare = &callback_on_class_prepare;
+
 #if ABRT_OBJECT_ALLOCATION_SIZE_CHECK
     /* JVMTI_EVENT_VM_OBJECT_ALLOC */
     callbacks.VMObjectAlloc = &callback_on_object_alloc;
@@ -2827,6 +4442,10 @@ jvmtiError register_all_callback_functions(jvmtiEnv *jvmti_env)
     callbacks.ObjectFree = &callback_on_object_free;
 #endif
 
+    /* JVMTI_EVENT_CLASS_FILE_LOAD_HOOK is enabled only with JVMTI stack
+     * traces */
+    callbacks.ClassFileLoadHook = &callback_on_class_file_load_hook;
+
 #if ABRT_GARBAGE_COLLECTION_TIMEOUT_CHECK
     /* JVMTI_EVENT_GARBAGE_COLLECTION_START */
     callbacks.GarbageCollectionStart  = &callback_on_gc_start;
@@ -2873,12 +4492,10 @@ jvmtiError set_event_notification_modes(jvmtiEnv* jvmti_env)
         return error_code;
     }
 
-#if ABRT_VM_DEATH_CHECK
     if ((error_code = set_event_notification_mode(jvmti_env, JVMTI_EVENT_VM_DEATH)) != JNI_OK)
     {
         return error_code;
     }
-#endif /* ABRT_VM_DEATH_CHECK */
 
     if ((error_code = set_event_notification_mode(jvmti_env, JVMTI_EVENT_THREAD_END)) != JNI_OK)
     {
@@ -2890,10 +4507,8 @@ jvmtiError set_event_notification_modes(jvmtiEnv* jvmti_env)
         return error_code;
     }
 
-    if ((error_code = set_event_notification_mode(jvmti_env, JVMTI_EVENT_EXCEPTION_CATCH)) != JNI_OK)
-    {
-        return error_code;
-    }
+    /* JVMTI_EVENT_EXCEPTION_CATCH is enabled per thread only while the thread
+     * has a pending uncaught exception report */
 
 #if ABRT_OBJECT_ALLOCATION_SIZE_CHECK
     if ((error_code = set_event_notification_mode(jvmti_env, JVMTI_EVENT_VM_OBJECT_ALLOC)) != JNI_OK)
@@ -2933,6 +4548,52 @@ jvmtiError set_event_notification_modes(jvmtiEnv* jvmti_env)
 
 
 
+/*
+ * Creates a JVMTI environment tagging class loaders and observing their
+ * collection.
+ *
+ * @returns The environment; NULL on errors
+ */
+static jvmtiEnv *create_class_loader_env(JavaVM *jvm)
+{
+    jvmtiEnv *jvmti_env = NULL;
+    const jint result = (*jvm)->GetEnv(jvm, (void **)&jvmti_env, JVMTI_VERSION_1_0);
+    if (JNI_OK != result || NULL == jvmti_env)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": GetEnv() returned %d\n", (int)result);
+        return NULL;
+    }
+
+    jvmtiCapabilities capabilities;
+    (void)memset(&capabilities, 0, sizeof(capabilities));
+    capabilities.can_tag_objects = 1;
+    capabilities.can_generate_object_free_events = 1;
+
+    jvmtiError error_code = (*jvmti_env)->AddCapabilities(jvmti_env, &capabilities);
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+        goto create_class_loader_env_error;
+
+    jvmtiEventCallbacks callbacks;
+    (void)memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.ObjectFree = &callback_on_class_loader_free;
+
+    error_code = (*jvmti_env)->SetEventCallbacks(jvmti_env, &callbacks, (jint)sizeof(callbacks));
+    if (check_jvmti_error(jvmti_env, error_code, __FILE__ ":" STRINGIZE(__LINE__)))
+        goto create_class_loader_env_error;
+
+    /* Invalidates caches of classes of collected class loaders */
+    if (JVMTI_ERROR_NONE != set_event_notification_mode(jvmti_env, JVMTI_EVENT_OBJECT_FREE))
+        goto create_class_loader_env_error;
+
+    return jvmti_env;
+
+create_class_loader_env_error:
+    (*jvmti_env)->DisposeEnvironment(jvmti_env);
+    return NULL;
+}
+
+
+
 /*
  * Create monitor used to acquire and free global lock (mutex).
  */
@@ -3007,6 +4668,26 @@ JNIEXPORT jint JNICALL Agent_OnLoad(
         parse_configuration_file(&globalConfig, globalConfig.configurationFileName);
     }
 
+    if (NULL != globalConfig.fqdnDebugMethods)
+    {
+        debugMethods = debug_methods_new((const char *const *)globalConfig.fqdnDebugMethods,
+                globalConfig.debugMethodTimeout, globalConfig.debugMethodTTL);
+        if (NULL != debugMethods && 0 == debug_methods_count(debugMethods))
+        {
+            debug_methods_free(debugMethods, /*no references*/NULL);
+            debugMethods = NULL;
+        }
+    }
+
+    if (NULL != globalConfig.reportedCaughExceptionTypes)
+    {
+        caughtExceptionMatcher = exception_matcher_new((const char *const *)globalConfig.reportedCaughExceptionTypes);
+        if (NULL == caughtExceptionMatcher)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": can not compile the list of reported caught exceptions\n");
+        }
+    }
+
     /* check if JVM TI version is correct */
     result = (*jvm)->GetEnv(jvm, (void **) &jvmti_env, JVMTI_VERSION_1_0);
     if (result != JNI_OK || jvmti_env == NULL)
@@ -3038,6 +4719,9 @@ JNIEXPORT jint JNICALL Agent_OnLoad(
         return error_code;
     }
 
+    /* Classes are not cached per class loader without the environment */
+    classLoaderEnv = create_class_loader_env(jvm);
+
     /* create global mutex */
     if ((error_code = create_raw_monitor(jvmti_env, "Shared Agent Lock", &shared_lock)) != JNI_OK)
     {
@@ -3052,19 +4736,86 @@ JNIEXPORT jint JNICALL Agent_OnLoad(
     }
 #endif
 
-    threadMap = jthread_map_new();
-    if (NULL == threadMap)
+    reportedExceptions = fingerprint_set_new(REPORTED_EXCEPTION_FINGERPRINT_CAPACITY, get_reported_exception_ttl());
+    if (NULL == reportedExceptions)
     {
         fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": can not create a set of reported exceptions\n");
         return -1;
     }
 
-    uncaughtExceptionMap = jthread_map_new();
-    if (NULL == uncaughtExceptionMap)
+    symbols = string_table_new(SYMBOL_TABLE_MEMORY_LIMIT);
+    if (NULL == symbols)
     {
-        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": can not create a set of uncaught exceptions\n");
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": can not create a table of symbols\n");
         return -1;
     }
+
+    /* Locations of classes are resolved over and over without the cache */
+    classLocationStrings = string_table_new(CLASS_LOCATION_STRINGS_MEMORY_LIMIT);
+    if (NULL != classLocationStrings)
+    {
+        classLocations = class_location_cache_new(CLASS_LOCATION_CACHE_CAPACITY, classLocationStrings);
+    }
+    if (NULL == classLocations)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": can not create a cache of class locations\n");
+    }
+
+    /* Only frames captured by JVMTI are identified by method IDs */
+    if (STACK_TRACE_JVMTI == globalConfig.stackTraceMode)
+    {
+        frameCache = frame_cache_new(FRAME_CACHE_MEMORY_LIMIT);
+        if (NULL == frameCache)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": can not create a cache of frames\n");
+        }
+
+        lineNumbers = line_number_cache_new(LINE_NUMBER_CACHE_MEMORY_LIMIT);
+        if (NULL == lineNumbers)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": can not create a cache of line numbers\n");
+        }
+
+        /* Invalidates the caches when a class is redefined */
+        if ((NULL != frameCache || NULL != lineNumbers)
+                && JVMTI_ERROR_NONE != set_event_notification_mode(jvmti_env, JVMTI_EVENT_CLASS_FILE_LOAD_HOOK))
+        {
+            frame_cache_free(frameCache);
+            frameCache = NULL;
+            line_number_cache_free(lineNumbers);
+            lineNumbers = NULL;
+        }
+    }
+
+    /* Classes are searched by a linear scan without the index */
+    loadedClasses = class_index_new();
+    if (NULL == loadedClasses)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": can not create an index of loaded classes\n");
+    }
+
+    if (globalConfig.rateLimit > 0)
+    {
+        reportRateLimiter = rate_limiter_new(globalConfig.rateLimit, (size_t)globalConfig.rateLimitBurst);
+        if (NULL == reportRateLimiter)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": can not create report rate limiter. Reports will not be limited.\n");
+        }
+    }
+
+    reportDispatcher = create_report_dispatcher();
+    if (NULL == reportDispatcher)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": can not create report dispatcher\n");
+        return -1;
+    }
+
+    reportWorkers = worker_pool_new(REPORT_WORKER_COUNT, REPORT_WORKER_QUEUE_CAPACITY, &process_exception_report, &discard_exception_report);
+    if (NULL == reportWorkers)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": can not create report workers. Reports will be processed synchronously.\n");
+    }
+
     return JNI_OK;
 }
 
@@ -3095,8 +4846,19 @@ JNIEXPORT void JNICALL Agent_OnUnload(JavaVM *vm __UNUSED_VAR)
         fclose(fout);
     }
 
-    jthread_map_free(uncaughtExceptionMap);
-    jthread_map_free(threadMap);
+    fingerprint_set_free(reportedExceptions);
+    worker_pool_free(reportWorkers);
+    report_dispatcher_free(reportDispatcher);
+    rate_limiter_free(reportRateLimiter);
+    class_location_cache_free(classLocations);
+    string_table_free(classLocationStrings);
+    string_table_free(symbols);
+    frame_cache_free(frameCache);
+    line_number_cache_free(lineNumbers);
+    /* JVM has already released the weak references */
+    exception_matcher_free(caughtExceptionMatcher, /*no JNI*/NULL);
+    class_index_free(loadedClasses, /*no JNI*/NULL);
+    debug_methods_free(debugMethods, /*no JNI*/NULL);
 }
 
 
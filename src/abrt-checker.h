@@ -81,6 +81,47 @@ enum {
 
 
 
+/*
+ * Determines what to do with a new report when a queue of a report sink is full
+ */
+typedef enum {
+    OVERFLOW_DROP_NEWEST = 0, ///< Drop the new report
+    OVERFLOW_DROP_OLDEST,     ///< Drop the oldest queued report
+    OVERFLOW_BLOCK,           ///< Wait a limited time for a free space
+} T_overflowPolicy;
+
+
+
+/*
+ * Determines how stack traces of exceptions are obtained
+ */
+typedef enum {
+    STACK_TRACE_JAVA = 0,     ///< Throwable.getStackTrace() on a report worker
+    STACK_TRACE_JVMTI,        ///< JVMTI GetStackTrace() at the time of throw
+} T_stackTraceMode;
+
+
+
+/* Default maximal number of frames captured by STACK_TRACE_JVMTI */
+#define DEFAULT_STACK_TRACE_DEPTH 1024
+
+
+
+/* Default time limit for OVERFLOW_BLOCK in milliseconds */
+#define DEFAULT_OVERFLOW_TIMEOUT 100
+
+
+
+/* Default maximal number of reports with the same signature passed at once */
+#define DEFAULT_RATE_LIMIT_BURST 10
+
+
+
+/* Default time limit for a result of a debug method in milliseconds */
+#define DEFAULT_DEBUG_METHOD_TIMEOUT 1000
+
+
+
 /* A pointer determining that log output is disabled */
 #define DISABLED_LOG_OUTPUT ((void *)-1)
 
@@ -106,6 +147,37 @@ typedef struct {
      * reported */
     char **fqdnDebugMethods;
 
+    /* What to do with a report when a queue of a report sink is full */
+    T_overflowPolicy overflowPolicy;
+
+    /* Milliseconds to wait for a free space in a full queue if overflowPolicy
+     * is OVERFLOW_BLOCK */
+    int overflowTimeout;
+
+    /* Reports per second with the same exception type and throw location,
+     * 0 means unlimited */
+    double rateLimit;
+
+    /* Maximal number of reports with the same signature passed at once */
+    int rateLimitBurst;
+
+    /* Milliseconds to wait for a result of a debug method */
+    int debugMethodTimeout;
+
+    /* Milliseconds for which a result of a debug method is reused, 0 means
+     * the methods are called for every report */
+    int debugMethodTTL;
+
+    /* How stack traces of exceptions are obtained */
+    T_stackTraceMode stackTraceMode;
+
+    /* Maximal number of frames captured if stackTraceMode is
+     * STACK_TRACE_JVMTI */
+    int stackTraceDepth;
+
+    /* Print agent's statistics at VM death */
+    int statistics;
+
     int configured;
 } T_configuration;
 
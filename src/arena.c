@@ -0,0 +1,278 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "arena.h"
+#include "abrt-checker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <assert.h>
+
+
+
+/*
+ * Size of chunks of arenas of threads
+ */
+#ifndef ARENA_THREAD_CHUNK_SIZE
+#define ARENA_THREAD_CHUNK_SIZE (16 * 1024)
+#endif
+
+/*
+ * Number of regular chunks kept by an empty arena
+ */
+#ifndef ARENA_RETAINED_CHUNKS
+#define ARENA_RETAINED_CHUNKS 2
+#endif
+
+/*
+ * Alignment of allocated memory
+ */
+#define ARENA_ALIGNMENT (2 * sizeof(void *))
+
+
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;         ///< the next chunk or NULL
+    size_t size;                      ///< size of data
+    size_t used;                      ///< number of allocated bytes of data
+    union {
+        long double alignment;        ///< aligns data for any type
+        char data[1];                 ///< the memory
+    } memory;
+} T_arenaChunk;
+
+
+
+struct arena {
+    size_t chunk_size;                ///< size of regular chunks
+    T_arenaChunk *first;              ///< the first chunk or NULL
+    T_arenaChunk *current;            ///< the chunk allocations are taken from or NULL
+};
+
+
+
+/* Thread specific data pointing to the arena of the thread */
+static pthread_key_t thread_arena_key;
+static pthread_once_t thread_arena_key_once = PTHREAD_ONCE_INIT;
+
+
+
+static void thread_arena_destroy(void *arena)
+{
+    arena_free((T_arena *)arena);
+}
+
+
+
+static void thread_arena_key_create(void)
+{
+    pthread_key_create(&thread_arena_key, &thread_arena_destroy);
+}
+
+
+
+T_arena *arena_new(size_t chunk_size)
+{
+    T_arena *arena = (T_arena *)calloc(1, sizeof(*arena));
+    if (NULL == arena)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    arena->chunk_size = chunk_size;
+    return arena;
+}
+
+
+
+void arena_free(T_arena *arena)
+{
+    if (NULL == arena)
+    {
+        return;
+    }
+
+    T_arenaChunk *chunk = arena->first;
+    while (NULL != chunk)
+    {
+        T_arenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(arena);
+}
+
+
+
+T_arena *arena_thread_local(void)
+{
+    pthread_once(&thread_arena_key_once, thread_arena_key_create);
+
+    T_arena *arena = (T_arena *)pthread_getspecific(thread_arena_key);
+    if (NULL == arena)
+    {
+        arena = arena_new(ARENA_THREAD_CHUNK_SIZE);
+        if (NULL == arena)
+        {
+            return NULL;
+        }
+
+        if (0 != pthread_setspecific(thread_arena_key, arena))
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot store an arena of the thread\n");
+            arena_free(arena);
+            return NULL;
+        }
+    }
+
+    return arena;
+}
+
+
+
+void *arena_alloc(T_arena *arena, size_t size)
+{
+    assert(NULL != arena);
+
+    if (size > SIZE_MAX - ARENA_ALIGNMENT)
+    {
+        return NULL;
+    }
+
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+    T_arenaChunk *chunk = arena->current;
+    if (NULL != chunk && chunk->size - chunk->used >= size)
+    {
+        void *memory = chunk->memory.data + chunk->used;
+        chunk->used += size;
+        return memory;
+    }
+
+    /* Chunks after the current one are unused */
+    T_arenaChunk *next = NULL == chunk ? arena->first : chunk->next;
+    if (NULL == next || next->size < size)
+    {
+        const size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+        T_arenaChunk *new_chunk = (T_arenaChunk *)malloc(offsetof(T_arenaChunk, memory) + chunk_size);
+        if (NULL == new_chunk)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory\n");
+            return NULL;
+        }
+
+        new_chunk->size = chunk_size;
+        new_chunk->used = 0;
+        new_chunk->next = next;
+
+        if (NULL == chunk)
+        {
+            arena->first = new_chunk;
+        }
+        else
+        {
+            chunk->next = new_chunk;
+        }
+
+        next = new_chunk;
+    }
+
+    arena->current = next;
+    next->used = size;
+    return next->memory.data;
+}
+
+
+
+char *arena_strdup(T_arena *arena, const char *string)
+{
+    const size_t size = strlen(string) + 1;
+    char *copy = (char *)arena_alloc(arena, size);
+    if (NULL != copy)
+    {
+        memcpy(copy, string, size);
+    }
+
+    return copy;
+}
+
+
+
+T_arenaMark arena_mark(T_arena *arena)
+{
+    assert(NULL != arena);
+
+    T_arenaMark mark = { arena->current, NULL == arena->current ? 0 : arena->current->used };
+    return mark;
+}
+
+
+
+void arena_release(T_arena *arena, T_arenaMark mark)
+{
+    assert(NULL != arena);
+
+    T_arenaChunk *chunk = (T_arenaChunk *)mark.chunk;
+    if (NULL != chunk)
+    {
+        chunk->used = mark.used;
+    }
+
+    /* Chunks after the marked one were all allocated later */
+    for (T_arenaChunk *unused = NULL == chunk ? arena->first : chunk->next; NULL != unused; unused = unused->next)
+    {
+        unused->used = 0;
+    }
+
+    arena->current = chunk;
+
+    if (NULL != chunk && (chunk != arena->first || 0 != chunk->used))
+    {
+        return;
+    }
+
+    /* The arena is empty; free large chunks and keep only a few regular
+     * chunks for the next allocations */
+    size_t retained = 0;
+    T_arenaChunk **link = &(arena->first);
+    while (NULL != *link)
+    {
+        T_arenaChunk *iter = *link;
+        if (iter->size == arena->chunk_size && retained < ARENA_RETAINED_CHUNKS)
+        {
+            ++retained;
+            link = &(iter->next);
+            continue;
+        }
+
+        *link = iter->next;
+        free(iter);
+    }
+
+    arena->current = NULL;
+}
+
+
+
+/*
+ * finito
+ */
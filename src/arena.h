@@ -0,0 +1,135 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+
+
+#include <stddef.h>
+
+
+
+/*
+ * An opaque structure representing a bump pointer allocator
+ *
+ * Memory is taken from large chunks by moving a pointer and it is never
+ * freed piece by piece. Everything allocated after a mark is released at
+ * once by @arena_release. Released chunks are kept and reused by the next
+ * allocations, only a few of them are retained when the arena becomes empty.
+ *
+ * An arena is not thread safe. Every thread has its own arena returned by
+ * @arena_thread_local, so threads never contend for a lock of the system
+ * allocator while they build their reports.
+ */
+typedef struct arena T_arena;
+
+
+
+/*
+ * A position in an arena; allocations made after the mark are released
+ * together
+ */
+typedef struct {
+    void *chunk;                      ///< the current chunk at the time of the mark
+    size_t used;                      ///< used bytes of the chunk
+} T_arenaMark;
+
+
+
+/*
+ * Creates a new empty arena
+ *
+ * @param chunk_size Size of chunks, larger allocations get their own chunks
+ * @returns Mallocated arena on success; otherwise NULL
+ */
+T_arena *arena_new(size_t chunk_size);
+
+
+
+/*
+ * Frees the arena and all memory allocated from it
+ *
+ * @param arena Freed arena. Can be NULL
+ */
+void arena_free(T_arena *arena);
+
+
+
+/*
+ * Returns the arena of the calling thread
+ *
+ * The arena is created on the first call and freed at thread exit. Callers
+ * release their allocations by @arena_release in reverse order of their
+ * marks, hence nested callers can share the arena.
+ *
+ * @returns The arena or NULL if the arena cannot be created
+ */
+T_arena *arena_thread_local(void);
+
+
+
+/*
+ * Allocates memory aligned for any type
+ *
+ * @param arena The arena
+ * @param size Number of bytes
+ * @returns Pointer to the memory or NULL if out of memory
+ */
+void *arena_alloc(T_arena *arena, size_t size);
+
+
+
+/*
+ * Copies a string to the arena
+ *
+ * @param arena The arena
+ * @param string Copied string
+ * @returns The copy or NULL if out of memory
+ */
+char *arena_strdup(T_arena *arena, const char *string);
+
+
+
+/*
+ * Remembers the current position in the arena
+ *
+ * @param arena The arena
+ * @returns The mark for @arena_release
+ */
+T_arenaMark arena_mark(T_arena *arena);
+
+
+
+/*
+ * Releases all memory allocated after a mark
+ *
+ * @param arena The arena
+ * @param mark A mark returned by @arena_mark; memory allocated before the
+ *        mark must not have been released yet
+ */
+void arena_release(T_arena *arena, T_arenaMark mark);
+
+
+
+#endif // __ARENA_H__
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,340 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "class_index.h"
+#include "abrt-checker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+
+
+/*
+ * Number of independently locked stripes, must be a power of two
+ */
+#ifndef CLASS_INDEX_STRIPES
+#define CLASS_INDEX_STRIPES 32
+#endif
+
+/*
+ * Initial number of buckets of a stripe, must be a power of two
+ */
+#define CLASS_INDEX_STRIPE_BUCKETS 64
+
+
+
+typedef struct indexed_class {
+    struct indexed_class *chain;      ///< next entry in the same bucket
+    uint64_t hash;                    ///< hash of name
+    jweak class;                      ///< weak global reference to the class
+    char name[];                      ///< Class.getName()
+} T_indexedClass;
+
+
+
+typedef struct {
+    pthread_mutex_t mutex;            ///< guards all members below
+    T_indexedClass **buckets;         ///< hash table of entries
+    size_t mask;                      ///< number of buckets - 1
+    size_t length;                    ///< number of entries
+} T_classIndexStripe;
+
+
+
+struct class_index {
+    T_classIndexStripe stripes[CLASS_INDEX_STRIPES];
+    size_t size;                      ///< number of entries, updated atomically
+};
+
+
+
+/*
+ * FNV-1a of the class name
+ */
+static uint64_t class_index_hash(const char *class_name)
+{
+    uint64_t hash = UINT64_C(14695981039346656037);
+    for (const unsigned char *c = (const unsigned char *)class_name; '\0' != *c; ++c)
+    {
+        hash = (hash ^ *c) * UINT64_C(1099511628211);
+    }
+
+    return hash;
+}
+
+
+
+static T_classIndexStripe *class_index_stripe(T_classIndex *index, uint64_t hash)
+{
+    /* the bottom bits select a bucket */
+    return index->stripes + (hash >> 48) % CLASS_INDEX_STRIPES;
+}
+
+
+
+T_classIndex *class_index_new(void)
+{
+    T_classIndex *index = (T_classIndex *)calloc(1, sizeof(*index));
+    if (NULL == index)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < CLASS_INDEX_STRIPES; ++i)
+    {
+        T_classIndexStripe *stripe = index->stripes + i;
+        stripe->buckets = (T_indexedClass **)calloc(CLASS_INDEX_STRIPE_BUCKETS, sizeof(*stripe->buckets));
+        if (NULL == stripe->buckets)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+            while (i-- > 0)
+            {
+                pthread_mutex_destroy(&index->stripes[i].mutex);
+                free(index->stripes[i].buckets);
+            }
+            free(index);
+            return NULL;
+        }
+
+        stripe->mask = CLASS_INDEX_STRIPE_BUCKETS - 1;
+        pthread_mutex_init(&stripe->mutex, /*use default attributes*/NULL);
+    }
+
+    return index;
+}
+
+
+
+void class_index_free(T_classIndex *index, JNIEnv *jni_env)
+{
+    if (NULL == index)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < CLASS_INDEX_STRIPES; ++i)
+    {
+        T_classIndexStripe *stripe = index->stripes + i;
+        for (size_t j = 0; j <= stripe->mask; ++j)
+        {
+            T_indexedClass *entry = stripe->buckets[j];
+            while (NULL != entry)
+            {
+                T_indexedClass *next = entry->chain;
+                if (NULL != jni_env)
+                {
+                    (*jni_env)->DeleteWeakGlobalRef(jni_env, entry->class);
+                }
+                free(entry);
+                entry = next;
+            }
+        }
+
+        pthread_mutex_destroy(&stripe->mutex);
+        free(stripe->buckets);
+    }
+
+    free(index);
+}
+
+
+
+/*
+ * Doubles number of buckets of a stripe. Must be called with locked
+ * stripe's mutex.
+ */
+static void class_index_stripe_grow(T_classIndexStripe *stripe)
+{
+    const size_t mask = stripe->mask * 2 + 1;
+    T_indexedClass **buckets = (T_indexedClass **)calloc(mask + 1, sizeof(*buckets));
+    if (NULL == buckets)
+    {
+        /* Not fatal, only the chains get longer */
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc(): out of memory\n");
+        return;
+    }
+
+    for (size_t i = 0; i <= stripe->mask; ++i)
+    {
+        T_indexedClass *entry = stripe->buckets[i];
+        while (NULL != entry)
+        {
+            T_indexedClass *next = entry->chain;
+            entry->chain = buckets[entry->hash & mask];
+            buckets[entry->hash & mask] = entry;
+            entry = next;
+        }
+    }
+
+    free(stripe->buckets);
+    stripe->buckets = buckets;
+    stripe->mask = mask;
+}
+
+
+
+/*
+ * Removes entries of unloaded classes from a bucket. Must be called with
+ * locked stripe's mutex.
+ */
+static void class_index_stripe_purge_bucket(T_classIndex *index, T_classIndexStripe *stripe, JNIEnv *jni_env, size_t bucket)
+{
+    T_indexedClass **link = stripe->buckets + bucket;
+    while (NULL != *link)
+    {
+        T_indexedClass *entry = *link;
+        if ((*jni_env)->IsSameObject(jni_env, entry->class, NULL))
+        {
+            *link = entry->chain;
+            (*jni_env)->DeleteWeakGlobalRef(jni_env, entry->class);
+            free(entry);
+            --stripe->length;
+            __sync_sub_and_fetch(&index->size, 1);
+        }
+        else
+        {
+            link = &(entry->chain);
+        }
+    }
+}
+
+
+
+int class_index_add(T_classIndex *index, JNIEnv *jni_env, const char *class_name, jclass class)
+{
+    assert(NULL != index);
+
+    const uint64_t hash = class_index_hash(class_name);
+    T_classIndexStripe *stripe = class_index_stripe(index, hash);
+    const size_t length = strlen(class_name);
+
+    /* Allocate the entry before locking the mutex */
+    T_indexedClass *entry = (T_indexedClass *)malloc(sizeof(*entry) + length + 1);
+    if (NULL == entry)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory\n");
+        return 1;
+    }
+
+    entry->hash = hash;
+    memcpy(entry->name, class_name, length + 1);
+
+    pthread_mutex_lock(&stripe->mutex);
+
+    for (T_indexedClass *iter = stripe->buckets[hash & stripe->mask]; NULL != iter; iter = iter->chain)
+    {
+        if (iter->hash == hash && 0 == strcmp(iter->name, class_name)
+            && (*jni_env)->IsSameObject(jni_env, iter->class, class))
+        {
+            pthread_mutex_unlock(&stripe->mutex);
+            free(entry);
+            return 0;
+        }
+    }
+
+    entry->class = (*jni_env)->NewWeakGlobalRef(jni_env, class);
+    if (NULL == entry->class)
+    {
+        pthread_mutex_unlock(&stripe->mutex);
+        (*jni_env)->ExceptionClear(jni_env);
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot create a weak reference of class '%s'\n", class_name);
+        free(entry);
+        return 1;
+    }
+
+    /* Get rid of unloaded classes before making the table bigger */
+    if (stripe->length > stripe->mask)
+    {
+        for (size_t i = 0; i <= stripe->mask; ++i)
+        {
+            class_index_stripe_purge_bucket(index, stripe, jni_env, i);
+        }
+
+        if (stripe->length > stripe->mask / 2)
+        {
+            class_index_stripe_grow(stripe);
+        }
+    }
+
+    /* New classes are appended, so the first defined class is found first */
+    T_indexedClass **link = stripe->buckets + (hash & stripe->mask);
+    while (NULL != *link)
+    {
+        link = &((*link)->chain);
+    }
+
+    entry->chain = NULL;
+    *link = entry;
+    ++stripe->length;
+    __sync_add_and_fetch(&index->size, 1);
+
+    pthread_mutex_unlock(&stripe->mutex);
+
+    return 0;
+}
+
+
+
+jclass class_index_find(T_classIndex *index, JNIEnv *jni_env, const char *class_name)
+{
+    assert(NULL != index);
+
+    const uint64_t hash = class_index_hash(class_name);
+    T_classIndexStripe *stripe = class_index_stripe(index, hash);
+    jclass class = NULL;
+
+    pthread_mutex_lock(&stripe->mutex);
+
+    class_index_stripe_purge_bucket(index, stripe, jni_env, hash & stripe->mask);
+
+    for (T_indexedClass *iter = stripe->buckets[hash & stripe->mask]; NULL != iter; iter = iter->chain)
+    {
+        if (iter->hash == hash && 0 == strcmp(iter->name, class_name))
+        {
+            /* NULL if the class has been unloaded since the purge */
+            class = (jclass)(*jni_env)->NewLocalRef(jni_env, iter->class);
+            if (NULL != class)
+            {
+                break;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&stripe->mutex);
+
+    return class;
+}
+
+
+
+size_t class_index_size(T_classIndex *index)
+{
+    assert(NULL != index);
+
+    return __sync_add_and_fetch(&index->size, 0);
+}
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,106 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __CLASS_INDEX_H__
+#define __CLASS_INDEX_H__
+
+
+
+/*
+ * JNI types
+ */
+#include <jni.h>
+
+#include <stddef.h>
+
+
+
+/*
+ * An opaque structure mapping class names to loaded classes
+ *
+ * Classes are held by weak global references, so the index does not prevent
+ * classes from being unloaded. References of unloaded classes are removed
+ * lazily. The index can hold several classes of the same name defined by
+ * different class loaders.
+ */
+typedef struct class_index T_classIndex;
+
+
+
+/*
+ * Creates a new empty index
+ *
+ * @returns Mallocated index on success; otherwise NULL
+ */
+T_classIndex *class_index_new(void);
+
+
+
+/*
+ * Frees index's memory
+ *
+ * @param index A freed index. Can be NULL
+ * @param jni_env JNI environment used to delete the weak references. Can be
+ *        NULL if JVM is already gone.
+ */
+void class_index_free(T_classIndex *index, JNIEnv *jni_env);
+
+
+
+/*
+ * Adds a class to the index
+ *
+ * Does nothing if the class is already indexed.
+ *
+ * @param index The index
+ * @param jni_env JNI environment of the current thread
+ * @param class_name Class name in the form returned by Class.getName()
+ * @param class The class
+ * @returns 0 on success; otherwise non zero value
+ */
+int class_index_add(T_classIndex *index, JNIEnv *jni_env, const char *class_name, jclass class);
+
+
+
+/*
+ * Looks up a loaded class by its name
+ *
+ * @param index The index
+ * @param jni_env JNI environment of the current thread
+ * @param class_name Class name in the form returned by Class.getName()
+ * @returns A new local reference to the class indexed first; NULL if no
+ *          class of the name is loaded
+ */
+jclass class_index_find(T_classIndex *index, JNIEnv *jni_env, const char *class_name);
+
+
+
+/*
+ * Returns number of indexed classes including those which have been unloaded
+ * but not removed yet
+ */
+size_t class_index_size(T_classIndex *index);
+
+
+
+#endif // __CLASS_INDEX_H__
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,414 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "class_location_cache.h"
+#include "abrt-checker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+
+
+typedef struct class_location {
+    struct class_location *chain;     ///< next entry in the same bucket
+    struct class_location *newer;     ///< more recently used entry
+    struct class_location *older;     ///< less recently used entry
+    uint64_t hash;                    ///< hash of loader and class_name
+    uint64_t loader;                  ///< ID of the class loader
+    const char *class_name;           ///< interned name of the class
+    const char *external_form;        ///< interned URL.toExternalForm() or NULL
+    const char *path;                 ///< interned URL.getPath() or NULL
+                                      ///< the strings are copied right after
+                                      ///< the entry if they cannot be interned
+} T_classLocation;
+
+
+
+struct class_location_cache {
+    T_stringTable *strings;           ///< interns class names and locations
+    pthread_mutex_t mutex;            ///< guards all members below
+    T_classLocation **buckets;        ///< hash table of entries
+    size_t mask;                      ///< number of buckets - 1
+    size_t capacity;                  ///< maximal number of entries
+    size_t length;                    ///< number of entries
+    T_classLocation lru;              ///< sentinel of the ring ordered by use;
+                                      ///< lru.older is the most recently used
+                                      ///< entry and lru.newer the least one
+    size_t hits;                      ///< number of successful lookups
+    size_t misses;                    ///< number of failed lookups
+};
+
+
+
+/*
+ * FNV-1a of the loader ID and the class name
+ */
+static uint64_t class_location_hash(uint64_t loader, const char *class_name)
+{
+    uint64_t hash = UINT64_C(14695981039346656037);
+    for (size_t i = 0; i < sizeof(loader); ++i)
+    {
+        hash = (hash ^ ((loader >> (i * 8)) & 0xFF)) * UINT64_C(1099511628211);
+    }
+
+    for (const unsigned char *c = (const unsigned char *)class_name; '\0' != *c; ++c)
+    {
+        hash = (hash ^ *c) * UINT64_C(1099511628211);
+    }
+
+    return hash;
+}
+
+
+
+T_classLocationCache *class_location_cache_new(size_t capacity, T_stringTable *strings)
+{
+    assert(0 != capacity || !"Cannot create a cache with zero capacity");
+    assert(NULL != strings);
+
+    T_classLocationCache *cache = (T_classLocationCache *)calloc(1, sizeof(*cache));
+    if (NULL == cache)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    size_t buckets = 1;
+    while (buckets < capacity)
+    {
+        buckets <<= 1;
+    }
+
+    cache->buckets = (T_classLocation **)calloc(buckets, sizeof(*cache->buckets));
+    if (NULL == cache->buckets)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        free(cache);
+        return NULL;
+    }
+
+    cache->strings = strings;
+    cache->mask = buckets - 1;
+    cache->capacity = capacity;
+    cache->lru.newer = &cache->lru;
+    cache->lru.older = &cache->lru;
+    pthread_mutex_init(&cache->mutex, /*use default attributes*/NULL);
+
+    return cache;
+}
+
+
+
+void class_location_cache_free(T_classLocationCache *cache)
+{
+    if (NULL == cache)
+    {
+        return;
+    }
+
+    T_classLocation *entry = cache->lru.older;
+    while (&cache->lru != entry)
+    {
+        T_classLocation *next = entry->older;
+        free(entry);
+        entry = next;
+    }
+
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache->buckets);
+    free(cache);
+}
+
+
+
+/*
+ * Unlinks an entry from the list ordered by use. Must be called with locked
+ * cache's mutex.
+ */
+static void class_location_cache_unlink(T_classLocation *entry)
+{
+    entry->newer->older = entry->older;
+    entry->older->newer = entry->newer;
+}
+
+
+
+/*
+ * Makes an entry the most recently used. Must be called with locked cache's
+ * mutex.
+ */
+static void class_location_cache_link_newest(T_classLocationCache *cache, T_classLocation *entry)
+{
+    entry->older = cache->lru.older;
+    entry->newer = &cache->lru;
+    cache->lru.older->newer = entry;
+    cache->lru.older = entry;
+}
+
+
+
+/*
+ * Removes an entry from the cache and frees it. Must be called with locked
+ * cache's mutex.
+ */
+static void class_location_cache_remove(T_classLocationCache *cache, T_classLocation *entry)
+{
+    T_classLocation **link = cache->buckets + (entry->hash & cache->mask);
+    while (*link != entry)
+    {
+        link = &((*link)->chain);
+    }
+
+    *link = entry->chain;
+    class_location_cache_unlink(entry);
+    --cache->length;
+    free(entry);
+}
+
+
+
+/*
+ * Must be called with locked cache's mutex.
+ */
+static T_classLocation *class_location_cache_find(T_classLocationCache *cache, uint64_t hash, uint64_t loader, const char *class_name)
+{
+    for (T_classLocation *entry = cache->buckets[hash & cache->mask]; NULL != entry; entry = entry->chain)
+    {
+        if (entry->hash == hash && entry->loader == loader && 0 == strcmp(entry->class_name, class_name))
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+
+
+/*
+ * strdup() accepting NULL
+ *
+ * @returns 0 on success; otherwise non zero value
+ */
+static int class_location_strdup(const char *src, char **dest)
+{
+    *dest = NULL;
+    if (NULL != src)
+    {
+        *dest = strdup(src);
+        if (NULL == *dest)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": strdup(): out of memory\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+int class_location_cache_get(T_classLocationCache *cache, uint64_t loader, const char *class_name, char **external_form, char **path)
+{
+    assert(NULL != cache);
+
+    const uint64_t hash = class_location_hash(loader, class_name);
+    char *external_form_copy = NULL;
+    char *path_copy = NULL;
+    int retval = 1;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    T_classLocation *entry = class_location_cache_find(cache, hash, loader, class_name);
+    if (NULL == entry)
+    {
+        ++cache->misses;
+        goto class_location_cache_get_exit;
+    }
+
+    /* Copy the strings as the entry can be evicted once the mutex is unlocked */
+    if ((NULL != external_form && class_location_strdup(entry->external_form, &external_form_copy))
+        || (NULL != path && class_location_strdup(entry->path, &path_copy)))
+    {
+        free(external_form_copy);
+        goto class_location_cache_get_exit;
+    }
+
+    ++cache->hits;
+    class_location_cache_unlink(entry);
+    class_location_cache_link_newest(cache, entry);
+    retval = 0;
+
+class_location_cache_get_exit:
+    pthread_mutex_unlock(&cache->mutex);
+
+    if (0 == retval)
+    {
+        if (NULL != external_form)
+            *external_form = external_form_copy;
+
+        if (NULL != path)
+            *path = path_copy;
+    }
+
+    return retval;
+}
+
+
+
+/*
+ * Returns number of bytes of a copy of a string; 0 for NULL
+ */
+static size_t class_location_copy_size(const char *src)
+{
+    return NULL != src ? strlen(src) + 1 : 0;
+}
+
+
+
+/*
+ * Copies a string to memory of an entry and moves the pointer past the copy
+ *
+ * @returns The copy or NULL if @src is NULL
+ */
+static const char *class_location_copy(char **memory, const char *src)
+{
+    if (NULL == src)
+    {
+        return NULL;
+    }
+
+    const size_t size = strlen(src) + 1;
+    char *copy = (char *)memcpy(*memory, src, size);
+    *memory += size;
+    return copy;
+}
+
+
+
+void class_location_cache_put(T_classLocationCache *cache, uint64_t loader, const char *class_name, const char *external_form, const char *path)
+{
+    assert(NULL != cache);
+
+    /* Interned strings outlive evicted entries */
+    const char *interned_class_name = string_table_intern(cache->strings, class_name);
+    const char *interned_external_form = string_table_intern(cache->strings, external_form);
+    const char *interned_path = string_table_intern(cache->strings, path);
+    const int interned = NULL != interned_class_name
+        && (NULL == external_form || NULL != interned_external_form)
+        && (NULL == path || NULL != interned_path);
+
+    /* The entry holds private copies of the strings if the table is full */
+    size_t size = sizeof(T_classLocation);
+    if (!interned)
+    {
+        size += class_location_copy_size(class_name)
+            + class_location_copy_size(external_form)
+            + class_location_copy_size(path);
+    }
+
+    /* Allocate the entry before locking the mutex */
+    T_classLocation *entry = (T_classLocation *)calloc(1, size);
+    if (NULL == entry)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc(): out of memory\n");
+        return;
+    }
+
+    if (interned)
+    {
+        entry->class_name = interned_class_name;
+        entry->external_form = interned_external_form;
+        entry->path = interned_path;
+    }
+    else
+    {
+        char *memory = (char *)(entry + 1);
+        entry->class_name = class_location_copy(&memory, class_name);
+        entry->external_form = class_location_copy(&memory, external_form);
+        entry->path = class_location_copy(&memory, path);
+    }
+
+    entry->hash = class_location_hash(loader, class_name);
+    entry->loader = loader;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    /* Another thread might have resolved the same location in the meantime */
+    if (NULL != class_location_cache_find(cache, entry->hash, loader, class_name))
+    {
+        pthread_mutex_unlock(&cache->mutex);
+        free(entry);
+        return;
+    }
+
+    if (cache->length >= cache->capacity)
+    {
+        class_location_cache_remove(cache, cache->lru.newer);
+    }
+
+    T_classLocation **bucket = cache->buckets + (entry->hash & cache->mask);
+    entry->chain = *bucket;
+    *bucket = entry;
+    class_location_cache_link_newest(cache, entry);
+    ++cache->length;
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+void class_location_cache_invalidate_loader(T_classLocationCache *cache, uint64_t loader)
+{
+    assert(NULL != cache);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    T_classLocation *entry = cache->lru.older;
+    while (&cache->lru != entry)
+    {
+        T_classLocation *next = entry->older;
+        if (entry->loader == loader)
+        {
+            class_location_cache_remove(cache, entry);
+        }
+        entry = next;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+void class_location_cache_statistics(T_classLocationCache *cache, size_t *hits, size_t *misses)
+{
+    assert(NULL != cache);
+
+    pthread_mutex_lock(&cache->mutex);
+    *hits = cache->hits;
+    *misses = cache->misses;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,130 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __CLASS_LOCATION_CACHE_H__
+#define __CLASS_LOCATION_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "string_table.h"
+
+
+
+/*
+ * An opaque structure caching locations of classes
+ *
+ * A location of a class is the URL of the class file returned by
+ * ClassLoader.getResource() in two string forms. It never changes for a
+ * given class loader and class name, so it is resolved only once.
+ *
+ * Class loaders are identified by unique numbers assigned by the caller.
+ * The least recently used entry is evicted when the cache is full.
+ *
+ * Class names and locations are interned, so entries of the same class in
+ * several class loaders share their strings. Once the table of strings is
+ * full, new entries keep their own copies and are freed with them.
+ */
+typedef struct class_location_cache T_classLocationCache;
+
+
+
+/*
+ * Creates a new empty cache
+ *
+ * @param capacity Maximal number of cached locations
+ * @param strings Table interning cached strings, must outlive the cache and
+ *        should not be shared with other users to keep its memory for the
+ *        cache
+ * @returns Mallocated cache on success; otherwise NULL
+ */
+T_classLocationCache *class_location_cache_new(size_t capacity, T_stringTable *strings);
+
+
+
+/*
+ * Frees cache's memory
+ *
+ * @param cache A freed cache. Can be NULL
+ */
+void class_location_cache_free(T_classLocationCache *cache);
+
+
+
+/*
+ * Looks up a location of a class
+ *
+ * @param cache The cache
+ * @param loader ID of the class loader
+ * @param class_name Name of the class
+ * @param external_form Mallocated URL.toExternalForm() of the location or
+ *        NULL if unknown. Can be NULL if the caller is not interested.
+ * @param path Mallocated URL.getPath() of the location or NULL if unknown.
+ *        Can be NULL if the caller is not interested.
+ * @returns 0 if the location is cached; otherwise non zero value and the
+ *          output parameters are not changed
+ */
+int class_location_cache_get(T_classLocationCache *cache, uint64_t loader, const char *class_name, char **external_form, char **path);
+
+
+
+/*
+ * Stores a location of a class
+ *
+ * Unknown locations can be stored too, so the failing lookup is not
+ * repeated. The strings are copied to the entry if they cannot be interned.
+ *
+ * @param cache The cache
+ * @param loader ID of the class loader
+ * @param class_name Name of the class
+ * @param external_form URL.toExternalForm() of the location. Can be NULL.
+ * @param path URL.getPath() of the location. Can be NULL.
+ */
+void class_location_cache_put(T_classLocationCache *cache, uint64_t loader, const char *class_name, const char *external_form, const char *path);
+
+
+
+/*
+ * Removes all locations of classes of a class loader
+ *
+ * Does not call JNI, hence it can be called from ObjectFree callback.
+ *
+ * @param cache The cache
+ * @param loader ID of the class loader
+ */
+void class_location_cache_invalidate_loader(T_classLocationCache *cache, uint64_t loader);
+
+
+
+/*
+ * Gets cache's counters
+ *
+ * @param cache The cache
+ * @param hits Number of successful lookups
+ * @param misses Number of failed lookups
+ */
+void class_location_cache_statistics(T_classLocationCache *cache, size_t *hits, size_t *misses);
+
+
+
+#endif // __CLASS_LOCATION_CACHE_H__
+
+
+
+/*
+ * finito
+ */
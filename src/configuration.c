@@ -6,6 +6,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
+#include <limits.h>
 
 
 
@@ -18,6 +20,15 @@ enum {
     OPT_executable   = 1 << 5,
     OPT_conffile     = 1 << 6,
     OPT_debugmethod  = 1 << 7,
+    OPT_overflow     = 1 << 8,
+    OPT_overflowtimeout = 1 << 9,
+    OPT_statistics   = 1 << 10,
+    OPT_ratelimit    = 1 << 11,
+    OPT_burst        = 1 << 12,
+    OPT_debugmethodtimeout = 1 << 13,
+    OPT_debugmethodttl = 1 << 14,
+    OPT_stacktrace   = 1 << 15,
+    OPT_stacktracedepth = 1 << 16,
 };
 
 
@@ -42,6 +53,12 @@ void configuration_initialize(T_configuration *conf)
     conf->reportErrosTo = ED_JOURNALD;
     conf->outputFileName = DISABLED_LOG_OUTPUT;
     conf->configurationFileName = (char *)s_defaultConfFile;
+    conf->overflowPolicy = OVERFLOW_DROP_NEWEST;
+    conf->overflowTimeout = DEFAULT_OVERFLOW_TIMEOUT;
+    conf->rateLimitBurst = DEFAULT_RATE_LIMIT_BURST;
+    conf->debugMethodTimeout = DEFAULT_DEBUG_METHOD_TIMEOUT;
+    conf->stackTraceMode = STACK_TRACE_JAVA;
+    conf->stackTraceDepth = DEFAULT_STACK_TRACE_DEPTH;
 }
 
 
@@ -296,6 +313,213 @@ static int parse_option_debugmethod(T_configuration *conf, const char *value, T_
 
 
 
+static int parse_option_overflow(T_configuration *conf, const char *value, T_context *context __UNUSED_VAR)
+{
+    if (NULL == value || '\0' == value[0])
+    {
+        fprintf(stderr, "Value cannot be empty\n");
+        return 1;
+    }
+    else if (strcmp("dropnewest", value) == 0)
+    {
+        VERBOSE_PRINT("Drop new reports when a report queue is full\n");
+        conf->overflowPolicy = OVERFLOW_DROP_NEWEST;
+    }
+    else if (strcmp("dropoldest", value) == 0)
+    {
+        VERBOSE_PRINT("Drop the oldest reports when a report queue is full\n");
+        conf->overflowPolicy = OVERFLOW_DROP_OLDEST;
+    }
+    else if (strcmp("block", value) == 0)
+    {
+        VERBOSE_PRINT("Wait for a free space when a report queue is full\n");
+        conf->overflowPolicy = OVERFLOW_BLOCK;
+    }
+    else
+    {
+        fprintf(stderr, "Unknown value '%s'\n", value);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+
+/*
+ * Parses a numeric value of an option
+ *
+ * @param integer Non zero value to accept only whole numbers
+ * @param min The smallest valid value; the greatest one is INT_MAX
+ * @param what Description of the value for the error message
+ * @returns 0 on success; otherwise non zero value and @number is not changed
+ */
+static int parse_number(const char *value, int integer, double min, const char *what, double *number)
+{
+    if (NULL == value || '\0' == value[0])
+    {
+        fprintf(stderr, "Value cannot be empty\n");
+        return 1;
+    }
+
+    char *end = NULL;
+    errno = 0;
+    const double parsed = integer ? (double)strtol(value, &end, 10) : strtod(value, &end);
+    /* !(parsed >= min) catches NaN */
+    if (0 != errno || '\0' != *end || !(parsed >= min) || parsed > INT_MAX)
+    {
+        fprintf(stderr, "Value '%s' is not a valid %s\n", value, what);
+        return 1;
+    }
+
+    *number = parsed;
+    return 0;
+}
+
+
+
+/*
+ * Parses a whole number value of an option, see @parse_number
+ */
+static int parse_integer(const char *value, int min, const char *what, int *number)
+{
+    double parsed = 0;
+    if (parse_number(value, /*integer*/1, min, what, &parsed))
+    {
+        return 1;
+    }
+
+    *number = (int)parsed;
+    return 0;
+}
+
+
+
+static int parse_option_overflowtimeout(T_configuration *conf, const char *value, T_context *context __UNUSED_VAR)
+{
+    if (parse_integer(value, 0, "number of milliseconds", &(conf->overflowTimeout)))
+    {
+        return 1;
+    }
+
+    VERBOSE_PRINT("Wait at most %dms for a free space in a full report queue\n", conf->overflowTimeout);
+    return 0;
+}
+
+
+
+static int parse_option_statistics(T_configuration *conf, const char *value, T_context *context __UNUSED_VAR)
+{
+    if (value != NULL && (strcasecmp("on", value) == 0 || strcasecmp("yes", value) == 0))
+    {
+        VERBOSE_PRINT("Enabling statistics\n");
+        conf->statistics = 1;
+    }
+    else
+    {
+        conf->statistics = 0;
+    }
+
+    return 0;
+}
+
+
+
+static int parse_option_ratelimit(T_configuration *conf, const char *value, T_context *context __UNUSED_VAR)
+{
+    if (parse_number(value, /*integer*/0, 0, "number of reports per second", &(conf->rateLimit)))
+    {
+        return 1;
+    }
+
+    VERBOSE_PRINT("Limiting reports of the same exception to %f per second\n", conf->rateLimit);
+    return 0;
+}
+
+
+
+static int parse_option_burst(T_configuration *conf, const char *value, T_context *context __UNUSED_VAR)
+{
+    if (parse_integer(value, 1, "positive number of reports", &(conf->rateLimitBurst)))
+    {
+        return 1;
+    }
+
+    VERBOSE_PRINT("Passing at most %d reports of the same exception at once\n", conf->rateLimitBurst);
+    return 0;
+}
+
+
+
+static int parse_option_debugmethodtimeout(T_configuration *conf, const char *value, T_context *context __UNUSED_VAR)
+{
+    /* 0 means reports never wait; only results reused within
+     * debugmethodttl are attached */
+    if (parse_integer(value, 0, "number of milliseconds", &(conf->debugMethodTimeout)))
+    {
+        return 1;
+    }
+
+    VERBOSE_PRINT("Wait at most %dms for a result of a debug method\n", conf->debugMethodTimeout);
+    return 0;
+}
+
+
+
+static int parse_option_debugmethodttl(T_configuration *conf, const char *value, T_context *context __UNUSED_VAR)
+{
+    if (parse_integer(value, 0, "number of milliseconds", &(conf->debugMethodTTL)))
+    {
+        return 1;
+    }
+
+    VERBOSE_PRINT("Reuse results of debug methods for %dms\n", conf->debugMethodTTL);
+    return 0;
+}
+
+
+
+static int parse_option_stacktrace(T_configuration *conf, const char *value, T_context *context __UNUSED_VAR)
+{
+    if (NULL == value || '\0' == value[0])
+    {
+        fprintf(stderr, "Value cannot be empty\n");
+        return 1;
+    }
+    else if (strcmp("java", value) == 0)
+    {
+        VERBOSE_PRINT("Get stack traces from Throwable.getStackTrace()\n");
+        conf->stackTraceMode = STACK_TRACE_JAVA;
+    }
+    else if (strcmp("jvmti", value) == 0)
+    {
+        VERBOSE_PRINT("Capture stack traces by JVMTI\n");
+        conf->stackTraceMode = STACK_TRACE_JVMTI;
+    }
+    else
+    {
+        fprintf(stderr, "Unknown value '%s'\n", value);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+
+static int parse_option_stacktracedepth(T_configuration *conf, const char *value, T_context *context __UNUSED_VAR)
+{
+    if (parse_integer(value, 1, "positive number of frames", &(conf->stackTraceDepth)))
+    {
+        return 1;
+    }
+
+    VERBOSE_PRINT("Capture at most %d frames\n", conf->stackTraceDepth);
+    return 0;
+}
+
+
+
 static void parse_key_value(T_configuration *conf, const char *key, const char *value, T_context *context)
 {
     static struct parse_pair {
@@ -311,6 +535,15 @@ static void parse_key_value(T_configuration *conf, const char *key, const char *
         { OPT_executable, "executable", parse_option_executable },
         { OPT_conffile, "conffile", parse_option_conffile },
         { OPT_debugmethod, "debugmethod", parse_option_debugmethod },
+        { OPT_overflow, "overflow", parse_option_overflow },
+        { OPT_overflowtimeout, "overflowtimeout", parse_option_overflowtimeout },
+        { OPT_statistics, "statistics", parse_option_statistics },
+        { OPT_ratelimit, "ratelimit", parse_option_ratelimit },
+        { OPT_burst, "burst", parse_option_burst },
+        { OPT_debugmethodtimeout, "debugmethodtimeout", parse_option_debugmethodtimeout },
+        { OPT_debugmethodttl, "debugmethodttl", parse_option_debugmethodttl },
+        { OPT_stacktrace, "stacktrace", parse_option_stacktrace },
+        { OPT_stacktracedepth, "stacktracedepth", parse_option_stacktracedepth },
     };
 
     for (size_t i = 0; i < sizeof(arguments)/sizeof(arguments[0]); ++i)
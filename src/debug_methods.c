@@ -0,0 +1,608 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "debug_methods.h"
+#include "abrt-checker.h"
+#include "worker_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <assert.h>
+
+
+
+/*
+ * Signature of debug methods
+ */
+#define DEBUG_METHOD_SIGNATURE "()Ljava/lang/String;"
+
+/*
+ * java.lang.reflect.Modifier.STATIC
+ */
+#define DEBUG_METHOD_MODIFIER_STATIC 0x0008
+
+
+
+typedef struct {
+    T_debugMethods *owner;            ///< the owning structure
+    const char *label;                ///< the configured FQDN
+    char *class_name;                 ///< name.space.Class
+    char *method_name;                ///< method
+    jweak class;                      ///< declaring class or NULL if unresolved
+    jmethodID method;                 ///< the method or NULL if unresolved
+    char *result;                     ///< result of the last call or NULL
+    uint64_t result_time;             ///< when the result was returned
+    int pending;                      ///< the method is queued or running
+    uint64_t pending_since;           ///< when the pending call was requested
+    size_t completed;                 ///< number of finished calls
+    T_debugMethodStatistics stats;    ///< counters
+} T_debugMethod;
+
+
+
+struct debug_methods {
+    pthread_mutex_t mutex;            ///< guards all members of the methods
+    pthread_cond_t done;              ///< signals finished calls
+    T_workerPool *runner;             ///< the thread calling the methods
+    uint64_t timeout;                 ///< time budget of a call in microseconds
+    uint64_t ttl;                     ///< lifetime of a result in microseconds
+    uint64_t busy_since;              ///< start of the running call or 0
+    int stopping;                     ///< the runner is being stopped
+    size_t count;                     ///< number of methods
+    T_debugMethod *methods;           ///< the methods
+};
+
+
+
+/*
+ * Returns monotonic time in microseconds
+ */
+static uint64_t debug_methods_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+
+
+static void JNICALL debug_methods_execute(jvmtiEnv *jvmti_env, JNIEnv *jni_env, void *job);
+
+
+
+T_debugMethods *debug_methods_new(const char *const *fqdns, int timeout, int ttl)
+{
+    T_debugMethods *methods = (T_debugMethods *)calloc(1, sizeof(*methods));
+    if (NULL == methods)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    size_t cnt = 0;
+    for (const char *const *iter = fqdns; NULL != iter && NULL != *iter; ++iter)
+    {
+        ++cnt;
+    }
+
+    methods->methods = (T_debugMethod *)calloc(cnt + 1, sizeof(*methods->methods));
+    if (NULL == methods->methods)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        free(methods);
+        return NULL;
+    }
+
+    /* Jobs are the methods, nothing to release */
+    methods->runner = worker_pool_new(/*single thread*/1, cnt + 1, &debug_methods_execute, /*discard*/NULL);
+    if (NULL == methods->runner)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot create a thread for debug methods\n");
+        free(methods->methods);
+        free(methods);
+        return NULL;
+    }
+
+    pthread_mutex_init(&methods->mutex, /*use default attributes*/NULL);
+    pthread_cond_init(&methods->done, /*use default attributes*/NULL);
+    methods->timeout = (uint64_t)(timeout > 0 ? timeout : 0) * 1000;
+    methods->ttl = (uint64_t)(ttl > 0 ? ttl : 0) * 1000;
+
+    for (const char *const *iter = fqdns; NULL != iter && NULL != *iter; ++iter)
+    {
+        /* name.space.class.method -> name.space.class + method
+         */
+        const char *method_name = strrchr(*iter, '.');
+        if (NULL == method_name || *iter == method_name || '\0' == method_name[1])
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Debug method '%s' is not in FQDN format\n", *iter);
+            continue;
+        }
+
+        T_debugMethod *debug_method = methods->methods + methods->count;
+        debug_method->owner = methods;
+        debug_method->label = *iter;
+        debug_method->stats.label = *iter;
+        debug_method->class_name = strndup(*iter, method_name - *iter);
+        debug_method->method_name = strdup(method_name + 1);
+        if (NULL == debug_method->class_name || NULL == debug_method->method_name)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": strdup(): out of memory\n");
+            free(debug_method->class_name);
+            free(debug_method->method_name);
+            debug_method->class_name = NULL;
+            debug_method->method_name = NULL;
+            continue;
+        }
+
+        ++methods->count;
+    }
+
+    return methods;
+}
+
+
+
+void debug_methods_free(T_debugMethods *methods, JNIEnv *jni_env)
+{
+    if (NULL == methods)
+    {
+        return;
+    }
+
+    /* A worker stuck in a hung debug method still uses the methods and
+     * signals the condition once the method returns */
+    if (worker_pool_free(methods->runner))
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot free debug methods while a method is running\n");
+        return;
+    }
+
+    for (size_t i = 0; i < methods->count; ++i)
+    {
+        T_debugMethod *debug_method = methods->methods + i;
+        if (NULL != jni_env && NULL != debug_method->class)
+        {
+            (*jni_env)->DeleteWeakGlobalRef(jni_env, debug_method->class);
+        }
+
+        free(debug_method->class_name);
+        free(debug_method->method_name);
+        free(debug_method->result);
+    }
+
+    pthread_cond_destroy(&methods->done);
+    pthread_mutex_destroy(&methods->mutex);
+    free(methods->methods);
+    free(methods);
+}
+
+
+
+size_t debug_methods_count(T_debugMethods *methods)
+{
+    assert(NULL != methods);
+
+    return methods->count;
+}
+
+
+
+int debug_methods_start(T_debugMethods *methods, jvmtiEnv *jvmti_env, JNIEnv *jni_env)
+{
+    assert(NULL != methods);
+
+    return 0 == worker_pool_start(methods->runner, jvmti_env, jni_env);
+}
+
+
+
+void debug_methods_stop(T_debugMethods *methods, jvmtiEnv *jvmti_env, JNIEnv *jni_env)
+{
+    if (NULL == methods)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&methods->mutex);
+    methods->stopping = 1;
+    pthread_mutex_unlock(&methods->mutex);
+
+    worker_pool_stop(methods->runner, jvmti_env, jni_env);
+}
+
+
+
+/*
+ * Finds a static method returning String among methods declared by a class.
+ *
+ * Unlike JNI GetStaticMethodID(), JVMTI does not initialize the class.
+ */
+static jmethodID debug_methods_find_method(
+        jvmtiEnv   *jvmti_env,
+        jclass      class,
+        const char *method_name)
+{
+    jint method_count = 0;
+    jmethodID *class_methods = NULL;
+    jvmtiError error_code = (*jvmti_env)->GetClassMethods(jvmti_env, class, &method_count, &class_methods);
+    if (JVMTI_ERROR_NONE != error_code)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot get methods of a class: %d\n", error_code);
+        return NULL;
+    }
+
+    jmethodID found = NULL;
+    for (jint i = 0; NULL == found && i < method_count; ++i)
+    {
+        jint modifiers = 0;
+        error_code = (*jvmti_env)->GetMethodModifiers(jvmti_env, class_methods[i], &modifiers);
+        if (JVMTI_ERROR_NONE != error_code || 0 == (modifiers & DEBUG_METHOD_MODIFIER_STATIC))
+        {
+            continue;
+        }
+
+        char *name = NULL;
+        char *signature = NULL;
+        error_code = (*jvmti_env)->GetMethodName(jvmti_env, class_methods[i], &name, &signature, NULL);
+        if (JVMTI_ERROR_NONE != error_code)
+        {
+            continue;
+        }
+
+        if (0 == strcmp(method_name, name) && 0 == strcmp(DEBUG_METHOD_SIGNATURE, signature))
+        {
+            found = class_methods[i];
+        }
+
+        (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)name);
+        (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)signature);
+    }
+
+    (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)class_methods);
+    return found;
+}
+
+
+
+void debug_methods_resolve(T_debugMethods *methods, jvmtiEnv *jvmti_env, JNIEnv *jni_env, const char *class_name, jclass class)
+{
+    assert(NULL != methods);
+
+    /* Names never change, no lock is needed */
+    for (size_t i = 0; i < methods->count; ++i)
+    {
+        T_debugMethod *debug_method = methods->methods + i;
+        if (0 != strcmp(debug_method->class_name, class_name))
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&methods->mutex);
+        const int resolved = NULL != debug_method->class && !(*jni_env)->IsSameObject(jni_env, debug_method->class, NULL);
+        pthread_mutex_unlock(&methods->mutex);
+
+        if (resolved)
+        {
+            continue;
+        }
+
+        jmethodID method = debug_methods_find_method(jvmti_env, class, debug_method->method_name);
+        if (NULL == method)
+        {
+            VERBOSE_PRINT("Class '%s' does not declare debug method '%s'\n", class_name, debug_method->label);
+            continue;
+        }
+
+        jweak weak_class = (*jni_env)->NewWeakGlobalRef(jni_env, class);
+        if (NULL == weak_class)
+        {
+            (*jni_env)->ExceptionClear(jni_env);
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot create a weak reference of class '%s'\n", class_name);
+            continue;
+        }
+
+        pthread_mutex_lock(&methods->mutex);
+        /* Another thread might have resolved the method in the meantime */
+        if (NULL != debug_method->class && !(*jni_env)->IsSameObject(jni_env, debug_method->class, NULL))
+        {
+            pthread_mutex_unlock(&methods->mutex);
+            (*jni_env)->DeleteWeakGlobalRef(jni_env, weak_class);
+            continue;
+        }
+
+        jweak unloaded_class = debug_method->class;
+        debug_method->class = weak_class;
+        debug_method->method = method;
+        pthread_mutex_unlock(&methods->mutex);
+
+        if (NULL != unloaded_class)
+        {
+            (*jni_env)->DeleteWeakGlobalRef(jni_env, unloaded_class);
+        }
+
+        VERBOSE_PRINT("Resolved debug method '%s'\n", debug_method->label);
+    }
+}
+
+
+
+/*
+ * Gets a local reference to the class and ID of a debug method
+ *
+ * @returns 0 if the method is resolved; otherwise non zero value
+ */
+static int debug_methods_get_method(T_debugMethods *methods, JNIEnv *jni_env, T_debugMethod *debug_method, jclass *class, jmethodID *method)
+{
+    jweak unloaded_class = NULL;
+
+    *class = NULL;
+    *method = NULL;
+
+    pthread_mutex_lock(&methods->mutex);
+    if (NULL != debug_method->class)
+    {
+        /* The local reference keeps the class loaded while it is used */
+        *class = (jclass)(*jni_env)->NewLocalRef(jni_env, debug_method->class);
+        if (NULL != *class)
+        {
+            *method = debug_method->method;
+        }
+        else
+        {   /* The class has been unloaded, the method ID is no longer valid */
+            unloaded_class = debug_method->class;
+            debug_method->class = NULL;
+            debug_method->method = NULL;
+        }
+    }
+    pthread_mutex_unlock(&methods->mutex);
+
+    if (NULL != unloaded_class)
+    {
+        VERBOSE_PRINT("Class of debug method '%s' has been unloaded\n", debug_method->label);
+        (*jni_env)->DeleteWeakGlobalRef(jni_env, unloaded_class);
+    }
+
+    return NULL == *class;
+}
+
+
+
+int debug_methods_get(T_debugMethods *methods, JNIEnv *jni_env, size_t index, const char **label, jclass *class, jmethodID *method)
+{
+    assert(NULL != methods);
+    assert(index < methods->count);
+
+    T_debugMethod *debug_method = methods->methods + index;
+    *label = debug_method->label;
+    return debug_methods_get_method(methods, jni_env, debug_method, class, method);
+}
+
+
+
+/*
+ * Calls a debug method on the current thread
+ *
+ * @returns Mallocated result or NULL
+ */
+static char *debug_methods_call(T_debugMethods *methods, JNIEnv *jni_env, T_debugMethod *debug_method)
+{
+    jclass debug_class = NULL;
+    jmethodID method = NULL;
+    if (debug_methods_get_method(methods, jni_env, debug_method, &debug_class, &method))
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not find debug method '%s'\n", debug_method->label);
+        return NULL;
+    }
+
+    jstring debug_string = (*jni_env)->CallStaticObjectMethod(jni_env, debug_class, method);
+    (*jni_env)->DeleteLocalRef(jni_env, debug_class);
+
+    jthrowable exception = (*jni_env)->ExceptionOccurred(jni_env);
+    if (NULL != exception)
+    {
+#ifdef VERBOSE
+        (*jni_env)->ExceptionDescribe(jni_env);
+#endif
+        (*jni_env)->ExceptionClear(jni_env);
+        (*jni_env)->DeleteLocalRef(jni_env, exception);
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Exception occurred in debug method '%s'\n", debug_method->label);
+        return NULL;
+    }
+
+    char *result = NULL;
+    if (NULL != debug_string)
+    {
+        const char *tmp = (*jni_env)->GetStringUTFChars(jni_env, debug_string, NULL);
+        if (NULL != tmp)
+        {
+            result = strdup(tmp);
+            (*jni_env)->ReleaseStringUTFChars(jni_env, debug_string, tmp);
+        }
+        (*jni_env)->DeleteLocalRef(jni_env, debug_string);
+    }
+
+    if (NULL == result)
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Debug method '%s' returned no string\n", debug_method->label);
+    }
+
+    return result;
+}
+
+
+
+/*
+ * Calls a requested debug method. Runs on the runner thread.
+ */
+static void JNICALL debug_methods_execute(jvmtiEnv *jvmti_env __UNUSED_VAR, JNIEnv *jni_env, void *job)
+{
+    T_debugMethod *debug_method = (T_debugMethod *)job;
+    T_debugMethods *methods = debug_method->owner;
+
+    pthread_mutex_lock(&methods->mutex);
+    /* Calls left in the queue of a stopped runner are abandoned because
+     * nobody waits for them */
+    const int stopping = methods->stopping;
+    const uint64_t started = debug_methods_now();
+    methods->busy_since = stopping ? 0 : started;
+    pthread_mutex_unlock(&methods->mutex);
+
+    char *result = stopping ? NULL : debug_methods_call(methods, jni_env, debug_method);
+    const uint64_t finished = debug_methods_now();
+
+    pthread_mutex_lock(&methods->mutex);
+    methods->busy_since = 0;
+    debug_method->pending = 0;
+    ++debug_method->completed;
+
+    if (!stopping)
+    {
+        const uint64_t latency = finished - started;
+        ++debug_method->stats.calls;
+        debug_method->stats.total_latency += latency;
+        if (latency > debug_method->stats.max_latency)
+        {
+            debug_method->stats.max_latency = latency;
+        }
+
+        if (NULL == result)
+        {
+            ++debug_method->stats.failures;
+        }
+
+        free(debug_method->result);
+        debug_method->result = result;
+        debug_method->result_time = finished;
+    }
+
+    pthread_cond_broadcast(&methods->done);
+    pthread_mutex_unlock(&methods->mutex);
+}
+
+
+
+char *debug_methods_invoke(T_debugMethods *methods, size_t index, T_arena *arena)
+{
+    assert(NULL != methods);
+    assert(NULL != arena);
+    assert(index < methods->count);
+
+    T_debugMethod *debug_method = methods->methods + index;
+    char *result = NULL;
+    int available = 0;
+    int wait = 0;
+
+    pthread_mutex_lock(&methods->mutex);
+    const uint64_t now = debug_methods_now();
+
+    if (NULL != debug_method->result && now - debug_method->result_time < methods->ttl)
+    {
+        ++debug_method->stats.cached;
+        available = 1;
+    }
+    else if (debug_method->pending)
+    {
+        /* Join the pending call unless it has already spent its budget */
+        wait = now - debug_method->pending_since < methods->timeout;
+    }
+    else if (0 != methods->timeout && 0 != methods->busy_since && now - methods->busy_since >= methods->timeout)
+    {
+        /* Another method has exceeded its budget and blocks the runner */
+        wait = 0;
+    }
+    else if (WORKER_POOL_QUEUED == worker_pool_submit(methods->runner, /*single thread*/0, debug_method))
+    {
+        debug_method->pending = 1;
+        debug_method->pending_since = now;
+        wait = 0 != methods->timeout;
+    }
+    else
+    {
+        pthread_mutex_unlock(&methods->mutex);
+        VERBOSE_PRINT("Debug methods are not running, skipping '%s'\n", debug_method->label);
+        return NULL;
+    }
+
+    if (wait)
+    {
+        const uint64_t remaining = debug_method->pending_since + methods->timeout - now;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += remaining / 1000000;
+        deadline.tv_nsec += (long)(remaining % 1000000) * 1000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            ++deadline.tv_sec;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        const size_t completed = debug_method->completed;
+        int error = 0;
+        while (completed == debug_method->completed && ETIMEDOUT != error)
+        {
+            error = pthread_cond_timedwait(&methods->done, &methods->mutex, &deadline);
+        }
+
+        available = completed != debug_method->completed;
+    }
+
+    if (!available)
+    {
+        ++debug_method->stats.timeouts;
+        VERBOSE_PRINT("Debug method '%s' did not return in time\n", debug_method->label);
+    }
+    else if (NULL != debug_method->result)
+    {
+        result = arena_strdup(arena, debug_method->result);
+    }
+    pthread_mutex_unlock(&methods->mutex);
+
+    return result;
+}
+
+
+
+void debug_methods_statistics(T_debugMethods *methods, size_t index, T_debugMethodStatistics *stats)
+{
+    assert(NULL != methods);
+    assert(index < methods->count);
+
+    pthread_mutex_lock(&methods->mutex);
+    *stats = methods->methods[index].stats;
+    pthread_mutex_unlock(&methods->mutex);
+}
+
+
+
+const char *debug_methods_class_name(T_debugMethods *methods, size_t index)
+{
+    assert(NULL != methods);
+    assert(index < methods->count);
+
+    return methods->methods[index].class_name;
+}
+
+
+
+/*
+ * finito
+ */
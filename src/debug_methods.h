@@ -0,0 +1,216 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __DEBUG_METHODS_H__
+#define __DEBUG_METHODS_H__
+
+
+
+/*
+ * JNI and JVMTI types
+ */
+#include <jni.h>
+#include <jvmti.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+
+
+/*
+ * An opaque structure representing configured debug methods
+ *
+ * A debug method is a static method returning java.lang.String whose result
+ * is attached to reports. The methods are configured by their fully qualified
+ * names (name.space.Class.method) which are parsed only once.
+ *
+ * A method is resolved when its class is prepared. The class is held by a
+ * weak global reference, so the method is forgotten when the class is
+ * unloaded and resolved again when a class of the same name is prepared.
+ *
+ * The methods are application code of unknown duration, hence they are called
+ * on a dedicated agent thread and callers wait for their results only for a
+ * limited time. A result can be reused for a configured time.
+ */
+typedef struct debug_methods T_debugMethods;
+
+
+
+/*
+ * Counters of a single debug method
+ */
+typedef struct {
+    const char *label;                ///< the configured FQDN
+    size_t calls;                     ///< finished calls
+    size_t failures;                  ///< calls which returned no string
+    size_t cached;                    ///< results reused from a previous call
+    size_t timeouts;                  ///< results not available in time
+    uint64_t total_latency;           ///< sum of durations of calls in microseconds
+    uint64_t max_latency;             ///< the longest call in microseconds
+} T_debugMethodStatistics;
+
+
+
+/*
+ * Parses the configured debug methods
+ *
+ * Names not in FQDN format are reported and skipped.
+ *
+ * @param fqdns NULL terminated array of fully qualified method names; must
+ *        live as long as the returned structure
+ * @param timeout Milliseconds to wait for a result of a single method
+ * @param ttl Milliseconds for which a result is reused, 0 means never
+ * @returns Mallocated structure on success; otherwise NULL
+ */
+T_debugMethods *debug_methods_new(const char *const *fqdns, int timeout, int ttl);
+
+
+
+/*
+ * Frees memory of the debug methods
+ *
+ * The methods must be stopped by @debug_methods_stop before. The methods
+ * are left allocated if a method did not return, because its worker still
+ * uses them.
+ *
+ * @param methods Freed methods. Can be NULL
+ * @param jni_env JNI environment used to delete the weak references. Can be
+ *        NULL if JVM is already gone.
+ */
+void debug_methods_free(T_debugMethods *methods, JNIEnv *jni_env);
+
+
+
+/*
+ * Returns number of valid debug methods
+ */
+size_t debug_methods_count(T_debugMethods *methods);
+
+
+
+/*
+ * Starts the agent thread calling the methods
+ *
+ * Agent threads can be started only in the live phase (i.e. in VMInit
+ * callback or later). The methods are not called until the thread is running.
+ *
+ * @param methods The methods
+ * @param jvmti_env JVMTI environment
+ * @param jni_env JNI environment of the current thread
+ * @returns 0 on success; otherwise non zero value
+ */
+int debug_methods_start(T_debugMethods *methods, jvmtiEnv *jvmti_env, JNIEnv *jni_env);
+
+
+
+/*
+ * Stops the agent thread
+ *
+ * Pending calls are abandoned. Cached results are still returned by
+ * @debug_methods_invoke.
+ *
+ * @param methods The methods. Can be NULL
+ * @param jvmti_env JVMTI environment
+ * @param jni_env JNI environment of the current thread
+ */
+void debug_methods_stop(T_debugMethods *methods, jvmtiEnv *jvmti_env, JNIEnv *jni_env);
+
+
+
+/*
+ * Resolves debug methods declared by a class
+ *
+ * Does not initialize the class, hence it can be called from ClassPrepare
+ * callback. Does nothing if the class does not declare any unresolved debug
+ * method.
+ *
+ * @param methods The methods
+ * @param jvmti_env JVMTI environment
+ * @param jni_env JNI environment of the current thread
+ * @param class_name Class name in the form returned by Class.getName()
+ * @param class The class
+ */
+void debug_methods_resolve(T_debugMethods *methods, jvmtiEnv *jvmti_env, JNIEnv *jni_env, const char *class_name, jclass class);
+
+
+
+/*
+ * Gets a debug method
+ *
+ * @param methods The methods
+ * @param jni_env JNI environment of the current thread
+ * @param index Index of the method in [0, debug_methods_count())
+ * @param label Filled with the configured name of the method
+ * @param class Filled with a new local reference to the class declaring the
+ *        method or NULL if the method is not resolved
+ * @param method Filled with ID of the method or NULL if the method is not
+ *        resolved
+ * @returns 0 if the method is resolved; otherwise non zero value
+ */
+int debug_methods_get(T_debugMethods *methods, JNIEnv *jni_env, size_t index, const char **label, jclass *class, jmethodID *method);
+
+
+
+/*
+ * Gets a result of a debug method
+ *
+ * Returns the cached result if it is younger than the configured TTL.
+ * Otherwise asks the agent thread to call the method and waits for the result
+ * at most the configured timeout. Concurrent callers share a single call and
+ * nobody waits for a method which has already exceeded its time budget.
+ *
+ * @param methods The methods
+ * @param index Index of the method in [0, debug_methods_count())
+ * @param arena Arena the result is allocated from
+ * @returns The result or NULL if the method has not returned a string in
+ *          time
+ */
+char *debug_methods_invoke(T_debugMethods *methods, size_t index, T_arena *arena);
+
+
+
+/*
+ * Gets counters of a debug method
+ *
+ * @param methods The methods
+ * @param index Index of the method in [0, debug_methods_count())
+ * @param stats Filled with the counters
+ */
+void debug_methods_statistics(T_debugMethods *methods, size_t index, T_debugMethodStatistics *stats);
+
+
+
+/*
+ * Returns a class name of an unresolved debug method
+ *
+ * @param methods The methods
+ * @param index Index of the method in [0, debug_methods_count())
+ * @returns Class name in the form returned by Class.getName()
+ */
+const char *debug_methods_class_name(T_debugMethods *methods, size_t index);
+
+
+
+#endif // __DEBUG_METHODS_H__
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,527 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "exception_matcher.h"
+#include "abrt-checker.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+
+
+/*
+ * Flags of trie nodes
+ */
+enum {
+    MATCH_EXACT   = 1 << 0, ///< a pattern naming exactly the node's class
+    MATCH_PACKAGE = 1 << 1, ///< a pattern matching everything below the node
+    MATCH_SUBTYPE = 1 << 2, ///< a pattern matching the node's class and its subclasses
+};
+
+
+
+struct exception_matcher_node;
+
+typedef struct exception_matcher_node {
+    char *segment;                           ///< name space or class name
+    size_t length;                           ///< length of the segment
+    int flags;                               ///< MATCH_* flags
+    size_t subtype;                          ///< index to subtypes if MATCH_SUBTYPE
+    struct exception_matcher_node *children; ///< the first child node
+    struct exception_matcher_node *next;     ///< a next node on the same level
+} T_exceptionMatcherNode;
+
+
+
+struct exception_matcher {
+    T_exceptionMatcherNode root;   ///< name space trie
+    jweak *subtypes;               ///< resolved base classes of subclass patterns
+    size_t subtypes_count;         ///< number of subclass patterns
+    int released;                  ///< the weak references were deleted
+    pthread_mutex_t mutex;         ///< guards subtypes and released
+};
+
+
+
+static inline int is_separator(char c)
+{
+    return c == '.' || c == '/';
+}
+
+
+
+static inline int is_terminator(char c)
+{
+    return c == '\0' || c == ';';
+}
+
+
+
+/*
+ * Returns length of the segment beginning at @name
+ */
+static size_t segment_length(const char *name)
+{
+    size_t len = 0;
+    while (!is_separator(name[len]) && !is_terminator(name[len]))
+    {
+        ++len;
+    }
+
+    return len;
+}
+
+
+
+static T_exceptionMatcherNode *exception_matcher_node_find_child(const T_exceptionMatcherNode *node, const char *segment, size_t length)
+{
+    for (T_exceptionMatcherNode *child = node->children; NULL != child; child = child->next)
+    {
+        if (child->length == length && strncmp(child->segment, segment, length) == 0)
+        {
+            return child;
+        }
+    }
+
+    return NULL;
+}
+
+
+
+static T_exceptionMatcherNode *exception_matcher_node_add_child(T_exceptionMatcherNode *node, const char *segment, size_t length)
+{
+    T_exceptionMatcherNode *child = exception_matcher_node_find_child(node, segment, length);
+    if (NULL != child)
+    {
+        return child;
+    }
+
+    child = (T_exceptionMatcherNode *)calloc(1, sizeof(*child));
+    if (NULL == child)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    child->segment = strndup(segment, length);
+    if (NULL == child->segment)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": strndup(): out of memory\n");
+        free(child);
+        return NULL;
+    }
+
+    child->length = length;
+    child->next = node->children;
+    node->children = child;
+    return child;
+}
+
+
+
+static void exception_matcher_node_free_children(T_exceptionMatcherNode *node)
+{
+    T_exceptionMatcherNode *child = node->children;
+    while (NULL != child)
+    {
+        T_exceptionMatcherNode *next = child->next;
+        exception_matcher_node_free_children(child);
+        free(child->segment);
+        free(child);
+        child = next;
+    }
+
+    node->children = NULL;
+}
+
+
+
+/*
+ * Inserts first @length characters of @name into the trie and returns the
+ * node of the last segment
+ */
+static T_exceptionMatcherNode *exception_matcher_insert(T_exceptionMatcher *matcher, const char *name, size_t length)
+{
+    T_exceptionMatcherNode *node = &(matcher->root);
+    const char *const end = name + length;
+
+    while (name < end && NULL != node)
+    {
+        size_t seglen = segment_length(name);
+        if (name + seglen > end)
+        {
+            seglen = end - name;
+        }
+
+        if (0 != seglen)
+        {
+            node = exception_matcher_node_add_child(node, name, seglen);
+        }
+
+        name += seglen;
+        if (name < end && is_separator(*name))
+        {
+            ++name;
+        }
+    }
+
+    return node;
+}
+
+
+
+T_exceptionMatcher *exception_matcher_new(const char *const *patterns)
+{
+    T_exceptionMatcher *matcher = (T_exceptionMatcher *)calloc(1, sizeof(*matcher));
+    if (NULL == matcher)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    pthread_mutex_init(&matcher->mutex, /*use default attributes*/NULL);
+
+    size_t subtypes_count = 0;
+    for (const char *const *iter = patterns; NULL != iter && NULL != *iter; ++iter)
+    {
+        const size_t len = strlen(*iter);
+        if (len > 1 && (*iter)[len - 1] == '+')
+        {
+            ++subtypes_count;
+        }
+    }
+
+    if (0 != subtypes_count)
+    {
+        matcher->subtypes = (jweak *)calloc(subtypes_count, sizeof(*matcher->subtypes));
+        if (NULL == matcher->subtypes)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+            exception_matcher_free(matcher, /*nothing resolved*/NULL);
+            return NULL;
+        }
+    }
+
+    for (const char *const *iter = patterns; NULL != iter && NULL != *iter; ++iter)
+    {
+        const char *pattern = *iter;
+        size_t len = strlen(pattern);
+        int flag = MATCH_EXACT;
+
+        if (len == 0)
+        {
+            continue;
+        }
+        else if (strcmp(pattern, "*") == 0)
+        {
+            len = 0;
+            flag = MATCH_PACKAGE;
+        }
+        else if (len > 2 && pattern[len - 1] == '*' && is_separator(pattern[len - 2]))
+        {
+            len -= 2;
+            flag = MATCH_PACKAGE;
+        }
+        else if (len > 1 && pattern[len - 1] == '+')
+        {
+            len -= 1;
+            flag = MATCH_SUBTYPE;
+        }
+
+        T_exceptionMatcherNode *node = exception_matcher_insert(matcher, pattern, len);
+        if (NULL == node)
+        {
+            fprintf(stderr, "Cannot compile exception type pattern '%s'\n", pattern);
+            continue;
+        }
+
+        if (MATCH_SUBTYPE == flag && !(node->flags & MATCH_SUBTYPE))
+        {
+            node->subtype = matcher->subtypes_count++;
+        }
+
+        node->flags |= flag;
+        VERBOSE_PRINT("Compiled exception type pattern '%s'\n", pattern);
+    }
+
+    return matcher;
+}
+
+
+
+void exception_matcher_release_classes(T_exceptionMatcher *matcher, JNIEnv *jni_env)
+{
+    if (NULL == matcher)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&matcher->mutex);
+    for (size_t i = 0; i < matcher->subtypes_count; ++i)
+    {
+        if (NULL != matcher->subtypes[i])
+        {
+            (*jni_env)->DeleteWeakGlobalRef(jni_env, matcher->subtypes[i]);
+            matcher->subtypes[i] = NULL;
+        }
+    }
+    matcher->released = 1;
+    pthread_mutex_unlock(&matcher->mutex);
+}
+
+
+
+void exception_matcher_free(T_exceptionMatcher *matcher, JNIEnv *jni_env)
+{
+    if (NULL == matcher)
+    {
+        return;
+    }
+
+    if (NULL != jni_env)
+    {
+        exception_matcher_release_classes(matcher, jni_env);
+    }
+
+    exception_matcher_node_free_children(&matcher->root);
+    pthread_mutex_destroy(&matcher->mutex);
+    free(matcher->subtypes);
+    free(matcher);
+}
+
+
+
+/*
+ * Walks the trie along the segments of @class_name
+ *
+ * @returns The node of the last segment or NULL if there is no such node
+ */
+static const T_exceptionMatcherNode *exception_matcher_lookup(
+        T_exceptionMatcher *matcher,
+        const char *class_name,
+        int *package_match)
+{
+    const T_exceptionMatcherNode *node = &(matcher->root);
+
+    /* Lname/space/Class; */
+    if (class_name[0] == 'L' && NULL != strchr(class_name, ';'))
+    {
+        ++class_name;
+    }
+
+    *package_match = 0;
+    while (!is_terminator(*class_name))
+    {
+        if (node->flags & MATCH_PACKAGE)
+        {
+            *package_match = 1;
+        }
+
+        const size_t seglen = segment_length(class_name);
+        node = exception_matcher_node_find_child(node, class_name, seglen);
+        if (NULL == node)
+        {
+            return NULL;
+        }
+
+        class_name += seglen;
+        if (is_separator(*class_name))
+        {
+            ++class_name;
+        }
+    }
+
+    return node;
+}
+
+
+
+int exception_matcher_match_name(T_exceptionMatcher *matcher, const char *class_name)
+{
+    assert(NULL != matcher || !"Cannot match against NULL matcher");
+
+    int package_match = 0;
+    const T_exceptionMatcherNode *node = exception_matcher_lookup(matcher, class_name, &package_match);
+
+    return package_match || (NULL != node && (node->flags & (MATCH_EXACT | MATCH_SUBTYPE)));
+}
+
+
+
+/*
+ * Checks the resolved base classes by IsAssignableFrom()
+ *
+ * A class which is not a subclass of a resolved base class defined by its own
+ * class loader cannot be a subclass of a base class of the same name, so its
+ * super classes need to be walked only if a base class is not resolved yet or
+ * is defined by another class loader.
+ *
+ * @param unsure Set to non zero value if the super classes must be walked
+ * @returns 1 if the class is a subclass of a resolved base class; otherwise 0
+ */
+static int exception_matcher_check_resolved(T_exceptionMatcher *matcher, jvmtiEnv *jvmti_env, JNIEnv *jni_env, jclass class, int *unsure)
+{
+    int retval = 0;
+    jobject loader = NULL;
+    const jvmtiError loader_error = (*jvmti_env)->GetClassLoader(jvmti_env, class, &loader);
+
+    *unsure = 0;
+    for (size_t i = 0; i < matcher->subtypes_count; ++i)
+    {
+        pthread_mutex_lock(&matcher->mutex);
+        jweak base = matcher->subtypes[i];
+        jclass base_class = NULL;
+        if (NULL != base)
+        {
+            base_class = (jclass)(*jni_env)->NewLocalRef(jni_env, base);
+            if (NULL == base_class)
+            {
+                /* The base class was unloaded */
+                (*jni_env)->DeleteWeakGlobalRef(jni_env, base);
+                matcher->subtypes[i] = NULL;
+            }
+        }
+        pthread_mutex_unlock(&matcher->mutex);
+
+        if (NULL == base_class)
+        {
+            *unsure = 1;
+            continue;
+        }
+
+        if ((*jni_env)->IsAssignableFrom(jni_env, class, base_class))
+        {
+            (*jni_env)->DeleteLocalRef(jni_env, base_class);
+            retval = 1;
+            break;
+        }
+
+        if (!*unsure)
+        {
+            jobject base_loader = NULL;
+            const jvmtiError error_code = (*jvmti_env)->GetClassLoader(jvmti_env, base_class, &base_loader);
+            /* NULL is the bootstrap class loader */
+            if (JVMTI_ERROR_NONE != loader_error || JVMTI_ERROR_NONE != error_code
+                    || !(*jni_env)->IsSameObject(jni_env, loader, base_loader))
+            {
+                *unsure = 1;
+            }
+
+            if (NULL != base_loader)
+            {
+                (*jni_env)->DeleteLocalRef(jni_env, base_loader);
+            }
+        }
+
+        (*jni_env)->DeleteLocalRef(jni_env, base_class);
+    }
+
+    if (NULL != loader)
+    {
+        (*jni_env)->DeleteLocalRef(jni_env, loader);
+    }
+
+    return retval;
+}
+
+
+
+/*
+ * Walks the super classes of @class and compares their names to the base
+ * classes of the subclass patterns. Resolves the matched base classes.
+ */
+static int exception_matcher_check_super_classes(T_exceptionMatcher *matcher, jvmtiEnv *jvmti_env, JNIEnv *jni_env, jclass class)
+{
+    int retval = 0;
+    jclass super_class = (*jni_env)->GetSuperclass(jni_env, class);
+
+    while (NULL != super_class && 0 == retval)
+    {
+        char *signature = NULL;
+        jvmtiError error_code = (*jvmti_env)->GetClassSignature(jvmti_env, super_class, &signature, NULL);
+        if (JVMTI_ERROR_NONE == error_code && NULL != signature)
+        {
+            int package_match = 0;
+            const T_exceptionMatcherNode *node = exception_matcher_lookup(matcher, signature, &package_match);
+            if (NULL != node && (node->flags & MATCH_SUBTYPE))
+            {
+                VERBOSE_PRINT("Resolved base exception class %s\n", signature);
+                retval = 1;
+
+                pthread_mutex_lock(&matcher->mutex);
+                if (!matcher->released && NULL == matcher->subtypes[node->subtype])
+                {
+                    matcher->subtypes[node->subtype] = (*jni_env)->NewWeakGlobalRef(jni_env, super_class);
+                }
+                pthread_mutex_unlock(&matcher->mutex);
+            }
+
+            (*jvmti_env)->Deallocate(jvmti_env, (unsigned char *)signature);
+        }
+
+        jclass next = (*jni_env)->GetSuperclass(jni_env, super_class);
+        (*jni_env)->DeleteLocalRef(jni_env, super_class);
+        super_class = next;
+    }
+
+    if (NULL != super_class)
+    {
+        (*jni_env)->DeleteLocalRef(jni_env, super_class);
+    }
+
+    return retval;
+}
+
+
+
+int exception_matcher_match_class(T_exceptionMatcher *matcher, jvmtiEnv *jvmti_env, JNIEnv *jni_env, jclass class, const char *class_name)
+{
+    assert(NULL != matcher || !"Cannot match against NULL matcher");
+
+    if (exception_matcher_match_name(matcher, class_name))
+    {
+        return 1;
+    }
+
+    if (0 == matcher->subtypes_count)
+    {
+        return 0;
+    }
+
+    int unsure = 0;
+    if (exception_matcher_check_resolved(matcher, jvmti_env, jni_env, class, &unsure))
+    {
+        return 1;
+    }
+
+    /* Only one class of each base class name is resolved but other class
+     * loaders can define classes of the same name */
+    if (!unsure)
+    {
+        return 0;
+    }
+
+    return exception_matcher_check_super_classes(matcher, jvmti_env, jni_env, class);
+}
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,121 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __EXCEPTION_MATCHER_H__
+#define __EXCEPTION_MATCHER_H__
+
+
+
+/*
+ * JNI and JVMTI types
+ */
+#include <jni.h>
+#include <jvmti.h>
+
+
+
+/*
+ * An opaque structure representing a compiled list of exception type patterns.
+ *
+ * Supported patterns:
+ *   name.space.Class   - the class itself
+ *   name.space.*       - all classes in the name space and its sub name spaces
+ *   name.space.Class+  - the class and all its subclasses
+ *   *                  - all classes
+ */
+typedef struct exception_matcher T_exceptionMatcher;
+
+
+
+/*
+ * Compiles a NULL terminated list of patterns into a new matcher
+ *
+ * Result must be released by @exception_matcher_free
+ *
+ * @param patterns NULL terminated list of patterns
+ * @returns Mallocated matcher on success; otherwise NULL
+ */
+T_exceptionMatcher *exception_matcher_new(const char *const *patterns);
+
+
+
+/*
+ * Deletes weak references to the resolved base classes
+ *
+ * The matcher stays usable but doesn't resolve base classes anymore.
+ *
+ * @param matcher The matcher. Can be NULL
+ * @param jni_env JNI environment used to delete the weak references
+ */
+void exception_matcher_release_classes(T_exceptionMatcher *matcher, JNIEnv *jni_env);
+
+
+
+/*
+ * Frees matcher's memory
+ *
+ * @param matcher A freed matcher. Can be NULL
+ * @param jni_env JNI environment used to delete the weak references. Can be
+ *        NULL if JVM is already gone.
+ */
+void exception_matcher_free(T_exceptionMatcher *matcher, JNIEnv *jni_env);
+
+
+
+/*
+ * Checks whether a class name matches any pattern
+ *
+ * Both '.' and '/' are accepted as name space separators and a JVM class
+ * signature (Lname/space/Class;) is accepted too. The subclass patterns match
+ * only their base class here.
+ *
+ * @param matcher The matcher
+ * @param class_name The tested class name
+ * @returns Non zero value if the class name matches; otherwise 0
+ */
+int exception_matcher_match_name(T_exceptionMatcher *matcher, const char *class_name);
+
+
+
+/*
+ * Checks whether a class matches any pattern including the subclass patterns
+ *
+ * The base classes of the subclass patterns are resolved from the super
+ * classes of the tested classes and the resolved ones are checked by
+ * IsAssignableFrom(). Classes which are not subclasses of the resolved base
+ * classes are matched by names of their super classes only if their class
+ * loader differs from the loader of a resolved base class, because base
+ * classes of the same name can be defined by several class loaders.
+ *
+ * @param matcher The matcher
+ * @param jvmti_env JVMTI environment
+ * @param jni_env JNI environment of the current thread
+ * @param class The tested class
+ * @param class_name Name of the tested class
+ * @returns Non zero value if the class matches; otherwise 0
+ */
+int exception_matcher_match_class(T_exceptionMatcher *matcher, jvmtiEnv *jvmti_env, JNIEnv *jni_env, jclass class, const char *class_name);
+
+
+
+#endif // __EXCEPTION_MATCHER_H__
+
+
+
+/*
+ * finito
+ */
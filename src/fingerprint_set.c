@@ -0,0 +1,352 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "fingerprint_set.h"
+#include "abrt-checker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+
+
+
+/*
+ * Number of slots where a fingerprint can be stored
+ */
+#ifndef FINGERPRINT_SET_PROBE_LENGTH
+#define FINGERPRINT_SET_PROBE_LENGTH 8
+#endif
+
+/* Marks recently used entries; the remaining bits hold the fingerprint */
+#define FINGERPRINT_REFERENCED_BIT (1ULL << 63)
+
+/* Value of an empty slot */
+#define FINGERPRINT_EMPTY 0ULL
+
+
+
+struct fingerprint_set {
+    size_t mask;          ///< number of slots - 1
+    size_t hits;          ///< number of found fingerprints
+    size_t evictions;     ///< number of evicted fingerprints
+    uint64_t *slots;      ///< fingerprints with the referenced bit
+    unsigned ttl;         ///< seconds a fingerprint is valid for, 0 means forever
+    uint32_t *inserted;   ///< insertion times of slots' fingerprints in seconds,
+                          ///< NULL if fingerprints never expire
+    uint32_t *duplicates; ///< lookups of slots' fingerprints since the insertion,
+                          ///< NULL if fingerprints never expire
+};
+
+
+
+T_fingerprintSet *fingerprint_set_new(size_t capacity, unsigned ttl)
+{
+    assert(0 != capacity || !"Cannot create a set with zero capacity");
+
+    size_t slots = FINGERPRINT_SET_PROBE_LENGTH;
+    while (slots < capacity)
+    {
+        slots <<= 1;
+    }
+
+    T_fingerprintSet *set = (T_fingerprintSet *)calloc(1, sizeof(*set));
+    if (NULL == set)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    set->slots = (uint64_t *)calloc(slots, sizeof(*set->slots));
+    if (NULL == set->slots)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        free(set);
+        return NULL;
+    }
+
+    if (0 != ttl)
+    {
+        set->inserted = (uint32_t *)calloc(slots, sizeof(*set->inserted));
+        set->duplicates = (uint32_t *)calloc(slots, sizeof(*set->duplicates));
+        if (NULL == set->inserted || NULL == set->duplicates)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+            fingerprint_set_free(set);
+            return NULL;
+        }
+    }
+
+    set->mask = slots - 1;
+    set->ttl = ttl;
+    return set;
+}
+
+
+
+void fingerprint_set_free(T_fingerprintSet *set)
+{
+    if (NULL == set)
+    {
+        return;
+    }
+
+    free(set->duplicates);
+    free(set->inserted);
+    free(set->slots);
+    free(set);
+}
+
+
+
+/*
+ * Strips the referenced bit and avoids the value of empty slots
+ */
+static uint64_t fingerprint_set_key(uint64_t fingerprint)
+{
+    fingerprint &= ~FINGERPRINT_REFERENCED_BIT;
+    return FINGERPRINT_EMPTY == fingerprint ? 1 : fingerprint;
+}
+
+
+
+/*
+ * Returns the first slot of fingerprint's probe sequence
+ */
+static size_t fingerprint_set_start(T_fingerprintSet *set, uint64_t key)
+{
+    /* fingerprints are hashes, but mix the high bits in anyway */
+    return (size_t)(key ^ (key >> 32)) & set->mask;
+}
+
+
+
+/*
+ * Monotonic time in seconds, wraps around
+ */
+static uint32_t fingerprint_set_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec;
+}
+
+
+
+/*
+ * Checks whether the fingerprint stored in the slot has expired
+ *
+ * @param inserted Filled with the insertion time of the fingerprint
+ */
+static int fingerprint_set_expired(T_fingerprintSet *set, const uint64_t *slot, uint32_t *inserted)
+{
+    if (0 == set->ttl)
+    {
+        return 0;
+    }
+
+    *inserted = __sync_fetch_and_add(set->inserted + (slot - set->slots), 0);
+    return fingerprint_set_now() - *inserted >= set->ttl;
+}
+
+
+
+/*
+ * Prepares the slot for a new fingerprint. The times and counters of slots
+ * are updated apart from the fingerprints, hence they are only approximate
+ * when several threads insert into the same slot.
+ */
+static void fingerprint_set_reset(T_fingerprintSet *set, const uint64_t *slot)
+{
+    if (0 != set->ttl)
+    {
+        const size_t index = (size_t)(slot - set->slots);
+        __sync_lock_test_and_set(set->inserted + index, fingerprint_set_now());
+        __sync_lock_test_and_set(set->duplicates + index, 0);
+    }
+}
+
+
+
+/*
+ * Finds the key in its probe sequence
+ *
+ * @param found The slot of the key if the key was found
+ * @param empty The first empty slot of the sequence if the key was not found
+ */
+static int fingerprint_set_find(T_fingerprintSet *set, uint64_t key, uint64_t **found, uint64_t **empty)
+{
+    *found = NULL;
+    *empty = NULL;
+
+    const size_t start = fingerprint_set_start(set, key);
+    for (size_t i = 0; i < FINGERPRINT_SET_PROBE_LENGTH; ++i)
+    {
+        uint64_t *slot = set->slots + ((start + i) & set->mask);
+        const uint64_t value = __sync_fetch_and_add(slot, 0);
+
+        if (FINGERPRINT_EMPTY == value)
+        {   /* slots are never emptied, the key cannot be farther */
+            *empty = slot;
+            return 0;
+        }
+
+        if (key == (value & ~FINGERPRINT_REFERENCED_BIT))
+        {
+            *found = slot;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+/*
+ * Marks the found fingerprint as recently used and counts the duplicate
+ */
+static void fingerprint_set_hit(T_fingerprintSet *set, uint64_t *slot)
+{
+    const uint64_t value = __sync_fetch_and_add(slot, 0);
+    if (!(value & FINGERPRINT_REFERENCED_BIT))
+    {   /* losing the race against a concurrent update is harmless */
+        __sync_bool_compare_and_swap(slot, value, value | FINGERPRINT_REFERENCED_BIT);
+    }
+
+    if (0 != set->ttl)
+    {
+        __sync_fetch_and_add(set->duplicates + (slot - set->slots), 1);
+    }
+
+    __sync_fetch_and_add(&set->hits, 1);
+}
+
+
+
+int fingerprint_set_contains(T_fingerprintSet *set, uint64_t fingerprint)
+{
+    uint64_t *found = NULL;
+    uint64_t *empty = NULL;
+    uint32_t inserted = 0;
+
+    if (!fingerprint_set_find(set, fingerprint_set_key(fingerprint), &found, &empty)
+        || fingerprint_set_expired(set, found, &inserted))
+    {
+        return 0;
+    }
+
+    fingerprint_set_hit(set, found);
+    return 1;
+}
+
+
+
+int fingerprint_set_insert(T_fingerprintSet *set, uint64_t fingerprint, size_t *duplicates)
+{
+    const uint64_t key = fingerprint_set_key(fingerprint);
+    const size_t start = fingerprint_set_start(set, key);
+
+    for (;;)
+    {
+        uint64_t *found = NULL;
+        uint64_t *empty = NULL;
+        if (fingerprint_set_find(set, key, &found, &empty))
+        {
+            uint32_t inserted = 0;
+            if (!fingerprint_set_expired(set, found, &inserted))
+            {
+                fingerprint_set_hit(set, found);
+                return 0;
+            }
+
+            /* Only one of concurrent insertions renews the fingerprint */
+            const size_t index = (size_t)(found - set->slots);
+            if (__sync_bool_compare_and_swap(set->inserted + index, inserted, fingerprint_set_now()))
+            {
+                const uint32_t renewed = __sync_lock_test_and_set(set->duplicates + index, 0);
+                if (NULL != duplicates)
+                {
+                    *duplicates = renewed;
+                }
+                return 1;
+            }
+
+            continue;
+        }
+
+        if (NULL != empty)
+        {
+            fingerprint_set_reset(set, empty);
+            if (__sync_bool_compare_and_swap(empty, FINGERPRINT_EMPTY, key))
+            {
+                if (NULL != duplicates)
+                {
+                    *duplicates = 0;
+                }
+                return 1;
+            }
+
+            /* Taken by a concurrent insertion, maybe of the same key */
+            continue;
+        }
+
+        /* Evict the first slot without the second chance. The referenced
+         * bits are cleared on the way, hence the second pass always finds a
+         * victim unless other threads race. */
+        for (size_t i = 0; i < 2 * FINGERPRINT_SET_PROBE_LENGTH; ++i)
+        {
+            uint64_t *slot = set->slots + ((start + i % FINGERPRINT_SET_PROBE_LENGTH) & set->mask);
+            const uint64_t value = __sync_fetch_and_add(slot, 0);
+
+            if (value & FINGERPRINT_REFERENCED_BIT)
+            {
+                __sync_bool_compare_and_swap(slot, value, value & ~FINGERPRINT_REFERENCED_BIT);
+                continue;
+            }
+
+            fingerprint_set_reset(set, slot);
+            if (__sync_bool_compare_and_swap(slot, value, key))
+            {
+                __sync_fetch_and_add(&set->evictions, 1);
+                if (NULL != duplicates)
+                {
+                    *duplicates = 0;
+                }
+                return 1;
+            }
+
+            /* The slot has been changed, maybe by an insertion of the same
+             * key. Start over. */
+            break;
+        }
+    }
+}
+
+
+
+void fingerprint_set_statistics(T_fingerprintSet *set, size_t *hits, size_t *evictions)
+{
+    *hits = __sync_fetch_and_add(&set->hits, 0);
+    *evictions = __sync_fetch_and_add(&set->evictions, 0);
+}
+
+
+
+/*
+ * finito
+ */
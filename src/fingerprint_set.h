@@ -0,0 +1,111 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __FINGERPRINT_SET_H__
+#define __FINGERPRINT_SET_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+/*
+ * An opaque structure representing a bounded set of 64-bit fingerprints
+ *
+ * The set is an open addressing table with a short probe sequence. Lookups
+ * and insertions are lock free and take constant time. When the probe
+ * sequence of a new fingerprint is full, one of its entries is evicted by
+ * the CLOCK (second chance) algorithm, so recently looked up fingerprints
+ * survive longer.
+ *
+ * Fingerprints can expire. An expired fingerprint is not contained in the
+ * set and its insertion renews it. The set counts the lookups of each
+ * fingerprint, so the renewal tells how many duplicates were found while the
+ * fingerprint was valid.
+ *
+ * The highest bit of fingerprints is ignored.
+ */
+typedef struct fingerprint_set T_fingerprintSet;
+
+
+
+/*
+ * Creates a new empty set
+ *
+ * @param capacity Maximal number of fingerprints, rounded up to a power of 2
+ * @param ttl Number of seconds a fingerprint is valid for, 0 means forever
+ * @returns Mallocated set on success; otherwise NULL
+ */
+T_fingerprintSet *fingerprint_set_new(size_t capacity, unsigned ttl);
+
+
+
+/*
+ * Frees set's memory
+ *
+ * @param set A freed set. Can be NULL
+ */
+void fingerprint_set_free(T_fingerprintSet *set);
+
+
+
+/*
+ * Checks whether the set contains a valid fingerprint
+ *
+ * A found fingerprint is counted as a duplicate.
+ *
+ * @param set The set
+ * @param fingerprint The searched fingerprint
+ * @returns Non zero value if the fingerprint was found; otherwise 0
+ */
+int fingerprint_set_contains(T_fingerprintSet *set, uint64_t fingerprint);
+
+
+
+/*
+ * Adds a fingerprint to the set or renews an expired one
+ *
+ * @param set The set
+ * @param fingerprint The added fingerprint
+ * @param duplicates Number of duplicates found while the renewed fingerprint
+ *        was valid, 0 for new fingerprints. Filled only if the fingerprint
+ *        was added. Can be NULL
+ * @returns Non zero value if the fingerprint was added; 0 if the set already
+ * contains the valid fingerprint
+ */
+int fingerprint_set_insert(T_fingerprintSet *set, uint64_t fingerprint, size_t *duplicates);
+
+
+
+/*
+ * Gets counters of the set
+ *
+ * @param set The set
+ * @param hits Number of found fingerprints
+ * @param evictions Number of fingerprints evicted to make space for new ones
+ */
+void fingerprint_set_statistics(T_fingerprintSet *set, size_t *hits, size_t *evictions);
+
+
+
+#endif // __FINGERPRINT_SET_H__
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,346 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "frame_cache.h"
+#include "abrt-checker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+
+
+/*
+ * Number of hash table buckets per kilobyte of the memory limit
+ */
+#define FRAME_CACHE_BUCKETS_PER_KB 8
+
+
+
+typedef struct frame {
+    struct frame *chain;              ///< next entry in the same bucket
+    struct frame *newer;              ///< more recently used entry
+    struct frame *older;              ///< less recently used entry
+    const void *method;               ///< method ID
+    int64_t location;                 ///< location in the method
+    uint64_t loader;                  ///< ID of the class loader
+    size_t length;                    ///< length of text
+    char text[];                      ///< formatted frame
+} T_frame;
+
+
+
+struct frame_cache {
+    pthread_mutex_t mutex;            ///< guards all members below
+    T_frame **buckets;                ///< hash table of entries
+    size_t mask;                      ///< number of buckets - 1
+    size_t memory_limit;              ///< maximal memory used by entries
+    size_t memory;                    ///< memory used by entries
+    T_frame lru;                      ///< sentinel of the ring ordered by use;
+                                      ///< lru.older is the most recently used
+                                      ///< entry and lru.newer the least one
+    size_t hits;                      ///< number of successful lookups
+    size_t misses;                    ///< number of failed lookups
+};
+
+
+
+static size_t frame_cache_bucket(const T_frameCache *cache, const void *method, int64_t location)
+{
+    uint64_t h = (uint64_t)(uintptr_t)method ^ ((uint64_t)location * UINT64_C(0x9E3779B97F4A7C15));
+    h ^= h >> 29;
+    h *= UINT64_C(0xbf58476d1ce4e5b9);
+    h ^= h >> 32;
+    return (size_t)h & cache->mask;
+}
+
+
+
+static size_t frame_size(size_t length)
+{
+    return sizeof(T_frame) + length + 1;
+}
+
+
+
+T_frameCache *frame_cache_new(size_t memory_limit)
+{
+    T_frameCache *cache = (T_frameCache *)calloc(1, sizeof(*cache));
+    if (NULL == cache)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    size_t buckets = 1;
+    while (buckets < memory_limit / 1024 * FRAME_CACHE_BUCKETS_PER_KB)
+    {
+        buckets <<= 1;
+    }
+
+    cache->buckets = (T_frame **)calloc(buckets, sizeof(*cache->buckets));
+    if (NULL == cache->buckets)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        free(cache);
+        return NULL;
+    }
+
+    cache->mask = buckets - 1;
+    cache->memory_limit = memory_limit;
+    cache->lru.newer = &cache->lru;
+    cache->lru.older = &cache->lru;
+    pthread_mutex_init(&cache->mutex, /*use default attributes*/NULL);
+
+    return cache;
+}
+
+
+
+void frame_cache_free(T_frameCache *cache)
+{
+    if (NULL == cache)
+    {
+        return;
+    }
+
+    T_frame *entry = cache->lru.older;
+    while (&cache->lru != entry)
+    {
+        T_frame *next = entry->older;
+        free(entry);
+        entry = next;
+    }
+
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache->buckets);
+    free(cache);
+}
+
+
+
+/*
+ * Unlinks an entry from the list ordered by use. Must be called with locked
+ * cache's mutex.
+ */
+static void frame_cache_unlink(T_frame *entry)
+{
+    entry->newer->older = entry->older;
+    entry->older->newer = entry->newer;
+}
+
+
+
+/*
+ * Makes an entry the most recently used. Must be called with locked cache's
+ * mutex.
+ */
+static void frame_cache_link_newest(T_frameCache *cache, T_frame *entry)
+{
+    entry->older = cache->lru.older;
+    entry->newer = &cache->lru;
+    cache->lru.older->newer = entry;
+    cache->lru.older = entry;
+}
+
+
+
+/*
+ * Removes an entry from the cache and frees it. Must be called with locked
+ * cache's mutex.
+ */
+static void frame_cache_remove(T_frameCache *cache, T_frame *entry)
+{
+    T_frame **link = cache->buckets + frame_cache_bucket(cache, entry->method, entry->location);
+    while (*link != entry)
+    {
+        link = &((*link)->chain);
+    }
+
+    *link = entry->chain;
+    frame_cache_unlink(entry);
+    cache->memory -= frame_size(entry->length);
+    free(entry);
+}
+
+
+
+/*
+ * Must be called with locked cache's mutex.
+ */
+static T_frame *frame_cache_find(T_frameCache *cache, const void *method, int64_t location)
+{
+    for (T_frame *entry = cache->buckets[frame_cache_bucket(cache, method, location)]; NULL != entry; entry = entry->chain)
+    {
+        if (entry->method == method && entry->location == location)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+
+
+size_t frame_cache_get(T_frameCache *cache, const void *method, int64_t location, char *buffer, size_t size)
+{
+    assert(NULL != cache);
+
+    size_t length = 0;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    T_frame *entry = frame_cache_find(cache, method, location);
+    if (NULL == entry)
+    {
+        ++cache->misses;
+    }
+    else
+    {
+        ++cache->hits;
+        length = entry->length;
+        if (length < size)
+        {
+            memcpy(buffer, entry->text, length + 1);
+        }
+
+        frame_cache_unlink(entry);
+        frame_cache_link_newest(cache, entry);
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    return length;
+}
+
+
+
+void frame_cache_put(T_frameCache *cache, const void *method, int64_t location, uint64_t loader, const char *frame)
+{
+    assert(NULL != cache);
+    assert(NULL != frame && '\0' != frame[0]);
+
+    const size_t length = strlen(frame);
+    if (frame_size(length) > cache->memory_limit)
+    {
+        return;
+    }
+
+    /* Allocate the entry before locking the mutex */
+    T_frame *entry = (T_frame *)malloc(frame_size(length));
+    if (NULL == entry)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory\n");
+        return;
+    }
+
+    entry->method = method;
+    entry->location = location;
+    entry->loader = loader;
+    entry->length = length;
+    memcpy(entry->text, frame, length + 1);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    /* Another thread might have formatted the same frame in the meantime */
+    if (NULL != frame_cache_find(cache, method, location))
+    {
+        pthread_mutex_unlock(&cache->mutex);
+        free(entry);
+        return;
+    }
+
+    while (cache->memory + frame_size(length) > cache->memory_limit)
+    {
+        frame_cache_remove(cache, cache->lru.newer);
+    }
+
+    T_frame **bucket = cache->buckets + frame_cache_bucket(cache, method, location);
+    entry->chain = *bucket;
+    *bucket = entry;
+    frame_cache_link_newest(cache, entry);
+    cache->memory += frame_size(length);
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+void frame_cache_invalidate_loader(T_frameCache *cache, uint64_t loader)
+{
+    assert(NULL != cache);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    T_frame *entry = cache->lru.older;
+    while (&cache->lru != entry)
+    {
+        T_frame *next = entry->older;
+        if (entry->loader == loader)
+        {
+            frame_cache_remove(cache, entry);
+        }
+        entry = next;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+void frame_cache_invalidate_method(T_frameCache *cache, const void *method)
+{
+    assert(NULL != cache);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    /* Frames are keyed by location too, hence all entries are visited */
+    T_frame *entry = cache->lru.older;
+    while (&cache->lru != entry)
+    {
+        T_frame *next = entry->older;
+        if (entry->method == method)
+        {
+            frame_cache_remove(cache, entry);
+        }
+        entry = next;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+void frame_cache_statistics(T_frameCache *cache, size_t *hits, size_t *misses, size_t *memory)
+{
+    assert(NULL != cache);
+
+    pthread_mutex_lock(&cache->mutex);
+    *hits = cache->hits;
+    *misses = cache->misses;
+    *memory = cache->memory;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+/*
+ * finito
+ */
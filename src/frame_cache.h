@@ -0,0 +1,130 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __FRAME_CACHE_H__
+#define __FRAME_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+/*
+ * An opaque structure caching formatted stack trace frames
+ *
+ * A frame is identified by a method ID and a location in the method. The
+ * formatted text of a frame includes the location of the class, hence it
+ * is valid as long as the class is loaded. Frames of a class loader are
+ * invalidated by @frame_cache_invalidate_loader.
+ *
+ * The cache is limited by the memory used by its entries. The least
+ * recently used entries are evicted first.
+ */
+typedef struct frame_cache T_frameCache;
+
+
+
+/*
+ * Creates a new empty cache
+ *
+ * @param memory_limit Maximal number of bytes used by cached frames
+ * @returns Mallocated cache on success; otherwise NULL
+ */
+T_frameCache *frame_cache_new(size_t memory_limit);
+
+
+
+/*
+ * Frees cache's memory
+ *
+ * @param cache A freed cache. Can be NULL
+ */
+void frame_cache_free(T_frameCache *cache);
+
+
+
+/*
+ * Copies a formatted frame
+ *
+ * @param cache The cache
+ * @param method Method ID (jmethodID)
+ * @param location Location in the method (jlocation)
+ * @param buffer Destination of the frame's text
+ * @param size Size of @buffer
+ * @returns Length of the frame's text or 0 if the frame is not cached. The
+ *          text is copied only if its length is less than @size.
+ */
+size_t frame_cache_get(T_frameCache *cache, const void *method, int64_t location, char *buffer, size_t size);
+
+
+
+/*
+ * Stores a formatted frame
+ *
+ * @param cache The cache
+ * @param method Method ID (jmethodID)
+ * @param location Location in the method (jlocation)
+ * @param loader ID of the class loader of method's class
+ * @param frame The frame's text, must not be empty
+ */
+void frame_cache_put(T_frameCache *cache, const void *method, int64_t location, uint64_t loader, const char *frame);
+
+
+
+/*
+ * Removes all frames of methods of classes of a class loader
+ *
+ * Does not call JNI, hence it can be called from ObjectFree callback.
+ *
+ * @param cache The cache
+ * @param loader ID of the class loader
+ */
+void frame_cache_invalidate_loader(T_frameCache *cache, uint64_t loader);
+
+
+
+/*
+ * Removes all frames of a method
+ *
+ * A redefined method keeps its ID but may get new line numbers.
+ *
+ * @param cache The cache
+ * @param method Method ID
+ */
+void frame_cache_invalidate_method(T_frameCache *cache, const void *method);
+
+
+
+/*
+ * Gets cache's counters
+ *
+ * @param cache The cache
+ * @param hits Number of successful lookups
+ * @param misses Number of failed lookups
+ * @param memory Number of bytes used by cached frames
+ */
+void frame_cache_statistics(T_frameCache *cache, size_t *hits, size_t *misses, size_t *memory);
+
+
+
+#endif // __FRAME_CACHE_H__
+
+
+
+/*
+ * finito
+ */
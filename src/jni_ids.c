@@ -0,0 +1,221 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "jni_ids.h"
+#include "abrt-checker.h"
+
+#include <stdio.h>
+#include <pthread.h>
+
+
+
+/* The resolved IDs */
+static T_jniIds jni_ids;
+
+/* Non zero once jni_ids are completely resolved */
+static int jni_ids_resolved;
+
+/* Serializes resolution */
+static pthread_mutex_t jni_ids_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/*
+ * Finds a class and returns a global reference to it
+ */
+static jclass jni_ids_find_class(JNIEnv *jni_env, const char *name)
+{
+    jclass local = (*jni_env)->FindClass(jni_env, name);
+    if ((*jni_env)->ExceptionCheck(jni_env) || NULL == local)
+    {
+        (*jni_env)->ExceptionClear(jni_env);
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get class of %s\n", name);
+        return NULL;
+    }
+
+    jclass global = (jclass)(*jni_env)->NewGlobalRef(jni_env, local);
+    (*jni_env)->DeleteLocalRef(jni_env, local);
+
+    if (NULL == global)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": NewGlobalRef(): out of memory\n");
+    }
+
+    return global;
+}
+
+
+
+/*
+ * Gets ID of an instance or static method
+ */
+static jmethodID jni_ids_get_method(JNIEnv *jni_env, jclass class, const char *name, const char *signature, int is_static)
+{
+    if (NULL == class)
+    {
+        return NULL;
+    }
+
+    jmethodID method = is_static
+        ? (*jni_env)->GetStaticMethodID(jni_env, class, name, signature)
+        : (*jni_env)->GetMethodID(jni_env, class, name, signature);
+
+    if ((*jni_env)->ExceptionCheck(jni_env) || NULL == method)
+    {
+        (*jni_env)->ExceptionClear(jni_env);
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get methodID of %s%s\n", name, signature);
+        return NULL;
+    }
+
+    return method;
+}
+
+
+
+/*
+ * Gets ID of an instance field
+ */
+static jfieldID jni_ids_get_field(JNIEnv *jni_env, jclass class, const char *name, const char *signature)
+{
+    if (NULL == class)
+    {
+        return NULL;
+    }
+
+    jfieldID field = (*jni_env)->GetFieldID(jni_env, class, name, signature);
+    if ((*jni_env)->ExceptionCheck(jni_env) || NULL == field)
+    {
+        (*jni_env)->ExceptionClear(jni_env);
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__)": Could not get fieldID of %s%s\n", name, signature);
+        return NULL;
+    }
+
+    return field;
+}
+
+
+
+static void jni_ids_release_class(JNIEnv *jni_env, jclass *class)
+{
+    if (NULL != *class)
+    {
+        (*jni_env)->DeleteGlobalRef(jni_env, *class);
+        *class = NULL;
+    }
+}
+
+
+
+/*
+ * Resolves all IDs. Must be called with locked jni_ids_mutex.
+ *
+ * @returns 0 on success; otherwise non zero value and no global reference is
+ * held
+ */
+static int jni_ids_resolve(JNIEnv *jni_env, T_jniIds *ids)
+{
+    ids->thread_class = jni_ids_find_class(jni_env, "java/lang/Thread");
+    ids->thread_get_id = jni_ids_get_method(jni_env, ids->thread_class, "getId", "()J", /*static*/0);
+
+    ids->class_class = jni_ids_find_class(jni_env, "java/lang/Class");
+    ids->class_get_name = jni_ids_get_method(jni_env, ids->class_class, "getName", "()Ljava/lang/String;", /*static*/0);
+
+    ids->class_loader_class = jni_ids_find_class(jni_env, "java/lang/ClassLoader");
+    ids->class_loader_get_resource = jni_ids_get_method(jni_env, ids->class_loader_class,
+            "getResource", "(Ljava/lang/String;)Ljava/net/URL;", /*static*/0);
+    ids->class_loader_get_system_class_loader = jni_ids_get_method(jni_env, ids->class_loader_class,
+            "getSystemClassLoader", "()Ljava/lang/ClassLoader;", /*static*/1);
+
+    ids->url_class = jni_ids_find_class(jni_env, "java/net/URL");
+    ids->url_to_external_form = jni_ids_get_method(jni_env, ids->url_class, "toExternalForm", "()Ljava/lang/String;", /*static*/0);
+    ids->url_get_path = jni_ids_get_method(jni_env, ids->url_class, "getPath", "()Ljava/lang/String;", /*static*/0);
+
+    ids->throwable_class = jni_ids_find_class(jni_env, "java/lang/Throwable");
+    ids->throwable_to_string = jni_ids_get_method(jni_env, ids->throwable_class, "toString", "()Ljava/lang/String;", /*static*/0);
+    ids->throwable_get_stack_trace = jni_ids_get_method(jni_env, ids->throwable_class,
+            "getStackTrace", "()[Ljava/lang/StackTraceElement;", /*static*/0);
+    ids->throwable_get_cause = jni_ids_get_method(jni_env, ids->throwable_class, "getCause", "()Ljava/lang/Throwable;", /*static*/0);
+    /* Private field, read without running Java code; optional */
+    ids->throwable_detail_message = jni_ids_get_field(jni_env, ids->throwable_class, "detailMessage", "Ljava/lang/String;");
+
+    ids->stack_trace_element_class = jni_ids_find_class(jni_env, "java/lang/StackTraceElement");
+    ids->stack_trace_element_get_class_name = jni_ids_get_method(jni_env, ids->stack_trace_element_class,
+            "getClassName", "()Ljava/lang/String;", /*static*/0);
+    ids->stack_trace_element_get_method_name = jni_ids_get_method(jni_env, ids->stack_trace_element_class,
+            "getMethodName", "()Ljava/lang/String;", /*static*/0);
+    ids->stack_trace_element_get_line_number = jni_ids_get_method(jni_env, ids->stack_trace_element_class,
+            "getLineNumber", "()I", /*static*/0);
+    ids->stack_trace_element_equals = jni_ids_get_method(jni_env, ids->stack_trace_element_class,
+            "equals", "(Ljava/lang/Object;)Z", /*static*/0);
+    ids->stack_trace_element_to_string = jni_ids_get_method(jni_env, ids->stack_trace_element_class,
+            "toString", "()Ljava/lang/String;", /*static*/0);
+
+    if (NULL != ids->thread_get_id
+        && NULL != ids->class_get_name
+        && NULL != ids->class_loader_get_resource
+        && NULL != ids->class_loader_get_system_class_loader
+        && NULL != ids->url_to_external_form
+        && NULL != ids->url_get_path
+        && NULL != ids->throwable_to_string
+        && NULL != ids->throwable_get_stack_trace
+        && NULL != ids->throwable_get_cause
+        && NULL != ids->stack_trace_element_get_class_name
+        && NULL != ids->stack_trace_element_get_method_name
+        && NULL != ids->stack_trace_element_get_line_number
+        && NULL != ids->stack_trace_element_equals
+        && NULL != ids->stack_trace_element_to_string)
+    {
+        return 0;
+    }
+
+    jni_ids_release_class(jni_env, &(ids->thread_class));
+    jni_ids_release_class(jni_env, &(ids->class_class));
+    jni_ids_release_class(jni_env, &(ids->class_loader_class));
+    jni_ids_release_class(jni_env, &(ids->url_class));
+    jni_ids_release_class(jni_env, &(ids->throwable_class));
+    jni_ids_release_class(jni_env, &(ids->stack_trace_element_class));
+
+    return 1;
+}
+
+
+
+const T_jniIds *jni_ids_get(JNIEnv *jni_env)
+{
+    /* Fast path; the flag is set after all IDs are written */
+    if (__sync_fetch_and_add(&jni_ids_resolved, 0))
+    {
+        return &jni_ids;
+    }
+
+    pthread_mutex_lock(&jni_ids_mutex);
+    int resolved = jni_ids_resolved;
+    if (!resolved && 0 == jni_ids_resolve(jni_env, &jni_ids))
+    {
+        resolved = 1;
+        __sync_fetch_and_add(&jni_ids_resolved, 1);
+    }
+    pthread_mutex_unlock(&jni_ids_mutex);
+
+    return resolved ? &jni_ids : NULL;
+}
+
+
+
+/*
+ * finito
+ */
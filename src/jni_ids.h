@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __JNI_IDS_H__
+#define __JNI_IDS_H__
+
+
+
+/*
+ * JNI types
+ */
+#include <jni.h>
+
+
+
+/*
+ * Global references to classes and IDs of methods called by the agent
+ *
+ * Looking the IDs up is not cheap and their values do not change, hence they
+ * are resolved only once and kept until the VM dies.
+ */
+typedef struct {
+    jclass thread_class;                          ///< java.lang.Thread
+    jmethodID thread_get_id;                      ///< Thread.getId()
+
+    jclass class_class;                           ///< java.lang.Class
+    jmethodID class_get_name;                     ///< Class.getName()
+
+    jclass class_loader_class;                    ///< java.lang.ClassLoader
+    jmethodID class_loader_get_resource;          ///< ClassLoader.getResource(String)
+    jmethodID class_loader_get_system_class_loader; ///< static ClassLoader.getSystemClassLoader()
+
+    jclass url_class;                             ///< java.net.URL
+    jmethodID url_to_external_form;               ///< URL.toExternalForm()
+    jmethodID url_get_path;                       ///< URL.getPath()
+
+    jclass throwable_class;                       ///< java.lang.Throwable
+    jmethodID throwable_to_string;                ///< Throwable.toString()
+    jmethodID throwable_get_stack_trace;          ///< Throwable.getStackTrace()
+    jmethodID throwable_get_cause;                ///< Throwable.getCause()
+    jfieldID throwable_detail_message;            ///< Throwable.detailMessage or NULL if the VM has no such field
+
+    jclass stack_trace_element_class;             ///< java.lang.StackTraceElement
+    jmethodID stack_trace_element_get_class_name; ///< StackTraceElement.getClassName()
+    jmethodID stack_trace_element_get_method_name; ///< StackTraceElement.getMethodName()
+    jmethodID stack_trace_element_get_line_number; ///< StackTraceElement.getLineNumber()
+    jmethodID stack_trace_element_equals;         ///< StackTraceElement.equals(Object)
+    jmethodID stack_trace_element_to_string;      ///< StackTraceElement.toString()
+} T_jniIds;
+
+
+
+/*
+ * Returns the resolved IDs
+ *
+ * The IDs are resolved by the first successful call, which should be made from
+ * VMInit callback. Calls made before the classes can be loaded fail and the
+ * resolution is attempted again by the next call.
+ *
+ * @param jni_env JNI environment of the current thread
+ * @returns The resolved IDs; NULL if they cannot be resolved
+ */
+const T_jniIds *jni_ids_get(JNIEnv *jni_env);
+
+
+
+#endif // __JNI_IDS_H__
+
+
+
+/*
+ * finito
+ */
@@ -17,38 +17,83 @@
  */
 #include "jthread_map.h"
 #include "abrt-checker.h"
-#include "jthrowable_circular_buf.h"
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <pthread.h>
 #include <assert.h>
 
 
 /*
- * Number of elements
+ * Number of independently locked segments, must be a power of two
  */
-#define MAP_SIZE 111
+#ifndef JTHREAD_MAP_SEGMENTS
+#define JTHREAD_MAP_SEGMENTS 16
+#endif
 
+/*
+ * Initial number of slots of a segment, must be a power of two
+ */
+#ifndef JTHREAD_MAP_SEGMENT_CAPACITY
+#define JTHREAD_MAP_SEGMENT_CAPACITY 16
+#endif
+
+/*
+ * A segment grows when it is fuller than 3/4
+ */
+#define SEGMENT_IS_OVERLOADED(length, capacity) ((length) * 4 > (capacity) * 3)
 
 
-struct jthread_map_item;
 
-typedef struct jthread_map_item {
-    long tid;                         ///< item ID from Thread.getId()
+typedef struct {
+    jlong tid;                        ///< item ID from Thread.getId()
     void *data;                       ///< data
-    struct jthread_map_item *next;    ///< a next item mapped to same element
-} T_jthreadMapItem;
+    int used;                         ///< the slot holds an item
+} T_jthreadMapSlot;
+
+
+
+typedef struct {
+    pthread_mutex_t mutex;            ///< guards all members below
+    T_jthreadMapSlot *slots;          ///< open addressing table with linear probing
+    size_t capacity;                  ///< number of slots, a power of two
+    size_t length;                    ///< number of used slots
+} T_jthreadMapSegment;
 
 
 
 struct jthread_map {
-    T_jthreadMapItem *items[MAP_SIZE]; ///< map elements
-    pthread_mutex_t mutex;
-    size_t size;
+    T_jthreadMapSegment segments[JTHREAD_MAP_SEGMENTS]; ///< map segments
+    size_t size;                      ///< number of items, updated atomically
 };
 
 
 
+/*
+ * Scatters TIDs which are usually small consecutive numbers
+ *
+ * The top bits select a segment and the bottom bits a slot in the segment.
+ */
+static uint64_t jthread_map_hash(jlong tid)
+{
+    uint64_t h = (uint64_t)tid;
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    return h;
+}
+
+
+
+static T_jthreadMapSegment *jthread_map_segment(T_jthreadMap *map, uint64_t hash)
+{
+    return map->segments + (hash >> 32) % JTHREAD_MAP_SEGMENTS;
+}
+
+
+
 T_jthreadMap *jthread_map_new()
 {
     T_jthreadMap *map = (T_jthreadMap *)calloc(1, sizeof(*map));
@@ -58,7 +103,25 @@ T_jthreadMap *jthread_map_new()
         return NULL;
     }
 
-    pthread_mutex_init(&map->mutex, /*use default attributes*/NULL);
+    for (size_t i = 0; i < JTHREAD_MAP_SEGMENTS; ++i)
+    {
+        T_jthreadMapSegment *segment = map->segments + i;
+        segment->slots = (T_jthreadMapSlot *)calloc(JTHREAD_MAP_SEGMENT_CAPACITY, sizeof(*segment->slots));
+        if (NULL == segment->slots)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+            while (i-- > 0)
+            {
+                pthread_mutex_destroy(&map->segments[i].mutex);
+                free(map->segments[i].slots);
+            }
+            free(map);
+            return NULL;
+        }
+
+        segment->capacity = JTHREAD_MAP_SEGMENT_CAPACITY;
+        pthread_mutex_init(&segment->mutex, /*use default attributes*/NULL);
+    }
 
     return map;
 }
@@ -72,41 +135,88 @@ void jthread_map_free(T_jthreadMap *map)
         return;
     }
 
-    pthread_mutex_destroy(&map->mutex);
+    for (size_t i = 0; i < JTHREAD_MAP_SEGMENTS; ++i)
+    {
+        pthread_mutex_destroy(&map->segments[i].mutex);
+        free(map->segments[i].slots);
+    }
+
     free(map);
 }
 
 
+
 int jthread_map_empty(T_jthreadMap *map)
 {
-    return 0 == map->size;
+    return 0 == jthread_map_size(map);
 }
 
-static T_jthreadMapItem *jthrowable_map_item_new(long tid, void *item)
+
+
+size_t jthread_map_size(T_jthreadMap *map)
 {
-    T_jthreadMapItem *itm = malloc(sizeof(*itm));
-    if (NULL == itm)
+    assert(NULL != map);
+
+    return __sync_add_and_fetch(&map->size, 0);
+}
+
+
+
+/*
+ * Finds a slot of @tid or the empty slot where @tid would be stored. Must be
+ * called with locked segment's mutex.
+ */
+static size_t jthread_map_segment_find(const T_jthreadMapSegment *segment, uint64_t hash, jlong tid)
+{
+    const size_t mask = segment->capacity - 1;
+    size_t index = (size_t)hash & mask;
+
+    /* The segment always has an empty slot, the loop terminates */
+    while (segment->slots[index].used && segment->slots[index].tid != tid)
     {
-        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory");
-        return NULL;
+        index = (index + 1) & mask;
     }
 
-    itm->tid = tid;
-    itm->data = item;
-    itm->next = NULL;
-    return itm;
+    return index;
 }
 
 
 
-static void jthread_map_item_free(T_jthreadMapItem *itm)
+/*
+ * Doubles capacity of a segment. Must be called with locked segment's mutex.
+ *
+ * @returns 0 on success; otherwise non zero value and the segment is not
+ *          changed
+ */
+static int jthread_map_segment_grow(T_jthreadMapSegment *segment)
 {
-    if (NULL == itm)
+    T_jthreadMapSegment grown = {
+        .slots = NULL,
+        .capacity = segment->capacity * 2,
+        .length = segment->length,
+    };
+
+    grown.slots = (T_jthreadMapSlot *)calloc(grown.capacity, sizeof(*grown.slots));
+    if (NULL == grown.slots)
     {
-        return;
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc(): out of memory\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < segment->capacity; ++i)
+    {
+        const T_jthreadMapSlot *slot = segment->slots + i;
+        if (slot->used)
+        {
+            grown.slots[jthread_map_segment_find(&grown, jthread_map_hash(slot->tid), slot->tid)] = *slot;
+        }
     }
 
-    free(itm);
+    free(segment->slots);
+    segment->slots = grown.slots;
+    segment->capacity = grown.capacity;
+
+    return 0;
 }
 
 
@@ -115,33 +225,38 @@ void jthread_map_push(T_jthreadMap *map, jlong tid, void *item)
 {
     assert(NULL != map);
 
-    pthread_mutex_lock(&map->mutex);
+    const uint64_t hash = jthread_map_hash(tid);
+    T_jthreadMapSegment *segment = jthread_map_segment(map, hash);
+
+    pthread_mutex_lock(&segment->mutex);
 
-    const long index = tid % MAP_SIZE;
-    T_jthreadMapItem *last = NULL;
-    T_jthreadMapItem *itm = map->items[index];
-    while(NULL != itm && itm->tid != tid)
+    size_t index = jthread_map_segment_find(segment, hash, tid);
+    if (segment->slots[index].used)
     {
-        last = itm;
-        itm = itm->next;
+        goto jthread_map_push_exit;
     }
 
-    if (NULL == itm)
+    if (SEGMENT_IS_OVERLOADED(segment->length + 1, segment->capacity))
     {
-        ++map->size;
-
-        T_jthreadMapItem *new = jthrowable_map_item_new(tid, item);
-        if (last == NULL)
+        if (0 == jthread_map_segment_grow(segment))
         {
-            map->items[index] = new;
+            index = jthread_map_segment_find(segment, hash, tid);
         }
-        else
-        {
-            last->next = new;
+        else if (segment->length + 1 >= segment->capacity)
+        {   /* At least one slot must stay empty */
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot store an item of thread %ld\n", (long)tid);
+            goto jthread_map_push_exit;
         }
     }
 
-    pthread_mutex_unlock(&map->mutex);
+    segment->slots[index].tid = tid;
+    segment->slots[index].data = item;
+    segment->slots[index].used = 1;
+    ++segment->length;
+    __sync_add_and_fetch(&map->size, 1);
+
+jthread_map_push_exit:
+    pthread_mutex_unlock(&segment->mutex);
 }
 
 
@@ -150,68 +265,120 @@ void *jthread_map_get(T_jthreadMap *map, jlong tid)
 {
     assert(NULL != map);
 
-    pthread_mutex_lock(&map->mutex);
+    const uint64_t hash = jthread_map_hash(tid);
+    T_jthreadMapSegment *segment = jthread_map_segment(map, hash);
+
+    pthread_mutex_lock(&segment->mutex);
+
+    const T_jthreadMapSlot *slot = segment->slots + jthread_map_segment_find(segment, hash, tid);
+    void *data = slot->used ? slot->data : NULL;
+
+    pthread_mutex_unlock(&segment->mutex);
+
+    return data;
+}
+
+
+
+void *jthread_map_pop(T_jthreadMap *map, jlong tid)
+{
+    assert(NULL != map);
 
-    const size_t index = tid % MAP_SIZE;
+    const uint64_t hash = jthread_map_hash(tid);
+    T_jthreadMapSegment *segment = jthread_map_segment(map, hash);
+
+    pthread_mutex_lock(&segment->mutex);
+
+    size_t index = jthread_map_segment_find(segment, hash, tid);
     void *data = NULL;
 
-    for (T_jthreadMapItem *itm = map->items[index]; NULL != itm; itm = itm->next)
+    if (segment->slots[index].used)
     {
-        if (itm->tid == tid)
+        data = segment->slots[index].data;
+
+        /* Shift the following items of the probe sequence back instead of
+         * leaving a tombstone, so lookups never scan removed items */
+        const size_t mask = segment->capacity - 1;
+        for (size_t next = (index + 1) & mask; segment->slots[next].used; next = (next + 1) & mask)
         {
-            data = itm->data;
-            break;
+            const size_t home = (size_t)jthread_map_hash(segment->slots[next].tid) & mask;
+
+            /* The item can fill the hole if its home slot is not in the
+             * cyclic range (index, next] */
+            if (((next - home) & mask) >= ((next - index) & mask))
+            {
+                segment->slots[index] = segment->slots[next];
+                index = next;
+            }
         }
+
+        segment->slots[index].used = 0;
+        segment->slots[index].data = NULL;
+        --segment->length;
+        __sync_sub_and_fetch(&map->size, 1);
     }
 
-    pthread_mutex_unlock(&map->mutex);
+    pthread_mutex_unlock(&segment->mutex);
 
     return data;
 }
 
 
 
-void *jthread_map_pop(T_jthreadMap *map, jlong tid)
+size_t jthread_map_snapshot(T_jthreadMap *map, T_jthreadMapEntry **entries)
 {
     assert(NULL != map);
+    assert(NULL != entries);
 
-    pthread_mutex_lock(&map->mutex);
+    *entries = NULL;
 
-    const size_t index = tid % MAP_SIZE;
-    void *data = NULL;
-    if (NULL != map->items[index])
+    size_t capacity = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < JTHREAD_MAP_SEGMENTS; ++i)
     {
-        T_jthreadMapItem *last = NULL;
-        T_jthreadMapItem *itm = map->items[index];
-        while (NULL != itm && itm->tid != tid)
-        {
-            last = itm;
-            itm = itm->next;
-        }
+        T_jthreadMapSegment *segment = map->segments + i;
 
-        if (NULL != itm)
-        {
-            data = itm->data;
+        pthread_mutex_lock(&segment->mutex);
 
-            if (NULL == last)
+        if (count + segment->length > capacity)
+        {
+            /* Reserve some space for items added to the next segments in
+             * the meantime */
+            const size_t new_capacity = count + segment->length + jthread_map_size(map);
+            T_jthreadMapEntry *resized = (T_jthreadMapEntry *)realloc(*entries, new_capacity * sizeof(**entries));
+            if (NULL == resized)
             {
-                map->items[index] = itm->next;
+                pthread_mutex_unlock(&segment->mutex);
+                fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": realloc(): out of memory\n");
+                free(*entries);
+                *entries = NULL;
+                return 0;
             }
-            else
+
+            *entries = resized;
+            capacity = new_capacity;
+        }
+
+        for (size_t j = 0; j < segment->capacity; ++j)
+        {
+            if (segment->slots[j].used)
             {
-                last->next = itm->next;
+                (*entries)[count].tid = segment->slots[j].tid;
+                (*entries)[count].item = segment->slots[j].data;
+                ++count;
             }
-
-            jthread_map_item_free(itm);
         }
-    }
 
-    if (NULL != data)
-        --map->size;
+        pthread_mutex_unlock(&segment->mutex);
+    }
 
-    pthread_mutex_unlock(&map->mutex);
+    if (0 == count)
+    {
+        free(*entries);
+        *entries = NULL;
+    }
 
-    return data;
+    return count;
 }
 
 
@@ -19,16 +19,30 @@
 #define __JTHREAD_MAP_H__
 
 
-#include "jthrowable_circular_buf.h"
+#include <stddef.h>
+#include <jni.h>
 
 
 /*
  * Map of TID to (void *)
+ *
+ * The map is split into independently locked segments, so threads working
+ * with different TIDs rarely contend for the same lock.
  */
 typedef struct jthread_map T_jthreadMap;
 
 
 
+/*
+ * A single item of a map's snapshot
+ */
+typedef struct {
+    jlong tid;  ///< item ID
+    void *item; ///< stored (void *)
+} T_jthreadMapEntry;
+
+
+
 /*
  * Initializes a new map
  *
@@ -94,6 +108,33 @@ void *jthread_map_pop(T_jthreadMap *map, jlong tid);
 
 
 
+/*
+ * Returns number of items in the map
+ *
+ * @param map Map
+ * @returns Number of items; the value can be outdated if other threads
+ *          modify the map
+ */
+size_t jthread_map_size(T_jthreadMap *map);
+
+
+
+/*
+ * Copies all items of the map
+ *
+ * Each segment is copied atomically but the map can change in between,
+ * hence the snapshot does not have to be consistent if other threads
+ * modify the map. The items are listed in no particular order.
+ *
+ * @param map Map
+ * @param entries Mallocated array of copied items which must be released
+ *        by free(); NULL if the map is empty or on errors
+ * @returns Number of items in @entries
+ */
+size_t jthread_map_snapshot(T_jthreadMap *map, T_jthreadMapEntry **entries);
+
+
+
 #endif //__JTHREAD_MAP_H__
 
 
@@ -0,0 +1,383 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "line_number_cache.h"
+#include "abrt-checker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+
+
+/*
+ * Number of hash table buckets per kilobyte of the memory limit
+ */
+#define LINE_NUMBER_CACHE_BUCKETS_PER_KB 4
+
+
+
+typedef struct line_number_table {
+    struct line_number_table *chain;  ///< next entry in the same bucket
+    struct line_number_table *newer;  ///< more recently used entry
+    struct line_number_table *older;  ///< less recently used entry
+    const void *method;               ///< method ID
+    uint64_t loader;                  ///< ID of the class loader
+    size_t count;                     ///< number of lines
+    T_lineNumber lines[];             ///< lines sorted by start location
+} T_lineNumberTable;
+
+
+
+struct line_number_cache {
+    pthread_mutex_t mutex;            ///< guards all members below
+    T_lineNumberTable **buckets;      ///< hash table of entries
+    size_t mask;                      ///< number of buckets - 1
+    size_t memory_limit;              ///< maximal memory used by entries
+    size_t memory;                    ///< memory used by entries
+    T_lineNumberTable lru;            ///< sentinel of the ring ordered by use;
+                                      ///< lru.older is the most recently used
+                                      ///< entry and lru.newer the least one
+    size_t hits;                      ///< number of successful lookups
+    size_t misses;                    ///< number of failed lookups
+};
+
+
+
+static int line_number_compare(const void *a, const void *b)
+{
+    const int64_t first = ((const T_lineNumber *)a)->start_location;
+    const int64_t second = ((const T_lineNumber *)b)->start_location;
+    return (first > second) - (first < second);
+}
+
+
+
+void line_number_table_sort(T_lineNumber *table, size_t count)
+{
+    /* JVMTI returns the tables already sorted in practice */
+    for (size_t i = 1; i < count; ++i)
+    {
+        if (table[i - 1].start_location > table[i].start_location)
+        {
+            qsort(table, count, sizeof(*table), &line_number_compare);
+            return;
+        }
+    }
+}
+
+
+
+int line_number_table_find(const T_lineNumber *table, size_t count, int64_t location)
+{
+    /* the line of the location is the line of the last entry starting before
+     * or at the location */
+    size_t begin = 0;
+    size_t end = count;
+    while (begin < end)
+    {
+        const size_t middle = begin + (end - begin) / 2;
+        if (table[middle].start_location <= location)
+        {
+            begin = middle + 1;
+        }
+        else
+        {
+            end = middle;
+        }
+    }
+
+    return 0 == begin ? -1 : table[begin - 1].line_number;
+}
+
+
+
+static size_t line_number_cache_bucket(const T_lineNumberCache *cache, const void *method)
+{
+    uint64_t h = (uint64_t)(uintptr_t)method;
+    h ^= h >> 29;
+    h *= UINT64_C(0xbf58476d1ce4e5b9);
+    h ^= h >> 32;
+    return (size_t)h & cache->mask;
+}
+
+
+
+static size_t line_number_table_size(size_t count)
+{
+    return sizeof(T_lineNumberTable) + count * sizeof(T_lineNumber);
+}
+
+
+
+T_lineNumberCache *line_number_cache_new(size_t memory_limit)
+{
+    T_lineNumberCache *cache = (T_lineNumberCache *)calloc(1, sizeof(*cache));
+    if (NULL == cache)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    size_t buckets = 1;
+    while (buckets < memory_limit / 1024 * LINE_NUMBER_CACHE_BUCKETS_PER_KB)
+    {
+        buckets <<= 1;
+    }
+
+    cache->buckets = (T_lineNumberTable **)calloc(buckets, sizeof(*cache->buckets));
+    if (NULL == cache->buckets)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        free(cache);
+        return NULL;
+    }
+
+    cache->mask = buckets - 1;
+    cache->memory_limit = memory_limit;
+    cache->lru.newer = &cache->lru;
+    cache->lru.older = &cache->lru;
+    pthread_mutex_init(&cache->mutex, /*use default attributes*/NULL);
+
+    return cache;
+}
+
+
+
+void line_number_cache_free(T_lineNumberCache *cache)
+{
+    if (NULL == cache)
+    {
+        return;
+    }
+
+    T_lineNumberTable *entry = cache->lru.older;
+    while (&cache->lru != entry)
+    {
+        T_lineNumberTable *next = entry->older;
+        free(entry);
+        entry = next;
+    }
+
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache->buckets);
+    free(cache);
+}
+
+
+
+/*
+ * Unlinks an entry from the list ordered by use. Must be called with locked
+ * cache's mutex.
+ */
+static void line_number_cache_unlink(T_lineNumberTable *entry)
+{
+    entry->newer->older = entry->older;
+    entry->older->newer = entry->newer;
+}
+
+
+
+/*
+ * Makes an entry the most recently used. Must be called with locked cache's
+ * mutex.
+ */
+static void line_number_cache_link_newest(T_lineNumberCache *cache, T_lineNumberTable *entry)
+{
+    entry->older = cache->lru.older;
+    entry->newer = &cache->lru;
+    cache->lru.older->newer = entry;
+    cache->lru.older = entry;
+}
+
+
+
+/*
+ * Removes an entry from the cache and frees it. Must be called with locked
+ * cache's mutex.
+ */
+static void line_number_cache_remove(T_lineNumberCache *cache, T_lineNumberTable *entry)
+{
+    T_lineNumberTable **link = cache->buckets + line_number_cache_bucket(cache, entry->method);
+    while (*link != entry)
+    {
+        link = &((*link)->chain);
+    }
+
+    *link = entry->chain;
+    line_number_cache_unlink(entry);
+    cache->memory -= line_number_table_size(entry->count);
+    free(entry);
+}
+
+
+
+/*
+ * Must be called with locked cache's mutex.
+ */
+static T_lineNumberTable *line_number_cache_find(T_lineNumberCache *cache, const void *method)
+{
+    for (T_lineNumberTable *entry = cache->buckets[line_number_cache_bucket(cache, method)]; NULL != entry; entry = entry->chain)
+    {
+        if (entry->method == method)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+
+
+int line_number_cache_get(T_lineNumberCache *cache, const void *method, int64_t location, int *line_number)
+{
+    assert(NULL != cache);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    T_lineNumberTable *entry = line_number_cache_find(cache, method);
+    if (NULL == entry)
+    {
+        ++cache->misses;
+    }
+    else
+    {
+        ++cache->hits;
+        *line_number = line_number_table_find(entry->lines, entry->count, location);
+
+        line_number_cache_unlink(entry);
+        line_number_cache_link_newest(cache, entry);
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    return NULL == entry;
+}
+
+
+
+void line_number_cache_put(T_lineNumberCache *cache, const void *method, uint64_t loader, const T_lineNumber *table, size_t count)
+{
+    assert(NULL != cache);
+    assert(NULL != table || 0 == count);
+
+    const size_t size = line_number_table_size(count);
+    if (size > cache->memory_limit)
+    {
+        return;
+    }
+
+    /* Allocate the entry before locking the mutex */
+    T_lineNumberTable *entry = (T_lineNumberTable *)malloc(size);
+    if (NULL == entry)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory\n");
+        return;
+    }
+
+    entry->method = method;
+    entry->loader = loader;
+    entry->count = count;
+    if (0 != count)
+    {
+        memcpy(entry->lines, table, count * sizeof(*table));
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+
+    /* Another thread might have stored the same table in the meantime */
+    if (NULL != line_number_cache_find(cache, method))
+    {
+        pthread_mutex_unlock(&cache->mutex);
+        free(entry);
+        return;
+    }
+
+    while (cache->memory + size > cache->memory_limit)
+    {
+        line_number_cache_remove(cache, cache->lru.newer);
+    }
+
+    T_lineNumberTable **bucket = cache->buckets + line_number_cache_bucket(cache, method);
+    entry->chain = *bucket;
+    *bucket = entry;
+    line_number_cache_link_newest(cache, entry);
+    cache->memory += size;
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+void line_number_cache_invalidate_loader(T_lineNumberCache *cache, uint64_t loader)
+{
+    assert(NULL != cache);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    T_lineNumberTable *entry = cache->lru.older;
+    while (&cache->lru != entry)
+    {
+        T_lineNumberTable *next = entry->older;
+        if (entry->loader == loader)
+        {
+            line_number_cache_remove(cache, entry);
+        }
+        entry = next;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+void line_number_cache_invalidate_method(T_lineNumberCache *cache, const void *method)
+{
+    assert(NULL != cache);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    T_lineNumberTable *entry = line_number_cache_find(cache, method);
+    if (NULL != entry)
+    {
+        line_number_cache_remove(cache, entry);
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+void line_number_cache_statistics(T_lineNumberCache *cache, size_t *hits, size_t *misses, size_t *memory)
+{
+    assert(NULL != cache);
+
+    pthread_mutex_lock(&cache->mutex);
+    *hits = cache->hits;
+    *misses = cache->misses;
+    *memory = cache->memory;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+
+
+/*
+ * finito
+ */
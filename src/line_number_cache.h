@@ -0,0 +1,161 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __LINE_NUMBER_CACHE_H__
+#define __LINE_NUMBER_CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+/*
+ * An entry of a line number table of a method
+ */
+typedef struct {
+    int64_t start_location;           ///< the first location of the line (jlocation)
+    int line_number;                  ///< the line
+} T_lineNumber;
+
+
+
+/*
+ * An opaque structure caching line number tables of methods
+ *
+ * A table is identified by a method ID and is valid as long as the class of
+ * the method is loaded and not redefined. Tables of a class loader are
+ * invalidated by @line_number_cache_invalidate_loader.
+ *
+ * The cache is limited by the memory used by its entries. The least
+ * recently used entries are evicted first.
+ */
+typedef struct line_number_cache T_lineNumberCache;
+
+
+
+/*
+ * Sorts a line number table by start locations
+ *
+ * @param table The table
+ * @param count Number of entries of the table
+ */
+void line_number_table_sort(T_lineNumber *table, size_t count);
+
+
+
+/*
+ * Finds a line of a location by binary search
+ *
+ * @param table A table sorted by @line_number_table_sort
+ * @param count Number of entries of the table
+ * @param location Location in the method (jlocation)
+ * @returns The line number or -1 if the location precedes all lines
+ */
+int line_number_table_find(const T_lineNumber *table, size_t count, int64_t location);
+
+
+
+/*
+ * Creates a new empty cache
+ *
+ * @param memory_limit Maximal number of bytes used by cached tables
+ * @returns Mallocated cache on success; otherwise NULL
+ */
+T_lineNumberCache *line_number_cache_new(size_t memory_limit);
+
+
+
+/*
+ * Frees cache's memory
+ *
+ * @param cache A freed cache. Can be NULL
+ */
+void line_number_cache_free(T_lineNumberCache *cache);
+
+
+
+/*
+ * Finds a line of a location in the cached table of a method
+ *
+ * @param cache The cache
+ * @param method Method ID (jmethodID)
+ * @param location Location in the method (jlocation)
+ * @param line_number Filled with the line number or -1 if the line is not
+ *        known
+ * @returns 0 if the table of the method is cached; otherwise non zero value
+ */
+int line_number_cache_get(T_lineNumberCache *cache, const void *method, int64_t location, int *line_number);
+
+
+
+/*
+ * Stores a line number table of a method
+ *
+ * @param cache The cache
+ * @param method Method ID (jmethodID)
+ * @param loader ID of the class loader of method's class
+ * @param table A table sorted by @line_number_table_sort
+ * @param count Number of entries of the table, 0 means the method has no line
+ *        numbers
+ */
+void line_number_cache_put(T_lineNumberCache *cache, const void *method, uint64_t loader, const T_lineNumber *table, size_t count);
+
+
+
+/*
+ * Removes all tables of methods of classes of a class loader
+ *
+ * Does not call JNI, hence it can be called from ObjectFree callback.
+ *
+ * @param cache The cache
+ * @param loader ID of the class loader
+ */
+void line_number_cache_invalidate_loader(T_lineNumberCache *cache, uint64_t loader);
+
+
+
+/*
+ * Removes the table of a method
+ *
+ * A redefined method keeps its ID but may get a new table.
+ *
+ * @param cache The cache
+ * @param method Method ID
+ */
+void line_number_cache_invalidate_method(T_lineNumberCache *cache, const void *method);
+
+
+
+/*
+ * Gets cache's counters
+ *
+ * @param cache The cache
+ * @param hits Number of successful lookups
+ * @param misses Number of failed lookups
+ * @param memory Number of bytes used by cached tables
+ */
+void line_number_cache_statistics(T_lineNumberCache *cache, size_t *hits, size_t *misses, size_t *memory);
+
+
+
+#endif // __LINE_NUMBER_CACHE_H__
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,235 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "rate_limiter.h"
+#include "abrt-checker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <assert.h>
+
+
+
+/*
+ * Number of buckets, must be a power of 2
+ */
+#ifndef RATE_LIMITER_CAPACITY
+#define RATE_LIMITER_CAPACITY 1024
+#endif
+
+/*
+ * Number of buckets a signature can be stored in, must be a power of 2
+ */
+#ifndef RATE_LIMITER_WAYS
+#define RATE_LIMITER_WAYS 4
+#endif
+
+/*
+ * Number of locks guarding the sets of buckets
+ */
+#ifndef RATE_LIMITER_LOCKS
+#define RATE_LIMITER_LOCKS 16
+#endif
+
+#define RATE_LIMITER_SETS (RATE_LIMITER_CAPACITY / RATE_LIMITER_WAYS)
+
+
+
+typedef struct {
+    uint64_t signature; ///< signature of events, 0 means unused
+    double tokens;      ///< number of available tokens
+    uint64_t refilled;  ///< time of the last refill in nanoseconds
+    size_t suppressed;  ///< number of suppressed events since the last passed
+} T_tokenBucket;
+
+
+
+struct rate_limiter {
+    double rate;                                   ///< tokens per nanosecond
+    double burst;                                  ///< capacity of a bucket
+    size_t passed;                                 ///< total passed events
+    size_t suppressed;                             ///< total suppressed events
+    pthread_mutex_t locks[RATE_LIMITER_LOCKS];     ///< guard the sets
+    T_tokenBucket buckets[RATE_LIMITER_CAPACITY];  ///< the sets one after another
+};
+
+
+
+T_rateLimiter *rate_limiter_new(double rate, size_t burst)
+{
+    assert(rate > 0 || !"Cannot create a limiter with non positive rate");
+    assert(0 != burst || !"Cannot create a limiter with zero burst");
+
+    T_rateLimiter *limiter = (T_rateLimiter *)calloc(1, sizeof(*limiter));
+    if (NULL == limiter)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    limiter->rate = rate / 1e9;
+    limiter->burst = (double)burst;
+
+    for (size_t i = 0; i < RATE_LIMITER_LOCKS; ++i)
+    {
+        pthread_mutex_init(limiter->locks + i, /*use default attributes*/NULL);
+    }
+
+    return limiter;
+}
+
+
+
+void rate_limiter_free(T_rateLimiter *limiter)
+{
+    if (NULL == limiter)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < RATE_LIMITER_LOCKS; ++i)
+    {
+        pthread_mutex_destroy(limiter->locks + i);
+    }
+
+    free(limiter);
+}
+
+
+
+static uint64_t rate_limiter_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+
+
+/*
+ * Finds signature's bucket in a set or reuses the least recently refilled
+ * one. Must be called with locked set.
+ */
+static T_tokenBucket *rate_limiter_find_bucket(T_rateLimiter *limiter, T_tokenBucket *set, uint64_t signature, uint64_t now)
+{
+    T_tokenBucket *victim = set;
+    for (T_tokenBucket *bucket = set; bucket < set + RATE_LIMITER_WAYS; ++bucket)
+    {
+        if (signature == bucket->signature)
+        {
+            return bucket;
+        }
+
+        if (0 == bucket->signature)
+        {
+            victim = bucket;
+            break;
+        }
+
+        if (bucket->refilled < victim->refilled)
+        {
+            victim = bucket;
+        }
+    }
+
+    victim->signature = signature;
+    victim->tokens = limiter->burst;
+    victim->refilled = now;
+    victim->suppressed = 0;
+
+    return victim;
+}
+
+
+
+int rate_limiter_acquire(T_rateLimiter *limiter, uint64_t signature, size_t *suppressed)
+{
+    /* 0 marks unused buckets */
+    if (0 == signature)
+    {
+        signature = 1;
+    }
+
+    const size_t set_index = (size_t)(signature & (RATE_LIMITER_SETS - 1));
+    T_tokenBucket *set = limiter->buckets + set_index * RATE_LIMITER_WAYS;
+    pthread_mutex_t *lock = limiter->locks + (set_index % RATE_LIMITER_LOCKS);
+
+    const uint64_t now = rate_limiter_now();
+    int passed = 0;
+
+    pthread_mutex_lock(lock);
+    T_tokenBucket *bucket = rate_limiter_find_bucket(limiter, set, signature, now);
+
+    if (now > bucket->refilled)
+    {
+        bucket->tokens += (double)(now - bucket->refilled) * limiter->rate;
+        if (bucket->tokens > limiter->burst)
+        {
+            bucket->tokens = limiter->burst;
+        }
+        bucket->refilled = now;
+    }
+
+    if (bucket->tokens >= 1.0)
+    {
+        bucket->tokens -= 1.0;
+        if (NULL != suppressed)
+        {
+            *suppressed = bucket->suppressed;
+        }
+        bucket->suppressed = 0;
+        passed = 1;
+    }
+    else
+    {
+        ++bucket->suppressed;
+    }
+    pthread_mutex_unlock(lock);
+
+    __sync_fetch_and_add(passed ? &limiter->passed : &limiter->suppressed, 1);
+    return passed;
+}
+
+
+
+void rate_limiter_statistics(T_rateLimiter *limiter, size_t *passed, size_t *suppressed)
+{
+    *passed = __sync_fetch_and_add(&limiter->passed, 0);
+    *suppressed = __sync_fetch_and_add(&limiter->suppressed, 0);
+}
+
+
+
+uint64_t rate_limiter_hash(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+
+
+/*
+ * finito
+ */
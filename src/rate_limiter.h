@@ -0,0 +1,103 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __RATE_LIMITER_H__
+#define __RATE_LIMITER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+/*
+ * An opaque structure limiting rate of events with the same signature
+ *
+ * Every signature has its own token bucket. The buckets are kept in a fixed
+ * size set associative table, so the memory consumption does not depend on
+ * the number of distinct signatures. When a set is full, the least recently
+ * refilled bucket is reused.
+ */
+typedef struct rate_limiter T_rateLimiter;
+
+
+
+/*
+ * Creates a new limiter
+ *
+ * @param rate Number of events per second passed for each signature
+ * @param burst Maximal number of events passed at once for each signature
+ * @returns Mallocated limiter on success; otherwise NULL
+ */
+T_rateLimiter *rate_limiter_new(double rate, size_t burst);
+
+
+
+/*
+ * Frees limiter's memory
+ *
+ * @param limiter A freed limiter. Can be NULL
+ */
+void rate_limiter_free(T_rateLimiter *limiter);
+
+
+
+/*
+ * Takes a token from signature's bucket
+ *
+ * @param limiter The limiter
+ * @param signature A signature of the event (see @rate_limiter_hash)
+ * @param suppressed Number of events with the same signature suppressed since
+ *        the last passed event. Filled only if the event passes. Can be NULL
+ * @returns Non zero value if the event passes; otherwise 0
+ */
+int rate_limiter_acquire(T_rateLimiter *limiter, uint64_t signature, size_t *suppressed);
+
+
+
+/*
+ * Gets total counters
+ *
+ * @param limiter The limiter
+ * @param passed Number of passed events
+ * @param suppressed Number of suppressed events
+ */
+void rate_limiter_statistics(T_rateLimiter *limiter, size_t *passed, size_t *suppressed);
+
+
+
+/* Initial value for @rate_limiter_hash */
+#define RATE_LIMITER_HASH_INIT 14695981039346656037ULL
+
+/*
+ * Mixes given bytes into a signature (FNV-1a)
+ *
+ * @param hash The signature computed so far or RATE_LIMITER_HASH_INIT
+ * @param data Mixed bytes
+ * @param size Number of mixed bytes
+ * @returns The updated signature
+ */
+uint64_t rate_limiter_hash(uint64_t hash, const void *data, size_t size);
+
+
+
+#endif // __RATE_LIMITER_H__
+
+
+
+/*
+ * finito
+ */
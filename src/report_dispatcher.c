@@ -0,0 +1,534 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "report_dispatcher.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <assert.h>
+
+
+
+/*
+ * Seconds to wait for the sinks to deliver their queues when stopping
+ */
+#ifndef REPORT_DISPATCHER_STOP_TIMEOUT
+#define REPORT_DISPATCHER_STOP_TIMEOUT 5
+#endif
+
+
+
+/*
+ * A reference counted copy of a dispatched report shared by all sinks
+ */
+typedef struct {
+    T_dispatchedReport report;
+    int references;
+    char data[];    ///< storage for the strings
+} T_queuedReport;
+
+
+
+typedef struct {
+    const char *name;
+    T_reportSinkDeliver deliver;
+    T_reportDispatcher *dispatcher;
+    pthread_t thread;
+    pthread_mutex_t deliver_mutex; ///< serializes calls of deliver
+    pthread_mutex_t mutex;       ///< guards all members below
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    T_queuedReport **queue;      ///< circular buffer
+    size_t begin;                ///< the oldest queued report
+    size_t length;               ///< number of queued reports
+    int running;                 ///< the consumer thread is alive
+    int stopping;                ///< the consumer is asked to terminate
+    size_t delivered;
+    size_t dropped;
+} T_reportSink;
+
+
+
+struct report_dispatcher {
+    size_t capacity;              ///< capacity of sink's queue
+    T_overflowPolicy policy;
+    int timeout;                  ///< milliseconds
+    T_reportSink **sinks;
+    size_t sinks_count;
+    int started;
+};
+
+
+
+T_reportDispatcher *report_dispatcher_new(size_t capacity, T_overflowPolicy policy, int timeout)
+{
+    assert(0 != capacity || !"Cannot create a dispatcher with zero capacity queues");
+
+    T_reportDispatcher *dispatcher = (T_reportDispatcher *)calloc(1, sizeof(*dispatcher));
+    if (NULL == dispatcher)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    dispatcher->capacity = capacity;
+    dispatcher->policy = policy;
+    dispatcher->timeout = timeout;
+
+    return dispatcher;
+}
+
+
+
+static void queued_report_release(T_queuedReport *queued)
+{
+    if (0 == __sync_sub_and_fetch(&queued->references, 1))
+    {
+        free(queued);
+    }
+}
+
+
+
+void report_dispatcher_free(T_reportDispatcher *dispatcher)
+{
+    if (NULL == dispatcher)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < dispatcher->sinks_count; ++i)
+    {
+        if (dispatcher->sinks[i]->running)
+        {
+            /* A consumer did not terminate in report_dispatcher_stop() and
+             * still uses the dispatcher, it is safer to leak the memory */
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot free a dispatcher with running sinks\n");
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < dispatcher->sinks_count; ++i)
+    {
+        T_reportSink *sink = dispatcher->sinks[i];
+
+        for ( ; 0 != sink->length; --sink->length)
+        {
+            queued_report_release(sink->queue[sink->begin]);
+            sink->begin = (sink->begin + 1) % dispatcher->capacity;
+        }
+
+        pthread_cond_destroy(&sink->not_full);
+        pthread_cond_destroy(&sink->not_empty);
+        pthread_mutex_destroy(&sink->mutex);
+        pthread_mutex_destroy(&sink->deliver_mutex);
+        free(sink->queue);
+        free(sink);
+    }
+
+    free(dispatcher->sinks);
+    free(dispatcher);
+}
+
+
+
+int report_dispatcher_add_sink(T_reportDispatcher *dispatcher, const char *name, T_reportSinkDeliver deliver)
+{
+    assert(!dispatcher->started || !"Cannot add a sink to a started dispatcher");
+
+    T_reportSink **sinks = (T_reportSink **)realloc(dispatcher->sinks, (dispatcher->sinks_count + 1) * sizeof(*sinks));
+    if (NULL == sinks)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": realloc(): out of memory\n");
+        return 1;
+    }
+    dispatcher->sinks = sinks;
+
+    T_reportSink *sink = (T_reportSink *)calloc(1, sizeof(*sink));
+    if (NULL == sink)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return 1;
+    }
+
+    sink->queue = (T_queuedReport **)calloc(dispatcher->capacity, sizeof(*sink->queue));
+    if (NULL == sink->queue)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        free(sink);
+        return 1;
+    }
+
+    sink->name = name;
+    sink->deliver = deliver;
+    sink->dispatcher = dispatcher;
+    pthread_mutex_init(&sink->deliver_mutex, /*use default attributes*/NULL);
+    pthread_mutex_init(&sink->mutex, /*use default attributes*/NULL);
+    pthread_cond_init(&sink->not_empty, /*use default attributes*/NULL);
+    pthread_cond_init(&sink->not_full, /*use default attributes*/NULL);
+
+    dispatcher->sinks[dispatcher->sinks_count++] = sink;
+    return 0;
+}
+
+
+
+/*
+ * Delivers a report to a sink and counts it
+ */
+static void report_sink_deliver(T_reportSink *sink, const T_dispatchedReport *report)
+{
+    pthread_mutex_lock(&sink->deliver_mutex);
+    sink->deliver(report);
+    pthread_mutex_unlock(&sink->deliver_mutex);
+
+    pthread_mutex_lock(&sink->mutex);
+    ++sink->delivered;
+    pthread_mutex_unlock(&sink->mutex);
+}
+
+
+
+/*
+ * The main function of consumer threads
+ */
+static void *report_sink_run(void *arg)
+{
+    T_reportSink *sink = (T_reportSink *)arg;
+    const size_t capacity = sink->dispatcher->capacity;
+
+    pthread_mutex_lock(&sink->mutex);
+    for (;;)
+    {
+        while (0 == sink->length && !sink->stopping)
+        {
+            pthread_cond_wait(&sink->not_empty, &sink->mutex);
+        }
+
+        if (0 == sink->length)
+        {   /* stopping and nothing to do */
+            break;
+        }
+
+        T_queuedReport *queued = sink->queue[sink->begin];
+        sink->queue[sink->begin] = NULL;
+        sink->begin = (sink->begin + 1) % capacity;
+        --sink->length;
+        pthread_cond_broadcast(&sink->not_full);
+        pthread_mutex_unlock(&sink->mutex);
+
+        report_sink_deliver(sink, &queued->report);
+        queued_report_release(queued);
+
+        pthread_mutex_lock(&sink->mutex);
+    }
+
+    sink->running = 0;
+    pthread_cond_broadcast(&sink->not_full);
+    pthread_mutex_unlock(&sink->mutex);
+
+    return NULL;
+}
+
+
+
+int report_dispatcher_start(T_reportDispatcher *dispatcher)
+{
+    int retval = 0;
+
+    for (size_t i = 0; i < dispatcher->sinks_count; ++i)
+    {
+        T_reportSink *sink = dispatcher->sinks[i];
+
+        pthread_mutex_lock(&sink->mutex);
+        sink->running = 1;
+        sink->stopping = 0;
+        pthread_mutex_unlock(&sink->mutex);
+
+        const int error = pthread_create(&sink->thread, /*use default attributes*/NULL, report_sink_run, sink);
+        if (0 != error)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot start consumer of sink '%s': %s\n", sink->name, strerror(error));
+            sink->running = 0;
+            retval = 1;
+            continue;
+        }
+
+        pthread_detach(sink->thread);
+        VERBOSE_PRINT("Started consumer of sink '%s'\n", sink->name);
+    }
+
+    dispatcher->started = 1;
+    return retval;
+}
+
+
+
+void report_dispatcher_stop(T_reportDispatcher *dispatcher)
+{
+    if (NULL == dispatcher)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < dispatcher->sinks_count; ++i)
+    {
+        T_reportSink *sink = dispatcher->sinks[i];
+
+        pthread_mutex_lock(&sink->mutex);
+        sink->stopping = 1;
+        pthread_cond_broadcast(&sink->not_empty);
+        pthread_mutex_unlock(&sink->mutex);
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += REPORT_DISPATCHER_STOP_TIMEOUT;
+
+    for (size_t i = 0; i < dispatcher->sinks_count; ++i)
+    {
+        T_reportSink *sink = dispatcher->sinks[i];
+
+        pthread_mutex_lock(&sink->mutex);
+        int error = 0;
+        while (sink->running && ETIMEDOUT != error)
+        {
+            error = pthread_cond_timedwait(&sink->not_full, &sink->mutex, &deadline);
+        }
+
+        if (sink->running)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Sink '%s' did not deliver %zu reports in time\n", sink->name, sink->length);
+        }
+        pthread_mutex_unlock(&sink->mutex);
+    }
+}
+
+
+
+/*
+ * Removes the oldest report from sink's queue
+ *
+ * @param only_caught Consider only reports of caught exceptions
+ * @returns 1 if a report was removed; otherwise 0
+ */
+static int report_sink_evict(T_reportSink *sink, int only_caught)
+{
+    const size_t capacity = sink->dispatcher->capacity;
+
+    for (size_t i = 0; i < sink->length; ++i)
+    {
+        const size_t index = (sink->begin + i) % capacity;
+        if (only_caught && sink->queue[index]->report.uncaught)
+        {
+            continue;
+        }
+
+        queued_report_release(sink->queue[index]);
+
+        /* Close the gap */
+        for ( ; i + 1 < sink->length; ++i)
+        {
+            sink->queue[(sink->begin + i) % capacity] = sink->queue[(sink->begin + i + 1) % capacity];
+        }
+
+        --sink->length;
+        sink->queue[(sink->begin + sink->length) % capacity] = NULL;
+        ++sink->dropped;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+
+/*
+ * Applies the overflow policy on a full queue
+ *
+ * @returns 1 if there is a free space in the queue; otherwise 0
+ */
+static int report_sink_make_room(T_reportSink *sink, const T_queuedReport *queued, const struct timespec *deadline)
+{
+    /* Uncaught reports have priority over caught ones */
+    if (queued->report.uncaught && report_sink_evict(sink, /*only caught*/1))
+    {
+        return 1;
+    }
+
+    switch (sink->dispatcher->policy)
+    {
+        case OVERFLOW_DROP_OLDEST:
+            return report_sink_evict(sink, /*only caught*/!queued->report.uncaught);
+
+        case OVERFLOW_BLOCK:
+            {
+                int error = 0;
+                while (sink->length == sink->dispatcher->capacity && sink->running && ETIMEDOUT != error)
+                {
+                    error = pthread_cond_timedwait(&sink->not_full, &sink->mutex, deadline);
+                }
+            }
+            return sink->length < sink->dispatcher->capacity;
+
+        case OVERFLOW_DROP_NEWEST:
+        default:
+            return 0;
+    }
+}
+
+
+
+static char *copy_string(char **storage, const char *string)
+{
+    if (NULL == string)
+    {
+        return NULL;
+    }
+
+    char *copy = strcpy(*storage, string);
+    *storage += strlen(string) + 1;
+    return copy;
+}
+
+
+
+/*
+ * Creates a reference counted copy of a report
+ */
+static T_queuedReport *queued_report_new(const T_dispatchedReport *report)
+{
+    const char *strings[] = { report->executable, report->message, report->stacktrace, report->additional_info };
+    size_t size = sizeof(T_queuedReport);
+    for (size_t i = 0; i < sizeof(strings)/sizeof(strings[0]); ++i)
+    {
+        if (NULL != strings[i])
+        {
+            size += strlen(strings[i]) + 1;
+        }
+    }
+
+    T_queuedReport *queued = (T_queuedReport *)malloc(size);
+    if (NULL == queued)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory\n");
+        return NULL;
+    }
+
+    char *storage = queued->data;
+    queued->report.executable = copy_string(&storage, report->executable);
+    queued->report.message = copy_string(&storage, report->message);
+    queued->report.stacktrace = copy_string(&storage, report->stacktrace);
+    queued->report.additional_info = copy_string(&storage, report->additional_info);
+    queued->report.uncaught = report->uncaught;
+    queued->report.suppressed = report->suppressed;
+    queued->references = 1;
+
+    return queued;
+}
+
+
+
+void report_dispatcher_dispatch(T_reportDispatcher *dispatcher, const T_dispatchedReport *report)
+{
+    assert(NULL != dispatcher || !"Cannot dispatch to NULL dispatcher");
+
+    /* The copy is created with the first queued reference; one reference is
+     * held by this function until the report is queued everywhere */
+    T_queuedReport *queued = NULL;
+
+    struct timespec deadline;
+    if (OVERFLOW_BLOCK == dispatcher->policy)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += dispatcher->timeout / 1000;
+        deadline.tv_nsec += (long)(dispatcher->timeout % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            ++deadline.tv_sec;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    for (size_t i = 0; i < dispatcher->sinks_count; ++i)
+    {
+        T_reportSink *sink = dispatcher->sinks[i];
+
+        pthread_mutex_lock(&sink->mutex);
+        if (!sink->running || sink->stopping)
+        {   /* not started yet or already stopped */
+            pthread_mutex_unlock(&sink->mutex);
+            report_sink_deliver(sink, report);
+            continue;
+        }
+
+        if (NULL == queued && NULL == (queued = queued_report_new(report)))
+        {
+            ++sink->dropped;
+        }
+        else if (sink->length == dispatcher->capacity && !report_sink_make_room(sink, queued, &deadline))
+        {
+            VERBOSE_PRINT("Queue of sink '%s' is full, dropping the report\n", sink->name);
+            ++sink->dropped;
+        }
+        else
+        {
+            __sync_add_and_fetch(&queued->references, 1);
+            sink->queue[(sink->begin + sink->length) % dispatcher->capacity] = queued;
+            ++sink->length;
+            pthread_cond_signal(&sink->not_empty);
+        }
+        pthread_mutex_unlock(&sink->mutex);
+    }
+
+    if (NULL != queued)
+    {
+        queued_report_release(queued);
+    }
+}
+
+
+
+size_t report_dispatcher_sink_count(T_reportDispatcher *dispatcher)
+{
+    return NULL == dispatcher ? 0 : dispatcher->sinks_count;
+}
+
+
+
+void report_dispatcher_sink_statistics(T_reportDispatcher *dispatcher, size_t index, T_reportSinkStatistics *statistics)
+{
+    assert(index < dispatcher->sinks_count || !"Sink index out of range");
+
+    T_reportSink *sink = dispatcher->sinks[index];
+
+    pthread_mutex_lock(&sink->mutex);
+    statistics->name = sink->name;
+    statistics->delivered = sink->delivered;
+    statistics->dropped = sink->dropped;
+    pthread_mutex_unlock(&sink->mutex);
+}
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,168 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __REPORT_DISPATCHER_H__
+#define __REPORT_DISPATCHER_H__
+
+#include "abrt-checker.h"
+
+#include <stddef.h>
+
+
+
+/*
+ * An opaque structure delivering reports to several sinks.
+ *
+ * Every sink has its own bounded queue and its own consumer thread, so a slow
+ * sink does not hold up the others. When a queue is full, the configured
+ * overflow policy is applied but uncaught exception reports always push out
+ * caught exception reports first.
+ */
+typedef struct report_dispatcher T_reportDispatcher;
+
+
+
+/*
+ * A dispatched report. All members can be NULL.
+ */
+typedef struct {
+    const char *executable;
+    const char *message;
+    const char *stacktrace;
+    const char *additional_info; ///< already formatted additional information
+    int uncaught;                ///< reports of uncaught exceptions have priority
+    size_t suppressed;           ///< number of similar reports suppressed before this one
+} T_dispatchedReport;
+
+
+
+/*
+ * A function delivering a report to a sink. Called from a single thread at
+ * once for each sink.
+ */
+typedef void (*T_reportSinkDeliver)(const T_dispatchedReport *report);
+
+
+
+/*
+ * Counters of a sink
+ */
+typedef struct {
+    const char *name;     ///< name of the sink
+    size_t delivered;     ///< number of delivered reports
+    size_t dropped;       ///< number of reports dropped due to a full queue
+} T_reportSinkStatistics;
+
+
+
+/*
+ * Creates a new dispatcher without sinks
+ *
+ * @param capacity Capacity of sink's queue
+ * @param policy What to do when a sink's queue is full
+ * @param timeout Milliseconds to wait for free space if policy is
+ *        OVERFLOW_BLOCK
+ * @returns Mallocated dispatcher on success; otherwise NULL
+ */
+T_reportDispatcher *report_dispatcher_new(size_t capacity, T_overflowPolicy policy, int timeout);
+
+
+
+/*
+ * Frees dispatcher's memory
+ *
+ * The dispatcher must be stopped by @report_dispatcher_stop before.
+ *
+ * @param dispatcher A freed dispatcher. Can be NULL
+ */
+void report_dispatcher_free(T_reportDispatcher *dispatcher);
+
+
+
+/*
+ * Adds a new sink. Sinks can be added only before the dispatcher is started.
+ *
+ * @param dispatcher The dispatcher
+ * @param name Name of the sink, must live as long as the dispatcher
+ * @param deliver A function delivering reports to the sink
+ * @returns 0 on success; otherwise non zero value
+ */
+int report_dispatcher_add_sink(T_reportDispatcher *dispatcher, const char *name, T_reportSinkDeliver deliver);
+
+
+
+/*
+ * Starts consumer threads of all sinks
+ *
+ * Reports are delivered synchronously until the dispatcher is started.
+ *
+ * @param dispatcher The dispatcher
+ * @returns 0 if all consumers were started; otherwise non zero value
+ */
+int report_dispatcher_start(T_reportDispatcher *dispatcher);
+
+
+
+/*
+ * Stops consumer threads
+ *
+ * Waits a limited time for delivery of all queued reports. Reports are
+ * delivered synchronously once the dispatcher is stopped.
+ *
+ * @param dispatcher The dispatcher. Can be NULL
+ */
+void report_dispatcher_stop(T_reportDispatcher *dispatcher);
+
+
+
+/*
+ * Queues a report for delivery to all sinks
+ *
+ * The report is copied, the caller can release it right after this call.
+ *
+ * @param dispatcher The dispatcher
+ * @param report The report
+ */
+void report_dispatcher_dispatch(T_reportDispatcher *dispatcher, const T_dispatchedReport *report);
+
+
+
+/*
+ * Returns number of sinks
+ */
+size_t report_dispatcher_sink_count(T_reportDispatcher *dispatcher);
+
+
+
+/*
+ * Gets counters of a sink
+ *
+ * @param dispatcher The dispatcher
+ * @param index Index of the sink in order of addition
+ * @param statistics Filled counters
+ */
+void report_dispatcher_sink_statistics(T_reportDispatcher *dispatcher, size_t index, T_reportSinkStatistics *statistics);
+
+
+
+#endif // __REPORT_DISPATCHER_H__
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,378 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "string_builder.h"
+#include "abrt-checker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <assert.h>
+
+
+
+/*
+ * Size of the first chunk of a builder
+ */
+#ifndef STRING_BUILDER_FIRST_CHUNK_SIZE
+#define STRING_BUILDER_FIRST_CHUNK_SIZE 1024
+#endif
+
+
+
+typedef struct string_builder_chunk {
+    struct string_builder_chunk *next;  ///< the next chunk or NULL
+    size_t size;                        ///< size of data
+    size_t length;                      ///< number of used bytes of data
+    char data[];                        ///< the characters
+} T_stringBuilderChunk;
+
+
+
+struct string_builder {
+    size_t capacity;                    ///< maximal length of the string
+    size_t length;                      ///< length of the string
+    T_stringBuilderChunk *first;        ///< the first chunk or NULL
+    T_stringBuilderChunk *current;      ///< the last used chunk or NULL
+};
+
+
+
+/* Thread specific data pointing to the builder of the thread */
+static pthread_key_t thread_builder_key;
+static pthread_once_t thread_builder_key_once = PTHREAD_ONCE_INIT;
+
+
+
+static void thread_builder_destroy(void *builder)
+{
+    string_builder_free((T_stringBuilder *)builder);
+}
+
+
+
+static void thread_builder_key_create(void)
+{
+    pthread_key_create(&thread_builder_key, &thread_builder_destroy);
+}
+
+
+
+T_stringBuilder *string_builder_new(size_t capacity)
+{
+    T_stringBuilder *builder = (T_stringBuilder *)calloc(1, sizeof(*builder));
+    if (NULL == builder)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    builder->capacity = capacity;
+    return builder;
+}
+
+
+
+void string_builder_free(T_stringBuilder *builder)
+{
+    if (NULL == builder)
+    {
+        return;
+    }
+
+    T_stringBuilderChunk *chunk = builder->first;
+    while (NULL != chunk)
+    {
+        T_stringBuilderChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(builder);
+}
+
+
+
+T_stringBuilder *string_builder_thread_local(size_t capacity)
+{
+    pthread_once(&thread_builder_key_once, thread_builder_key_create);
+
+    T_stringBuilder *builder = (T_stringBuilder *)pthread_getspecific(thread_builder_key);
+    if (NULL == builder)
+    {
+        builder = string_builder_new(capacity);
+        if (NULL == builder)
+        {
+            return NULL;
+        }
+
+        if (0 != pthread_setspecific(thread_builder_key, builder))
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot store a string builder of the thread\n");
+            string_builder_free(builder);
+            return NULL;
+        }
+    }
+
+    string_builder_reset(builder, capacity);
+    return builder;
+}
+
+
+
+void string_builder_reset(T_stringBuilder *builder, size_t capacity)
+{
+    assert(NULL != builder);
+
+    for (T_stringBuilderChunk *chunk = builder->first; NULL != chunk; chunk = chunk->next)
+    {
+        chunk->length = 0;
+    }
+
+    builder->capacity = capacity;
+    builder->length = 0;
+    builder->current = builder->first;
+}
+
+
+
+/*
+ * Returns a chunk with at least size free bytes
+ *
+ * Reuses the chunks following the current one and allocates a new chunk
+ * only if none of them is large enough. Sizes of new chunks grow
+ * geometrically.
+ */
+static T_stringBuilderChunk *string_builder_reserve(T_stringBuilder *builder, size_t size)
+{
+    T_stringBuilderChunk *chunk = builder->current;
+    if (NULL != chunk && chunk->size - chunk->length >= size)
+    {
+        return chunk;
+    }
+
+    /* Unused chunks are empty */
+    T_stringBuilderChunk *next = NULL == chunk ? builder->first : chunk->next;
+    if (NULL != next && next->size >= size)
+    {
+        builder->current = next;
+        return next;
+    }
+
+    size_t chunk_size = NULL == chunk ? STRING_BUILDER_FIRST_CHUNK_SIZE : 2 * chunk->size;
+    if (chunk_size < size)
+    {
+        chunk_size = size;
+    }
+
+    T_stringBuilderChunk *new_chunk = (T_stringBuilderChunk *)malloc(sizeof(*new_chunk) + chunk_size);
+    if (NULL == new_chunk)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory\n");
+        return NULL;
+    }
+
+    new_chunk->size = chunk_size;
+    new_chunk->length = 0;
+    new_chunk->next = next;
+
+    if (NULL == chunk)
+    {
+        builder->first = new_chunk;
+    }
+    else
+    {
+        chunk->next = new_chunk;
+    }
+
+    builder->current = new_chunk;
+    return new_chunk;
+}
+
+
+
+int string_builder_append(T_stringBuilder *builder, const char *string)
+{
+    assert(NULL != builder);
+
+    const size_t length = strlen(string);
+    if (length > builder->capacity - builder->length)
+    {
+        return 1;
+    }
+
+    T_stringBuilderChunk *chunk = string_builder_reserve(builder, length);
+    if (NULL == chunk)
+    {
+        return 1;
+    }
+
+    memcpy(chunk->data + chunk->length, string, length);
+    chunk->length += length;
+    builder->length += length;
+    return 0;
+}
+
+
+
+int string_builder_printf(T_stringBuilder *builder, const char *format, ...)
+{
+    assert(NULL != builder);
+
+    /* Try to print the string directly to the free space of the current
+     * chunk; vsnprintf() needs one more byte for the terminating zero */
+    T_stringBuilderChunk *chunk = builder->current;
+    char *free_space = NULL;
+    size_t free_size = 0;
+    if (NULL != chunk)
+    {
+        free_space = chunk->data + chunk->length;
+        free_size = chunk->size - chunk->length;
+    }
+
+    va_list args;
+    va_start(args, format);
+    const int wrote = vsnprintf(free_space, free_size, format, args);
+    va_end(args);
+
+    if (wrote < 0 || (size_t)wrote > builder->capacity - builder->length)
+    {
+        return 1;
+    }
+
+    if ((size_t)wrote >= free_size)
+    {
+        chunk = string_builder_reserve(builder, (size_t)wrote + 1);
+        if (NULL == chunk)
+        {
+            return 1;
+        }
+
+        va_start(args, format);
+        vsnprintf(chunk->data + chunk->length, chunk->size - chunk->length, format, args);
+        va_end(args);
+    }
+
+    chunk->length += (size_t)wrote;
+    builder->length += (size_t)wrote;
+    return 0;
+}
+
+
+
+void string_builder_truncate(T_stringBuilder *builder, size_t length)
+{
+    assert(NULL != builder);
+    assert(length <= builder->length);
+
+    if (NULL == builder->first)
+    {
+        return;
+    }
+
+    /* Find the chunk with the new end */
+    size_t kept = length;
+    T_stringBuilderChunk *chunk = builder->first;
+    while (kept > chunk->length)
+    {
+        kept -= chunk->length;
+        chunk = chunk->next;
+    }
+
+    for (T_stringBuilderChunk *unused = chunk->next; NULL != unused; unused = unused->next)
+    {
+        unused->length = 0;
+    }
+
+    chunk->length = kept;
+    builder->current = chunk;
+    builder->length = length;
+}
+
+
+
+size_t string_builder_length(T_stringBuilder *builder)
+{
+    assert(NULL != builder);
+
+    return builder->length;
+}
+
+
+
+/*
+ * Copies the built string to a buffer of length + 1 bytes and resets the
+ * builder
+ */
+static char *string_builder_copy(T_stringBuilder *builder, char *string)
+{
+    if (NULL == string)
+    {
+        string_builder_reset(builder, builder->capacity);
+        return NULL;
+    }
+
+    char *end = string;
+    /* Chunks after the current one are unused */
+    for (T_stringBuilderChunk *chunk = builder->first; NULL != chunk; chunk = chunk->next)
+    {
+        memcpy(end, chunk->data, chunk->length);
+        end += chunk->length;
+
+        if (chunk == builder->current)
+        {
+            break;
+        }
+    }
+    *end = '\0';
+
+    string_builder_reset(builder, builder->capacity);
+    return string;
+}
+
+
+
+char *string_builder_finish(T_stringBuilder *builder)
+{
+    assert(NULL != builder);
+
+    char *string = (char *)malloc(builder->length + 1);
+    if (NULL == string)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory\n");
+    }
+
+    return string_builder_copy(builder, string);
+}
+
+
+
+char *string_builder_finish_in(T_stringBuilder *builder, T_arena *arena)
+{
+    assert(NULL != builder);
+    assert(NULL != arena);
+
+    return string_builder_copy(builder, (char *)arena_alloc(arena, builder->length + 1));
+}
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,157 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __STRING_BUILDER_H__
+#define __STRING_BUILDER_H__
+
+
+
+#include <stddef.h>
+
+#include "arena.h"
+
+
+
+/*
+ * An opaque structure representing a string being built by appending
+ *
+ * The string is stored in a list of chunks. A chunk is never moved nor
+ * zeroed, hence an append costs only copying of the appended characters.
+ * Chunks are kept when the builder is reset and reused for the next string.
+ *
+ * The length of the string is limited by a hard cap. An append exceeding
+ * the cap fails and does not change the string, so the string never ends
+ * with a partially appended piece.
+ */
+typedef struct string_builder T_stringBuilder;
+
+
+
+/*
+ * Creates a new empty builder
+ *
+ * @param capacity Maximal length of the built string
+ * @returns Mallocated builder on success; otherwise NULL
+ */
+T_stringBuilder *string_builder_new(size_t capacity);
+
+
+
+/*
+ * Frees memory of the builder
+ *
+ * @param builder Freed builder. Can be NULL
+ */
+void string_builder_free(T_stringBuilder *builder);
+
+
+
+/*
+ * Returns a builder of the calling thread
+ *
+ * The builder is created on the first call and freed at thread exit. It is
+ * returned empty, hence it must not be used by two callers at once.
+ *
+ * @param capacity Maximal length of the built string
+ * @returns The builder or NULL if the builder cannot be created
+ */
+T_stringBuilder *string_builder_thread_local(size_t capacity);
+
+
+
+/*
+ * Removes all characters and sets new capacity
+ *
+ * @param builder The builder
+ * @param capacity Maximal length of the built string
+ */
+void string_builder_reset(T_stringBuilder *builder, size_t capacity);
+
+
+
+/*
+ * Appends a string
+ *
+ * @param builder The builder
+ * @param string Appended string
+ * @returns 0 on success; otherwise non zero value and the builder is not
+ *          changed (the capacity would be exceeded or out of memory)
+ */
+int string_builder_append(T_stringBuilder *builder, const char *string);
+
+
+
+/*
+ * Appends a formatted string
+ *
+ * @param builder The builder
+ * @param format printf() format
+ * @returns 0 on success; otherwise non zero value and the builder is not
+ *          changed (the capacity would be exceeded or out of memory)
+ */
+int string_builder_printf(T_stringBuilder *builder, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+
+
+/*
+ * Shortens the built string
+ *
+ * Allows to remove a group of appended strings which cannot be completed.
+ *
+ * @param builder The builder
+ * @param length New length, not greater than the current one
+ */
+void string_builder_truncate(T_stringBuilder *builder, size_t length);
+
+
+
+/*
+ * Returns length of the built string
+ */
+size_t string_builder_length(T_stringBuilder *builder);
+
+
+
+/*
+ * Returns the built string and resets the builder
+ *
+ * @param builder The builder
+ * @returns Mallocated string or NULL if out of memory
+ */
+char *string_builder_finish(T_stringBuilder *builder);
+
+
+
+/*
+ * Returns the built string allocated from an arena and resets the builder
+ *
+ * @param builder The builder
+ * @param arena The arena
+ * @returns The string or NULL if out of memory
+ */
+char *string_builder_finish_in(T_stringBuilder *builder, T_arena *arena);
+
+
+
+#endif // __STRING_BUILDER_H__
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,293 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "string_table.h"
+#include "abrt-checker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <assert.h>
+
+
+
+/*
+ * Number of independently locked parts of the table, must be a power of 2
+ */
+#ifndef STRING_TABLE_STRIPES
+#define STRING_TABLE_STRIPES 16
+#endif
+
+/*
+ * Initial number of hash table buckets of a stripe, must be a power of 2
+ */
+#define STRING_TABLE_INITIAL_BUCKETS 64
+
+
+
+typedef struct interned_string {
+    struct interned_string *chain;    ///< next string in the same bucket
+    uint64_t hash;                    ///< hash of text
+    char text[];                      ///< the interned string
+} T_internedString;
+
+
+
+typedef struct string_table_stripe {
+    pthread_mutex_t mutex;            ///< guards all members below
+    T_internedString **buckets;       ///< hash table of strings
+    size_t mask;                      ///< number of buckets - 1
+    size_t length;                    ///< number of strings
+    size_t hits;                      ///< number of strings found interned
+} T_stringTableStripe;
+
+
+
+struct string_table {
+    size_t memory_limit;              ///< maximal memory used by strings
+    size_t memory;                    ///< memory used by strings, updated atomically
+    T_stringTableStripe stripes[STRING_TABLE_STRIPES];
+};
+
+
+
+/*
+ * FNV-1a of the string
+ */
+static uint64_t string_table_hash(const char *string, size_t *length)
+{
+    uint64_t hash = UINT64_C(14695981039346656037);
+    const unsigned char *c = (const unsigned char *)string;
+    for ( ; '\0' != *c; ++c)
+    {
+        hash = (hash ^ *c) * UINT64_C(1099511628211);
+    }
+
+    *length = (size_t)(c - (const unsigned char *)string);
+    return hash;
+}
+
+
+
+/*
+ * The low bits select a bucket, hence the stripe is selected by the high ones
+ */
+static T_stringTableStripe *string_table_stripe(T_stringTable *table, uint64_t hash)
+{
+    return table->stripes + ((hash >> 56) & (STRING_TABLE_STRIPES - 1));
+}
+
+
+
+static size_t interned_string_size(size_t length)
+{
+    return sizeof(T_internedString) + length + 1;
+}
+
+
+
+T_stringTable *string_table_new(size_t memory_limit)
+{
+    T_stringTable *table = (T_stringTable *)calloc(1, sizeof(*table));
+    if (NULL == table)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < STRING_TABLE_STRIPES; ++i)
+    {
+        T_stringTableStripe *stripe = table->stripes + i;
+        stripe->buckets = (T_internedString **)calloc(STRING_TABLE_INITIAL_BUCKETS, sizeof(*stripe->buckets));
+        if (NULL == stripe->buckets)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+            while (i-- > 0)
+            {
+                pthread_mutex_destroy(&table->stripes[i].mutex);
+                free(table->stripes[i].buckets);
+            }
+            free(table);
+            return NULL;
+        }
+
+        stripe->mask = STRING_TABLE_INITIAL_BUCKETS - 1;
+        pthread_mutex_init(&stripe->mutex, /*use default attributes*/NULL);
+    }
+
+    table->memory_limit = memory_limit;
+
+    return table;
+}
+
+
+
+void string_table_free(T_stringTable *table)
+{
+    if (NULL == table)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < STRING_TABLE_STRIPES; ++i)
+    {
+        T_stringTableStripe *stripe = table->stripes + i;
+        for (size_t b = 0; b <= stripe->mask; ++b)
+        {
+            T_internedString *entry = stripe->buckets[b];
+            while (NULL != entry)
+            {
+                T_internedString *next = entry->chain;
+                free(entry);
+                entry = next;
+            }
+        }
+
+        pthread_mutex_destroy(&stripe->mutex);
+        free(stripe->buckets);
+    }
+
+    free(table);
+}
+
+
+
+/*
+ * Doubles the number of buckets of a stripe. The stripe keeps its buckets if
+ * there is not enough memory, only its chains get longer. Must be called
+ * with locked stripe's mutex.
+ */
+static void string_table_stripe_grow(T_stringTableStripe *stripe)
+{
+    const size_t buckets = (stripe->mask + 1) << 1;
+    T_internedString **grown = (T_internedString **)calloc(buckets, sizeof(*grown));
+    if (NULL == grown)
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__) ": cannot grow a string table\n");
+        return;
+    }
+
+    for (size_t b = 0; b <= stripe->mask; ++b)
+    {
+        T_internedString *entry = stripe->buckets[b];
+        while (NULL != entry)
+        {
+            T_internedString *next = entry->chain;
+            T_internedString **bucket = grown + (entry->hash & (buckets - 1));
+            entry->chain = *bucket;
+            *bucket = entry;
+            entry = next;
+        }
+    }
+
+    free(stripe->buckets);
+    stripe->buckets = grown;
+    stripe->mask = buckets - 1;
+}
+
+
+
+const char *string_table_intern(T_stringTable *table, const char *string)
+{
+    assert(NULL != table);
+
+    if (NULL == string)
+    {
+        return NULL;
+    }
+
+    size_t length = 0;
+    const uint64_t hash = string_table_hash(string, &length);
+    T_stringTableStripe *stripe = string_table_stripe(table, hash);
+    const char *interned = NULL;
+
+    pthread_mutex_lock(&stripe->mutex);
+
+    for (T_internedString *entry = stripe->buckets[hash & stripe->mask]; NULL != entry; entry = entry->chain)
+    {
+        if (entry->hash == hash && 0 == strcmp(entry->text, string))
+        {
+            ++stripe->hits;
+            interned = entry->text;
+            goto string_table_intern_exit;
+        }
+    }
+
+    /* The memory is shared by all stripes */
+    const size_t size = interned_string_size(length);
+    if (__sync_add_and_fetch(&table->memory, size) > table->memory_limit)
+    {
+        VERBOSE_PRINT(__FILE__ ":" STRINGIZE(__LINE__) ": the string table is full\n");
+        __sync_sub_and_fetch(&table->memory, size);
+        goto string_table_intern_exit;
+    }
+
+    T_internedString *entry = (T_internedString *)malloc(size);
+    if (NULL == entry)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": malloc(): out of memory\n");
+        __sync_sub_and_fetch(&table->memory, size);
+        goto string_table_intern_exit;
+    }
+
+    entry->hash = hash;
+    memcpy(entry->text, string, length + 1);
+
+    if (stripe->length > stripe->mask)
+    {
+        string_table_stripe_grow(stripe);
+    }
+
+    T_internedString **bucket = stripe->buckets + (hash & stripe->mask);
+    entry->chain = *bucket;
+    *bucket = entry;
+    ++stripe->length;
+    interned = entry->text;
+
+string_table_intern_exit:
+    pthread_mutex_unlock(&stripe->mutex);
+
+    return interned;
+}
+
+
+
+void string_table_statistics(T_stringTable *table, size_t *hits, size_t *misses, size_t *memory)
+{
+    assert(NULL != table);
+
+    *hits = 0;
+    *misses = 0;
+    for (size_t i = 0; i < STRING_TABLE_STRIPES; ++i)
+    {
+        T_stringTableStripe *stripe = table->stripes + i;
+        pthread_mutex_lock(&stripe->mutex);
+        *hits += stripe->hits;
+        *misses += stripe->length;
+        pthread_mutex_unlock(&stripe->mutex);
+    }
+
+    *memory = __sync_add_and_fetch(&table->memory, 0);
+}
+
+
+
+/*
+ * finito
+ */
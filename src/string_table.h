@@ -0,0 +1,89 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __STRING_TABLE_H__
+#define __STRING_TABLE_H__
+
+#include <stddef.h>
+
+
+
+/*
+ * An opaque structure interning strings
+ *
+ * Each distinct string is stored only once and the stored copy lives as long
+ * as the table. Interned strings can therefore be shared by any number of
+ * reports and cache entries and compared by their addresses.
+ *
+ * The table is split into independently locked stripes, so threads interning
+ * different strings rarely wait for each other. Strings are never removed,
+ * hence the table is limited by the memory used by the strings.
+ */
+typedef struct string_table T_stringTable;
+
+
+
+/*
+ * Creates a new empty table
+ *
+ * @param memory_limit Maximal number of bytes used by interned strings
+ * @returns Mallocated table on success; otherwise NULL
+ */
+T_stringTable *string_table_new(size_t memory_limit);
+
+
+
+/*
+ * Frees table's memory including all interned strings
+ *
+ * @param table A freed table. Can be NULL
+ */
+void string_table_free(T_stringTable *table);
+
+
+
+/*
+ * Returns the interned copy of a string
+ *
+ * @param table The table
+ * @param string An interned string. Can be NULL.
+ * @returns The interned copy which is valid until the table is freed or NULL
+ *          if @string is NULL or the copy could not be created
+ */
+const char *string_table_intern(T_stringTable *table, const char *string);
+
+
+
+/*
+ * Gets table's counters
+ *
+ * @param table The table
+ * @param hits Number of strings found already interned
+ * @param misses Number of newly interned strings
+ * @param memory Number of bytes used by interned strings
+ */
+void string_table_statistics(T_stringTable *table, size_t *hits, size_t *misses, size_t *memory);
+
+
+
+#endif // __STRING_TABLE_H__
+
+
+
+/*
+ * finito
+ */
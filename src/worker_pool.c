@@ -0,0 +1,422 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include "worker_pool.h"
+#include "abrt-checker.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <assert.h>
+
+
+
+/*
+ * Seconds to wait for the workers to finish their queues when stopping
+ */
+#ifndef WORKER_POOL_STOP_TIMEOUT
+#define WORKER_POOL_STOP_TIMEOUT 5
+#endif
+
+/*
+ * Name of Java threads running the workers
+ */
+#define WORKER_THREAD_NAME_FORMAT "abrt-java-connector worker %zu"
+
+
+
+typedef struct {
+    T_workerPool *pool;     ///< owning pool
+    pthread_mutex_t mutex;  ///< guards all members below
+    pthread_cond_t cond;    ///< signals new jobs and termination
+    void **jobs;            ///< circular buffer of queued jobs
+    size_t begin;           ///< the oldest queued job
+    size_t length;          ///< number of queued jobs
+    int running;            ///< the worker thread is alive
+    int stopping;           ///< the worker is asked to terminate
+} T_worker;
+
+
+
+struct worker_pool {
+    T_workerPoolProcess process; ///< job processing function
+    T_workerPoolDiscard discard; ///< job releasing function or NULL
+    size_t dropped;              ///< number of dropped jobs, atomic
+    size_t capacity;             ///< capacity of worker's queue
+    size_t count;                ///< number of workers
+    T_worker *workers;           ///< the workers
+};
+
+
+
+/* Thread specific data pointing to the worker running on the thread */
+static pthread_key_t worker_key;
+static pthread_once_t worker_key_once = PTHREAD_ONCE_INIT;
+
+
+
+static void worker_key_create(void)
+{
+    pthread_key_create(&worker_key, /*no destructor*/NULL);
+}
+
+
+
+T_workerPool *worker_pool_new(size_t workers, size_t capacity, T_workerPoolProcess process, T_workerPoolDiscard discard)
+{
+    assert(0 != workers || !"Cannot create a pool without workers");
+    assert(0 != capacity || !"Cannot create a pool with zero capacity queues");
+
+    pthread_once(&worker_key_once, worker_key_create);
+
+    T_workerPool *pool = (T_workerPool *)calloc(1, sizeof(*pool));
+    if (NULL == pool)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        return NULL;
+    }
+
+    pool->workers = (T_worker *)calloc(workers, sizeof(*pool->workers));
+    if (NULL == pool->workers)
+    {
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+        free(pool);
+        return NULL;
+    }
+
+    pool->process = process;
+    pool->discard = discard;
+    pool->capacity = capacity;
+
+    for ( ; pool->count < workers; ++pool->count)
+    {
+        T_worker *worker = pool->workers + pool->count;
+        worker->jobs = (void **)calloc(capacity, sizeof(*worker->jobs));
+        if (NULL == worker->jobs)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": calloc() error\n");
+            worker_pool_free(pool);
+            return NULL;
+        }
+
+        worker->pool = pool;
+        pthread_mutex_init(&worker->mutex, /*use default attributes*/NULL);
+        pthread_cond_init(&worker->cond, /*use default attributes*/NULL);
+    }
+
+    return pool;
+}
+
+
+
+int worker_pool_free(T_workerPool *pool)
+{
+    if (NULL == pool)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < pool->count; ++i)
+    {
+        if (pool->workers[i].running)
+        {
+            /* A worker did not terminate in worker_pool_stop() and still
+             * uses the pool, it is safer to leak the memory */
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot free a pool with running workers\n");
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; i < pool->count; ++i)
+    {
+        T_worker *worker = pool->workers + i;
+
+        pthread_cond_destroy(&worker->cond);
+        pthread_mutex_destroy(&worker->mutex);
+        free(worker->jobs);
+    }
+
+    free(pool->workers);
+    free(pool);
+    return 0;
+}
+
+
+
+/*
+ * Removes the oldest job from worker's queue. Must be called with locked
+ * worker's mutex.
+ */
+static void *worker_pop(T_worker *worker)
+{
+    if (0 == worker->length)
+    {
+        return NULL;
+    }
+
+    void *job = worker->jobs[worker->begin];
+    worker->jobs[worker->begin] = NULL;
+    worker->begin = (worker->begin + 1) % worker->pool->capacity;
+    --worker->length;
+
+    return job;
+}
+
+
+
+/*
+ * The main function of agent threads
+ */
+static void JNICALL worker_pool_run(jvmtiEnv *jvmti_env, JNIEnv *jni_env, void *arg)
+{
+    T_worker *worker = (T_worker *)arg;
+
+    pthread_setspecific(worker_key, worker);
+
+    pthread_mutex_lock(&worker->mutex);
+    for (;;)
+    {
+        while (0 == worker->length && !worker->stopping)
+        {
+            pthread_cond_wait(&worker->cond, &worker->mutex);
+        }
+
+        void *job = worker_pop(worker);
+        if (NULL == job)
+        {   /* stopping and nothing to do */
+            break;
+        }
+
+        pthread_mutex_unlock(&worker->mutex);
+        worker->pool->process(jvmti_env, jni_env, job);
+        pthread_mutex_lock(&worker->mutex);
+    }
+
+    worker->running = 0;
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+
+    pthread_setspecific(worker_key, NULL);
+}
+
+
+
+/*
+ * Creates a new instance of java.lang.Thread for an agent thread
+ */
+static jthread worker_pool_new_thread_object(JNIEnv *jni_env, const char *name)
+{
+    jthread thread = NULL;
+
+    jclass thread_class = (*jni_env)->FindClass(jni_env, "java/lang/Thread");
+    if ((*jni_env)->ExceptionCheck(jni_env) || NULL == thread_class)
+    {
+        (*jni_env)->ExceptionClear(jni_env);
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot find java.lang.Thread class\n");
+        return NULL;
+    }
+
+    jmethodID constructor = (*jni_env)->GetMethodID(jni_env, thread_class, "<init>", "(Ljava/lang/String;)V");
+    if ((*jni_env)->ExceptionCheck(jni_env) || NULL == constructor)
+    {
+        (*jni_env)->ExceptionClear(jni_env);
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot find java.lang.Thread(Ljava/lang/String;) constructor\n");
+        goto worker_pool_new_thread_object_cleanup;
+    }
+
+    jstring thread_name = (*jni_env)->NewStringUTF(jni_env, name);
+    if ((*jni_env)->ExceptionCheck(jni_env) || NULL == thread_name)
+    {
+        (*jni_env)->ExceptionClear(jni_env);
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot create a name of thread\n");
+        goto worker_pool_new_thread_object_cleanup;
+    }
+
+    thread = (*jni_env)->NewObject(jni_env, thread_class, constructor, thread_name);
+    if ((*jni_env)->ExceptionCheck(jni_env))
+    {
+        (*jni_env)->ExceptionClear(jni_env);
+        fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot create an instance of java.lang.Thread\n");
+        thread = NULL;
+    }
+
+    (*jni_env)->DeleteLocalRef(jni_env, thread_name);
+
+worker_pool_new_thread_object_cleanup:
+    (*jni_env)->DeleteLocalRef(jni_env, thread_class);
+    return thread;
+}
+
+
+
+size_t worker_pool_start(T_workerPool *pool, jvmtiEnv *jvmti_env, JNIEnv *jni_env)
+{
+    assert(NULL != pool || !"Cannot start NULL pool");
+
+    size_t started = 0;
+    for (size_t i = 0; i < pool->count; ++i)
+    {
+        T_worker *worker = pool->workers + i;
+
+        char name[sizeof(WORKER_THREAD_NAME_FORMAT) + sizeof(size_t) * 3];
+        snprintf(name, sizeof(name), WORKER_THREAD_NAME_FORMAT, i);
+
+        jthread thread = worker_pool_new_thread_object(jni_env, name);
+        if (NULL == thread)
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&worker->mutex);
+        worker->running = 1;
+        worker->stopping = 0;
+        pthread_mutex_unlock(&worker->mutex);
+
+        jvmtiError error_code = (*jvmti_env)->RunAgentThread(jvmti_env, thread, worker_pool_run, worker, JVMTI_THREAD_NORM_PRIORITY);
+        if (JVMTI_ERROR_NONE != error_code)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Cannot run agent thread '%s': %d\n", name, error_code);
+
+            pthread_mutex_lock(&worker->mutex);
+            worker->running = 0;
+            pthread_mutex_unlock(&worker->mutex);
+        }
+        else
+        {
+            VERBOSE_PRINT("Started agent thread '%s'\n", name);
+            ++started;
+        }
+
+        (*jni_env)->DeleteLocalRef(jni_env, thread);
+    }
+
+    return started;
+}
+
+
+
+void worker_pool_stop(T_workerPool *pool, jvmtiEnv *jvmti_env __UNUSED_VAR, JNIEnv *jni_env)
+{
+    if (NULL == pool)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < pool->count; ++i)
+    {
+        T_worker *worker = pool->workers + i;
+
+        pthread_mutex_lock(&worker->mutex);
+        worker->stopping = 1;
+        pthread_cond_broadcast(&worker->cond);
+        pthread_mutex_unlock(&worker->mutex);
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += WORKER_POOL_STOP_TIMEOUT;
+
+    for (size_t i = 0; i < pool->count; ++i)
+    {
+        T_worker *worker = pool->workers + i;
+
+        pthread_mutex_lock(&worker->mutex);
+        int error = 0;
+        while (worker->running && ETIMEDOUT != error)
+        {
+            error = pthread_cond_timedwait(&worker->cond, &worker->mutex, &deadline);
+        }
+
+        if (worker->running)
+        {
+            fprintf(stderr, __FILE__ ":" STRINGIZE(__LINE__) ": Worker %zu did not finish in time, %zu jobs dropped\n", i, worker->length);
+        }
+
+        /* The deadline has passed; processing the left jobs here could hold
+         * the caller for an unlimited time. */
+        void *job = NULL;
+        while (NULL != (job = worker_pop(worker)))
+        {
+            __sync_fetch_and_add(&pool->dropped, 1);
+            if (NULL != pool->discard)
+            {
+                pool->discard(jni_env, job);
+            }
+        }
+
+        pthread_mutex_unlock(&worker->mutex);
+    }
+}
+
+
+
+T_workerPoolSubmitResult worker_pool_submit(T_workerPool *pool, jlong key, void *job)
+{
+    if (NULL == pool)
+    {
+        return WORKER_POOL_NOT_RUNNING;
+    }
+
+    T_worker *worker = pool->workers + ((uint64_t)key % pool->count);
+    T_workerPoolSubmitResult retval = WORKER_POOL_NOT_RUNNING;
+
+    pthread_mutex_lock(&worker->mutex);
+    if (!worker->running || worker->stopping)
+    {
+        retval = WORKER_POOL_NOT_RUNNING;
+    }
+    else if (worker->length >= pool->capacity)
+    {
+        __sync_fetch_and_add(&pool->dropped, 1);
+        retval = WORKER_POOL_FULL;
+    }
+    else
+    {
+        worker->jobs[(worker->begin + worker->length) % pool->capacity] = job;
+        ++worker->length;
+        pthread_cond_signal(&worker->cond);
+        retval = WORKER_POOL_QUEUED;
+    }
+    pthread_mutex_unlock(&worker->mutex);
+
+    return retval;
+}
+
+
+
+void worker_pool_statistics(T_workerPool *pool, size_t *dropped)
+{
+    assert(NULL != pool);
+
+    *dropped = __sync_fetch_and_add(&pool->dropped, 0);
+}
+
+
+
+int worker_pool_is_worker_thread(void)
+{
+    pthread_once(&worker_key_once, worker_key_create);
+    return NULL != pthread_getspecific(worker_key);
+}
+
+
+
+/*
+ * finito
+ */
@@ -0,0 +1,168 @@
+/*
+ *  Copyright (C) RedHat inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+
+
+/*
+ * JNI and JVMTI types
+ */
+#include <jni.h>
+#include <jvmti.h>
+
+
+
+/*
+ * An opaque structure representing a pool of JVMTI agent threads processing
+ * submitted jobs.
+ *
+ * Every worker has its own bounded FIFO queue. Queued jobs submitted with the
+ * same key are always processed by the same worker, hence in the order of
+ * submission.
+ */
+typedef struct worker_pool T_workerPool;
+
+
+
+/*
+ * A function processing a single job on a worker thread
+ *
+ * The function takes ownership of the job.
+ */
+typedef void (*T_workerPoolProcess)(jvmtiEnv *jvmti_env, JNIEnv *jni_env, void *job);
+
+
+
+/*
+ * A function releasing a job which is not going to be processed
+ */
+typedef void (*T_workerPoolDiscard)(JNIEnv *jni_env, void *job);
+
+
+
+/*
+ * Results of @worker_pool_submit
+ */
+typedef enum {
+    WORKER_POOL_QUEUED = 0,     ///< the job was queued and the pool took its ownership
+    WORKER_POOL_NOT_RUNNING,    ///< the pool is not running or is stopping
+    WORKER_POOL_FULL,           ///< the queue of the selected worker is full
+} T_workerPoolSubmitResult;
+
+
+
+/*
+ * Creates a new pool of stopped workers
+ *
+ * @param workers Number of worker threads
+ * @param capacity Maximal number of jobs waiting in a queue of a worker
+ * @param process A function processing the jobs
+ * @param discard A function releasing jobs left queued when the pool is
+ *        stopped. Can be NULL if jobs need no release.
+ * @returns Mallocated pool on success; otherwise NULL
+ */
+T_workerPool *worker_pool_new(size_t workers, size_t capacity, T_workerPoolProcess process, T_workerPoolDiscard discard);
+
+
+
+/*
+ * Frees pool's memory
+ *
+ * The pool must be stopped by @worker_pool_stop before. A pool whose workers
+ * did not terminate is left allocated because the workers still use it.
+ *
+ * @param pool A freed pool. Can be NULL
+ * @returns 0 if the pool was freed; otherwise non zero value
+ */
+int worker_pool_free(T_workerPool *pool);
+
+
+
+/*
+ * Starts the worker threads
+ *
+ * Agent threads can be started only in the live phase (i.e. in VMInit
+ * callback or later).
+ *
+ * @param pool The pool
+ * @param jvmti_env JVMTI environment
+ * @param jni_env JNI environment of the current thread
+ * @returns Number of started workers
+ */
+size_t worker_pool_start(T_workerPool *pool, jvmtiEnv *jvmti_env, JNIEnv *jni_env);
+
+
+
+/*
+ * Stops the workers
+ *
+ * Lets the workers process all queued jobs and waits for their termination
+ * for a limited time. Jobs which are still queued after the time limit are
+ * discarded and counted as dropped, so the caller is never held up longer.
+ *
+ * @param pool The pool
+ * @param jvmti_env JVMTI environment
+ * @param jni_env JNI environment of the current thread
+ */
+void worker_pool_stop(T_workerPool *pool, jvmtiEnv *jvmti_env, JNIEnv *jni_env);
+
+
+
+/*
+ * Queues a job
+ *
+ * @param pool The pool
+ * @param key A key selecting the worker (e.g. thread ID)
+ * Jobs rejected because of a full queue are counted as dropped.
+ *
+ * @param job A submitted job
+ * @returns WORKER_POOL_QUEUED if the pool took ownership of the job;
+ *          otherwise the caller keeps the job
+ */
+T_workerPoolSubmitResult worker_pool_submit(T_workerPool *pool, jlong key, void *job);
+
+
+
+/*
+ * Gets pool's counters
+ *
+ * @param pool The pool
+ * @param dropped Number of jobs rejected by full queues or discarded when
+ *        the pool was stopped
+ */
+void worker_pool_statistics(T_workerPool *pool, size_t *dropped);
+
+
+
+/*
+ * Checks whether the current thread is a worker of any pool
+ *
+ * @returns Non zero value if the current thread is a worker; otherwise 0
+ */
+int worker_pool_is_worker_thread(void);
+
+
+
+#endif // __WORKER_POOL_H__
+
+
+
+/*
+ * finito
+ */
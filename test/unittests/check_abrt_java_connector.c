@@ -1,7 +1,23 @@
 #include "abrt-checker.h"
 #include "internal_libabrt.h"
+#include "exception_matcher.h"
+#include "report_dispatcher.h"
+#include "rate_limiter.h"
+#include "fingerprint_set.h"
+#include "jthread_map.h"
+#include "class_location_cache.h"
+#include "frame_cache.h"
+#include "class_index.h"
+#include "debug_methods.h"
+#include "string_builder.h"
+#include "line_number_cache.h"
+#include "arena.h"
+#include "string_table.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
 #include <check.h>
 
 void assert_str_vector_eq(const char **expected, const char **tested)
@@ -37,6 +53,16 @@ void assert_conf_populated(T_configuration *conf)
     ck_assert(conf->fqdnDebugMethods != NULL);
     const char *debugMethods[] = { "n.s.cls.M1", "n.s.cls2.M2", "n.s.cls3.M3", NULL };
     assert_str_vector_eq((const char **)debugMethods, (const char **)conf->fqdnDebugMethods);
+
+    ck_assert_int_eq(conf->overflowPolicy, OVERFLOW_BLOCK);
+    ck_assert_int_eq(conf->overflowTimeout, 250);
+    ck_assert_int_eq(conf->statistics, 1);
+    ck_assert(conf->rateLimit == 2.5);
+    ck_assert_int_eq(conf->rateLimitBurst, 5);
+    ck_assert_int_eq(conf->debugMethodTimeout, 300);
+    ck_assert_int_eq(conf->debugMethodTTL, 5000);
+    ck_assert_int_eq(conf->stackTraceMode, STACK_TRACE_JVMTI);
+    ck_assert_int_eq(conf->stackTraceDepth, 64);
 }
 
 START_TEST(test_config_file_all_entries_populated)
@@ -61,7 +87,9 @@ START_TEST(test_command_line_conf_all_entries_populated)
 
     char *opts = strdup(
             "abrt=on,syslog=on,journald=off,executable=threadclass,output=test.log,"
-            "caught=n.s.Ex1:n.s.Ex2:n.s.Ex3,debugmethod=n.s.cls.M1:n.s.cls2.M2:n.s.cls3.M3");
+            "caught=n.s.Ex1:n.s.Ex2:n.s.Ex3,debugmethod=n.s.cls.M1:n.s.cls2.M2:n.s.cls3.M3,"
+            "overflow=block,overflowtimeout=250,statistics=on,ratelimit=2.5,burst=5,"
+            "debugmethodtimeout=300,debugmethodttl=5000,stacktrace=jvmti,stacktracedepth=64");
 
     ck_assert_msg(NULL != opts, "Out of memory");
 
@@ -82,7 +110,9 @@ START_TEST(test_conf_file_no_overwrite)
 
     char *opts = strdup(
             "abrt=off,syslog=off,journald=on,executable=mainclass,output=,"
-            "conffile=,caught=,debugmethod=");
+            "conffile=,caught=,debugmethod=,overflow=dropoldest,overflowtimeout=0,"
+            "statistics=off,ratelimit=0,burst=1,debugmethodtimeout=0,debugmethodttl=0,"
+            "stacktrace=java,stacktracedepth=1");
 
     ck_assert_msg(NULL != opts, "Out of memory");
 
@@ -107,10 +137,1060 @@ START_TEST(test_conf_file_no_overwrite)
 
     ck_assert(NULL == conf.fqdnDebugMethods);
 
+    ck_assert_int_eq(conf.overflowPolicy, OVERFLOW_DROP_OLDEST);
+    ck_assert_int_eq(conf.overflowTimeout, 0);
+    ck_assert_int_eq(conf.statistics, 0);
+    ck_assert(conf.rateLimit == 0);
+    ck_assert_int_eq(conf.rateLimitBurst, 1);
+    ck_assert_int_eq(conf.debugMethodTimeout, 0);
+    ck_assert_int_eq(conf.debugMethodTTL, 0);
+    ck_assert_int_eq(conf.stackTraceMode, STACK_TRACE_JAVA);
+    ck_assert_int_eq(conf.stackTraceDepth, 1);
+
     configuration_destroy(&conf);
 }
 END_TEST
 
+START_TEST(test_exception_matcher_names)
+{
+    const char *patterns[] = { "n.s.Ex1", "n.s.pkg.*", "n.s.Base+", NULL };
+
+    mark_point();
+    T_exceptionMatcher *matcher = exception_matcher_new(patterns);
+    ck_assert_msg(NULL != matcher, "Out of memory");
+
+    /* exact names */
+    ck_assert(exception_matcher_match_name(matcher, "n.s.Ex1"));
+    ck_assert(exception_matcher_match_name(matcher, "Ln/s/Ex1;"));
+    ck_assert(!exception_matcher_match_name(matcher, "n.s.Ex"));
+    ck_assert(!exception_matcher_match_name(matcher, "n.s.Ex11"));
+    ck_assert(!exception_matcher_match_name(matcher, "n.s"));
+
+    /* package wildcards */
+    ck_assert(exception_matcher_match_name(matcher, "n.s.pkg.Ex2"));
+    ck_assert(exception_matcher_match_name(matcher, "n.s.pkg.sub.Ex3"));
+    ck_assert(exception_matcher_match_name(matcher, "Ln/s/pkg/Ex2;"));
+    ck_assert(!exception_matcher_match_name(matcher, "n.s.pkg"));
+    ck_assert(!exception_matcher_match_name(matcher, "n.s.pkgs.Ex2"));
+
+    /* subclass patterns match their base class by name */
+    ck_assert(exception_matcher_match_name(matcher, "n.s.Base"));
+    ck_assert(!exception_matcher_match_name(matcher, "n.s.Derived"));
+
+    exception_matcher_free(matcher, /*no JNI*/NULL);
+}
+END_TEST
+
+START_TEST(test_exception_matcher_match_all)
+{
+    const char *patterns[] = { "*", NULL };
+
+    mark_point();
+    T_exceptionMatcher *matcher = exception_matcher_new(patterns);
+    ck_assert_msg(NULL != matcher, "Out of memory");
+
+    ck_assert(exception_matcher_match_name(matcher, "Ex"));
+    ck_assert(exception_matcher_match_name(matcher, "n.s.Ex"));
+
+    exception_matcher_free(matcher, /*no JNI*/NULL);
+}
+END_TEST
+
+static pthread_mutex_t sink_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sink_cond = PTHREAD_COND_INITIALIZER;
+static int sink_open;
+static int sink_entered;
+static char sink_delivered[16];
+
+static void blocking_sink(const T_dispatchedReport *report)
+{
+    pthread_mutex_lock(&sink_mutex);
+    ++sink_entered;
+    pthread_cond_broadcast(&sink_cond);
+
+    while (!sink_open)
+    {
+        pthread_cond_wait(&sink_cond, &sink_mutex);
+    }
+
+    strncat(sink_delivered, report->message, sizeof(sink_delivered) - strlen(sink_delivered) - 1);
+    pthread_mutex_unlock(&sink_mutex);
+}
+
+static void dispatch_message(T_reportDispatcher *dispatcher, const char *message, int uncaught)
+{
+    const T_dispatchedReport report = { .message = message, .uncaught = uncaught };
+    report_dispatcher_dispatch(dispatcher, &report);
+}
+
+START_TEST(test_report_dispatcher_overflow)
+{
+    T_reportDispatcher *dispatcher = report_dispatcher_new(2, OVERFLOW_DROP_OLDEST, 0);
+    ck_assert_msg(NULL != dispatcher, "Out of memory");
+    ck_assert_int_eq(report_dispatcher_add_sink(dispatcher, "test", blocking_sink), 0);
+    ck_assert_int_eq(report_dispatcher_start(dispatcher), 0);
+
+    mark_point();
+    /* Wait until the sink blocks on the first report */
+    dispatch_message(dispatcher, "A", /*uncaught*/0);
+    pthread_mutex_lock(&sink_mutex);
+    while (0 == sink_entered)
+    {
+        pthread_cond_wait(&sink_cond, &sink_mutex);
+    }
+    pthread_mutex_unlock(&sink_mutex);
+
+    dispatch_message(dispatcher, "B", /*uncaught*/0);
+    dispatch_message(dispatcher, "C", /*uncaught*/0);
+    /* Full queue: pushes out B */
+    dispatch_message(dispatcher, "D", /*uncaught*/0);
+    /* Uncaught reports push out caught ones: C and D */
+    dispatch_message(dispatcher, "E", /*uncaught*/1);
+    dispatch_message(dispatcher, "F", /*uncaught*/1);
+    /* Caught report cannot push out uncaught ones */
+    dispatch_message(dispatcher, "G", /*uncaught*/0);
+
+    pthread_mutex_lock(&sink_mutex);
+    sink_open = 1;
+    pthread_cond_broadcast(&sink_cond);
+    pthread_mutex_unlock(&sink_mutex);
+
+    mark_point();
+    report_dispatcher_stop(dispatcher);
+
+    /* Delivered synchronously */
+    dispatch_message(dispatcher, "H", /*uncaught*/0);
+
+    ck_assert_str_eq(sink_delivered, "AEFH");
+
+    T_reportSinkStatistics stats;
+    report_dispatcher_sink_statistics(dispatcher, 0, &stats);
+    ck_assert_str_eq(stats.name, "test");
+    ck_assert_int_eq(stats.delivered, 4);
+    ck_assert_int_eq(stats.dropped, 4);
+
+    report_dispatcher_free(dispatcher);
+}
+END_TEST
+
+START_TEST(test_rate_limiter_burst)
+{
+    T_rateLimiter *limiter = rate_limiter_new(1000, 2);
+    ck_assert_msg(NULL != limiter, "Out of memory");
+
+    size_t suppressed = 10;
+    ck_assert(rate_limiter_acquire(limiter, 1, &suppressed));
+    ck_assert_int_eq(suppressed, 0);
+    ck_assert(rate_limiter_acquire(limiter, 1, &suppressed));
+    ck_assert(!rate_limiter_acquire(limiter, 1, &suppressed));
+    ck_assert(!rate_limiter_acquire(limiter, 1, &suppressed));
+
+    /* Other signatures have their own buckets */
+    ck_assert(rate_limiter_acquire(limiter, 2, &suppressed));
+    ck_assert_int_eq(suppressed, 0);
+
+    /* Enough time to refill the bucket */
+    const struct timespec delay = { .tv_sec = 0, .tv_nsec = 10000000 };
+    nanosleep(&delay, NULL);
+
+    ck_assert(rate_limiter_acquire(limiter, 1, &suppressed));
+    ck_assert_int_eq(suppressed, 2);
+
+    size_t passed = 0;
+    rate_limiter_statistics(limiter, &passed, &suppressed);
+    ck_assert_int_eq(passed, 4);
+    ck_assert_int_eq(suppressed, 2);
+
+    rate_limiter_free(limiter);
+}
+END_TEST
+
+START_TEST(test_rate_limiter_hash)
+{
+    const uint64_t first = rate_limiter_hash(RATE_LIMITER_HASH_INIT, "Ljava/io/IOException;", 21);
+    ck_assert(first == rate_limiter_hash(RATE_LIMITER_HASH_INIT, "Ljava/io/IOException;", 21));
+    ck_assert(first != rate_limiter_hash(RATE_LIMITER_HASH_INIT, "Ljava/io/EOFException;", 22));
+
+    const long location = 42;
+    ck_assert(first != rate_limiter_hash(first, &location, sizeof(location)));
+}
+END_TEST
+
+START_TEST(test_fingerprint_set_insert)
+{
+    T_fingerprintSet *set = fingerprint_set_new(64, 0);
+    ck_assert_msg(NULL != set, "Out of memory");
+
+    ck_assert(!fingerprint_set_contains(set, 42));
+    ck_assert(fingerprint_set_insert(set, 42, NULL));
+    ck_assert(fingerprint_set_contains(set, 42));
+    ck_assert(!fingerprint_set_insert(set, 42, NULL));
+
+    /* 0 is a valid fingerprint */
+    ck_assert(fingerprint_set_insert(set, 0, NULL));
+    ck_assert(fingerprint_set_contains(set, 0));
+
+    size_t hits = 0;
+    size_t evictions = 0;
+    fingerprint_set_statistics(set, &hits, &evictions);
+    ck_assert_int_eq(hits, 3);
+    ck_assert_int_eq(evictions, 0);
+
+    fingerprint_set_free(set);
+}
+END_TEST
+
+START_TEST(test_fingerprint_set_expiry)
+{
+    T_fingerprintSet *set = fingerprint_set_new(64, 1);
+    ck_assert_msg(NULL != set, "Out of memory");
+
+    size_t duplicates = 42;
+    ck_assert(fingerprint_set_insert(set, 42, &duplicates));
+    ck_assert_int_eq(duplicates, 0);
+    ck_assert(fingerprint_set_contains(set, 42));
+    ck_assert(fingerprint_set_contains(set, 42));
+    ck_assert(!fingerprint_set_insert(set, 42, &duplicates));
+
+    /* Let the fingerprint expire */
+    const struct timespec delay = { .tv_sec = 1, .tv_nsec = 100000000 };
+    nanosleep(&delay, NULL);
+
+    ck_assert(!fingerprint_set_contains(set, 42));
+    ck_assert(fingerprint_set_insert(set, 42, &duplicates));
+    ck_assert_int_eq(duplicates, 3);
+
+    /* Renewed */
+    ck_assert(fingerprint_set_contains(set, 42));
+    ck_assert(!fingerprint_set_insert(set, 42, NULL));
+
+    fingerprint_set_free(set);
+}
+END_TEST
+
+START_TEST(test_fingerprint_set_eviction)
+{
+    T_fingerprintSet *set = fingerprint_set_new(64, 0);
+    ck_assert_msg(NULL != set, "Out of memory");
+
+    /* Keep 42 referenced while filling the set far over its capacity */
+    ck_assert(fingerprint_set_insert(set, 42, NULL));
+    for (uint64_t i = 1000; i < 2000; ++i)
+    {
+        ck_assert(fingerprint_set_contains(set, 42));
+        fingerprint_set_insert(set, i * 0x9E3779B97F4A7C15ULL, NULL);
+    }
+
+    ck_assert(fingerprint_set_contains(set, 42));
+
+    size_t hits = 0;
+    size_t evictions = 0;
+    fingerprint_set_statistics(set, &hits, &evictions);
+    ck_assert(evictions > 0);
+
+    fingerprint_set_free(set);
+}
+END_TEST
+
+START_TEST(test_jthread_map_push_pop)
+{
+    T_jthreadMap *map = jthread_map_new();
+    ck_assert_msg(NULL != map, "Out of memory");
+    ck_assert(jthread_map_empty(map));
+
+    /* Enough items to resize the segments several times */
+    static char items[1000];
+    for (size_t i = 0; i < sizeof(items); ++i)
+    {
+        jthread_map_push(map, (jlong)i, items + i);
+    }
+
+    /* Existing items are not replaced */
+    jthread_map_push(map, 0, items + 1);
+
+    ck_assert_int_eq(jthread_map_size(map), sizeof(items));
+    for (size_t i = 0; i < sizeof(items); ++i)
+    {
+        ck_assert(items + i == jthread_map_get(map, (jlong)i));
+    }
+
+    for (size_t i = 0; i < sizeof(items); i += 2)
+    {
+        ck_assert(items + i == jthread_map_pop(map, (jlong)i));
+        ck_assert(NULL == jthread_map_pop(map, (jlong)i));
+    }
+
+    /* Removal must not break probe sequences of the left items */
+    for (size_t i = 1; i < sizeof(items); i += 2)
+    {
+        ck_assert(items + i == jthread_map_get(map, (jlong)i));
+    }
+
+    ck_assert_int_eq(jthread_map_size(map), sizeof(items) / 2);
+
+    for (size_t i = 1; i < sizeof(items); i += 2)
+    {
+        ck_assert(items + i == jthread_map_pop(map, (jlong)i));
+    }
+
+    ck_assert(jthread_map_empty(map));
+
+    jthread_map_free(map);
+}
+END_TEST
+
+START_TEST(test_jthread_map_snapshot)
+{
+    T_jthreadMap *map = jthread_map_new();
+    ck_assert_msg(NULL != map, "Out of memory");
+
+    T_jthreadMapEntry *entries = NULL;
+    ck_assert_int_eq(jthread_map_snapshot(map, &entries), 0);
+    ck_assert(NULL == entries);
+
+    static char items[100];
+    for (size_t i = 0; i < sizeof(items); ++i)
+    {
+        jthread_map_push(map, (jlong)i + 1, items + i);
+    }
+
+    const size_t count = jthread_map_snapshot(map, &entries);
+    ck_assert_int_eq(count, sizeof(items));
+
+    jlong sum = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        ck_assert(items + entries[i].tid - 1 == entries[i].item);
+        sum += entries[i].tid;
+    }
+
+    ck_assert_int_eq(sum, sizeof(items) * (sizeof(items) + 1) / 2);
+
+    free(entries);
+    jthread_map_free(map);
+}
+END_TEST
+
+START_TEST(test_class_location_cache_lru)
+{
+    T_stringTable *strings = string_table_new(1024);
+    ck_assert_msg(NULL != strings, "Out of memory");
+    T_classLocationCache *cache = class_location_cache_new(2, strings);
+    ck_assert_msg(NULL != cache, "Out of memory");
+
+    char *external_form = NULL;
+    char *path = NULL;
+    ck_assert(0 != class_location_cache_get(cache, 1, "a.", &external_form, &path));
+
+    class_location_cache_put(cache, 1, "a.", "file:/a.class", "/a.class");
+    /* Unknown locations are cached too */
+    class_location_cache_put(cache, 2, "a.", NULL, NULL);
+
+    ck_assert(0 == class_location_cache_get(cache, 1, "a.", &external_form, &path));
+    ck_assert_str_eq(external_form, "file:/a.class");
+    ck_assert_str_eq(path, "/a.class");
+    free(external_form);
+    free(path);
+
+    ck_assert(0 == class_location_cache_get(cache, 2, "a.", &external_form, NULL));
+    ck_assert(NULL == external_form);
+
+    /* The least recently used entry is evicted */
+    ck_assert(0 == class_location_cache_get(cache, 1, "a.", NULL, NULL));
+    class_location_cache_put(cache, 1, "b.", "file:/b.class", "/b.class");
+    ck_assert(0 != class_location_cache_get(cache, 2, "a.", NULL, NULL));
+    ck_assert(0 == class_location_cache_get(cache, 1, "a.", NULL, NULL));
+
+    size_t hits = 0;
+    size_t misses = 0;
+    class_location_cache_statistics(cache, &hits, &misses);
+    ck_assert_int_eq(hits, 4);
+    ck_assert_int_eq(misses, 2);
+
+    class_location_cache_free(cache);
+    string_table_free(strings);
+}
+END_TEST
+
+START_TEST(test_class_location_cache_invalidate)
+{
+    T_stringTable *strings = string_table_new(1024);
+    ck_assert_msg(NULL != strings, "Out of memory");
+    T_classLocationCache *cache = class_location_cache_new(16, strings);
+    ck_assert_msg(NULL != cache, "Out of memory");
+
+    class_location_cache_put(cache, 1, "a.", "file:/1/a.class", "/1/a.class");
+    class_location_cache_put(cache, 1, "b.", "file:/1/b.class", "/1/b.class");
+    class_location_cache_put(cache, 2, "a.", "file:/2/a.class", "/2/a.class");
+
+    class_location_cache_invalidate_loader(cache, 1);
+
+    ck_assert(0 != class_location_cache_get(cache, 1, "a.", NULL, NULL));
+    ck_assert(0 != class_location_cache_get(cache, 1, "b.", NULL, NULL));
+
+    char *path = NULL;
+    ck_assert(0 == class_location_cache_get(cache, 2, "a.", NULL, &path));
+    ck_assert_str_eq(path, "/2/a.class");
+    free(path);
+
+    class_location_cache_free(cache);
+    string_table_free(strings);
+}
+END_TEST
+
+START_TEST(test_class_location_cache_full_strings)
+{
+    /* Too small for any location */
+    T_stringTable *strings = string_table_new(8);
+    ck_assert_msg(NULL != strings, "Out of memory");
+    T_classLocationCache *cache = class_location_cache_new(2, strings);
+    ck_assert_msg(NULL != cache, "Out of memory");
+
+    class_location_cache_put(cache, 1, "a.", "file:/a.class", "/a.class");
+    class_location_cache_put(cache, 1, "b.", "file:/b.class", "/b.class");
+
+    char *external_form = NULL;
+    char *path = NULL;
+    ck_assert(0 == class_location_cache_get(cache, 1, "a.", &external_form, &path));
+    ck_assert_str_eq(external_form, "file:/a.class");
+    ck_assert_str_eq(path, "/a.class");
+    free(external_form);
+    free(path);
+
+    /* Entries with copied strings are evicted as the others */
+    class_location_cache_put(cache, 1, "c.", "file:/c.class", NULL);
+    ck_assert(0 != class_location_cache_get(cache, 1, "b.", NULL, NULL));
+    ck_assert(0 == class_location_cache_get(cache, 1, "c.", &external_form, &path));
+    ck_assert_str_eq(external_form, "file:/c.class");
+    ck_assert(NULL == path);
+    free(external_form);
+
+    class_location_cache_free(cache);
+    string_table_free(strings);
+}
+END_TEST
+
+START_TEST(test_frame_cache_get)
+{
+    T_frameCache *cache = frame_cache_new(4096);
+    ck_assert_msg(NULL != cache, "Out of memory");
+
+    static const char frame[] = "\tat Foo.bar(Foo.java:42) [file:/tmp/Foo.class]\n";
+    char buffer[sizeof(frame)];
+    const void *method = (const void *)0x1234;
+
+    ck_assert_int_eq(frame_cache_get(cache, method, 7, buffer, sizeof(buffer)), 0);
+
+    frame_cache_put(cache, method, 7, /*loader*/0, frame);
+    ck_assert_int_eq(frame_cache_get(cache, method, 7, buffer, sizeof(buffer)), sizeof(frame) - 1);
+    ck_assert_str_eq(buffer, frame);
+
+    /* Frames are keyed by location too */
+    ck_assert_int_eq(frame_cache_get(cache, method, 8, buffer, sizeof(buffer)), 0);
+
+    /* Too small buffer gets the length only */
+    buffer[0] = '\0';
+    ck_assert_int_eq(frame_cache_get(cache, method, 7, buffer, sizeof(buffer) - 1), sizeof(frame) - 1);
+    ck_assert_int_eq(buffer[0], '\0');
+
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t memory = 0;
+    frame_cache_statistics(cache, &hits, &misses, &memory);
+    ck_assert_int_eq(hits, 2);
+    ck_assert_int_eq(misses, 2);
+    ck_assert(memory > sizeof(frame));
+
+    frame_cache_free(cache);
+}
+END_TEST
+
+START_TEST(test_frame_cache_memory_limit)
+{
+    T_frameCache *cache = frame_cache_new(1024);
+    ck_assert_msg(NULL != cache, "Out of memory");
+
+    char buffer[32];
+    for (uintptr_t i = 1; i <= 100; ++i)
+    {
+        frame_cache_put(cache, (const void *)i, 0, /*loader*/i % 2, "\tat Foo.bar(Foo.java)\n");
+    }
+
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t memory = 0;
+    frame_cache_statistics(cache, &hits, &misses, &memory);
+    ck_assert(memory <= 1024);
+
+    /* The least recently used frames are evicted first */
+    ck_assert_int_eq(frame_cache_get(cache, (const void *)1, 0, buffer, sizeof(buffer)), 0);
+    ck_assert(0 != frame_cache_get(cache, (const void *)100, 0, buffer, sizeof(buffer)));
+
+    frame_cache_invalidate_loader(cache, 0);
+    ck_assert_int_eq(frame_cache_get(cache, (const void *)100, 0, buffer, sizeof(buffer)), 0);
+    ck_assert(0 != frame_cache_get(cache, (const void *)99, 0, buffer, sizeof(buffer)));
+
+    /* Frames of a redefined method are dropped at all locations */
+    frame_cache_put(cache, (const void *)99, 1, /*loader*/1, "\tat Foo.bar(Foo.java)\n");
+    frame_cache_invalidate_method(cache, (const void *)99);
+    ck_assert_int_eq(frame_cache_get(cache, (const void *)99, 0, buffer, sizeof(buffer)), 0);
+    ck_assert_int_eq(frame_cache_get(cache, (const void *)99, 1, buffer, sizeof(buffer)), 0);
+    ck_assert(0 != frame_cache_get(cache, (const void *)97, 0, buffer, sizeof(buffer)));
+
+    frame_cache_free(cache);
+}
+END_TEST
+
+START_TEST(test_line_number_table_find)
+{
+    T_lineNumber table[] = {
+        { 10, 12 },
+        { 0, 10 },
+        { 4, 11 },
+        { 10, 13 },
+        { 20, 14 },
+    };
+    const size_t count = sizeof(table) / sizeof(table[0]);
+
+    line_number_table_sort(table, count);
+    for (size_t i = 1; i < count; ++i)
+    {
+        ck_assert(table[i - 1].start_location <= table[i].start_location);
+    }
+
+    ck_assert_int_eq(line_number_table_find(table, count, 0), 10);
+    ck_assert_int_eq(line_number_table_find(table, count, 3), 10);
+    ck_assert_int_eq(line_number_table_find(table, count, 4), 11);
+    ck_assert_int_eq(line_number_table_find(table, count, 19), table[3].line_number);
+    ck_assert_int_eq(line_number_table_find(table, count, 1000), 14);
+
+    /* Locations before the first line are not known */
+    ck_assert_int_eq(line_number_table_find(table + 2, count - 2, 5), -1);
+    ck_assert_int_eq(line_number_table_find(NULL, 0, 5), -1);
+}
+END_TEST
+
+START_TEST(test_line_number_cache)
+{
+    T_lineNumberCache *cache = line_number_cache_new(1024);
+    ck_assert_msg(NULL != cache, "Out of memory");
+
+    static const T_lineNumber table[] = { { 0, 10 }, { 5, 11 }, { 9, 12 } };
+    const void *method = (const void *)0x1234;
+    int line_number = 0;
+
+    ck_assert(0 != line_number_cache_get(cache, method, 6, &line_number));
+
+    line_number_cache_put(cache, method, /*loader*/1, table, sizeof(table) / sizeof(table[0]));
+    ck_assert_int_eq(line_number_cache_get(cache, method, 6, &line_number), 0);
+    ck_assert_int_eq(line_number, 11);
+    ck_assert_int_eq(line_number_cache_get(cache, method, 100, &line_number), 0);
+    ck_assert_int_eq(line_number, 12);
+
+    /* Methods without line numbers are cached too */
+    line_number_cache_put(cache, (const void *)0x5678, /*loader*/2, NULL, 0);
+    ck_assert_int_eq(line_number_cache_get(cache, (const void *)0x5678, 6, &line_number), 0);
+    ck_assert_int_eq(line_number, -1);
+
+    line_number_cache_invalidate_loader(cache, 1);
+    ck_assert(0 != line_number_cache_get(cache, method, 6, &line_number));
+    ck_assert_int_eq(line_number_cache_get(cache, (const void *)0x5678, 6, &line_number), 0);
+
+    line_number_cache_invalidate_method(cache, (const void *)0x5678);
+    ck_assert(0 != line_number_cache_get(cache, (const void *)0x5678, 6, &line_number));
+
+    /* The least recently used tables are evicted first */
+    for (uintptr_t i = 1; i <= 100; ++i)
+    {
+        line_number_cache_put(cache, (const void *)i, /*loader*/0, table, sizeof(table) / sizeof(table[0]));
+    }
+
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t memory = 0;
+    line_number_cache_statistics(cache, &hits, &misses, &memory);
+    ck_assert_int_eq(hits, 4);
+    ck_assert_int_eq(misses, 3);
+    ck_assert(memory <= 1024);
+
+    ck_assert(0 != line_number_cache_get(cache, (const void *)1, 6, &line_number));
+    ck_assert_int_eq(line_number_cache_get(cache, (const void *)100, 6, &line_number), 0);
+
+    line_number_cache_free(cache);
+}
+END_TEST
+
+/*
+ * A minimal JNI environment supporting weak references and super classes
+ */
+typedef struct {
+    int weak;               ///< the object is a weak reference
+    void *referent;         ///< referenced object of a weak reference
+    int alive;              ///< the object has not been collected
+    void *super_class;      ///< super class of a class object or NULL
+    const char *signature;  ///< JVM signature of a class object
+    void *loader;           ///< class loader of a class object
+} T_fakeObject;
+
+static jobject fake_jni_resolve(jobject ref)
+{
+    T_fakeObject *object = (T_fakeObject *)ref;
+    if (NULL != object && object->weak)
+    {
+        object = (T_fakeObject *)object->referent;
+    }
+
+    return NULL != object && object->alive ? (jobject)object : NULL;
+}
+
+static jboolean JNICALL fake_jni_is_same_object(JNIEnv *env, jobject a, jobject b)
+{
+    (void)env;
+    return fake_jni_resolve(a) == fake_jni_resolve(b);
+}
+
+static jobject JNICALL fake_jni_new_local_ref(JNIEnv *env, jobject ref)
+{
+    (void)env;
+    return fake_jni_resolve(ref);
+}
+
+static jweak JNICALL fake_jni_new_weak_global_ref(JNIEnv *env, jobject obj)
+{
+    (void)env;
+    T_fakeObject *weak = (T_fakeObject *)calloc(1, sizeof(*weak));
+    ck_assert_msg(NULL != weak, "Out of memory");
+    weak->weak = 1;
+    weak->referent = obj;
+    return (jweak)weak;
+}
+
+static void JNICALL fake_jni_delete_weak_global_ref(JNIEnv *env, jweak ref)
+{
+    (void)env;
+    free(ref);
+}
+
+static void JNICALL fake_jni_exception_clear(JNIEnv *env)
+{
+    (void)env;
+}
+
+static void JNICALL fake_jni_delete_local_ref(JNIEnv *env, jobject ref)
+{
+    (void)env;
+    (void)ref;
+}
+
+static jclass JNICALL fake_jni_get_superclass(JNIEnv *env, jclass class)
+{
+    (void)env;
+    return (jclass)((T_fakeObject *)fake_jni_resolve(class))->super_class;
+}
+
+static jboolean JNICALL fake_jni_is_assignable_from(JNIEnv *env, jclass class, jclass base)
+{
+    for (jclass iter = fake_jni_resolve(class); NULL != iter; iter = fake_jni_get_superclass(env, iter))
+    {
+        if (iter == fake_jni_resolve(base))
+        {
+            return JNI_TRUE;
+        }
+    }
+
+    return JNI_FALSE;
+}
+
+static const struct JNINativeInterface_ fake_jni_functions = {
+    .ExceptionClear = fake_jni_exception_clear,
+    .IsSameObject = fake_jni_is_same_object,
+    .NewLocalRef = fake_jni_new_local_ref,
+    .NewWeakGlobalRef = fake_jni_new_weak_global_ref,
+    .DeleteWeakGlobalRef = fake_jni_delete_weak_global_ref,
+    .DeleteLocalRef = fake_jni_delete_local_ref,
+    .GetSuperclass = fake_jni_get_superclass,
+    .IsAssignableFrom = fake_jni_is_assignable_from,
+};
+
+/*
+ * A minimal JVMTI environment providing signatures and loaders of fake classes
+ */
+static int fake_jvmti_signature_calls;
+
+static jvmtiError JNICALL fake_jvmti_get_class_signature(jvmtiEnv *env, jclass class, char **signature, char **generic)
+{
+    (void)env;
+    (void)generic;
+    ++fake_jvmti_signature_calls;
+    *signature = strdup(((T_fakeObject *)class)->signature);
+    return NULL == *signature ? JVMTI_ERROR_OUT_OF_MEMORY : JVMTI_ERROR_NONE;
+}
+
+static jvmtiError JNICALL fake_jvmti_deallocate(jvmtiEnv *env, unsigned char *mem)
+{
+    (void)env;
+    free(mem);
+    return JVMTI_ERROR_NONE;
+}
+
+static jvmtiError JNICALL fake_jvmti_get_class_loader(jvmtiEnv *env, jclass class, jobject *loader)
+{
+    (void)env;
+    *loader = (jobject)((T_fakeObject *)class)->loader;
+    return JVMTI_ERROR_NONE;
+}
+
+static const struct jvmtiInterface_1_ fake_jvmti_functions = {
+    .GetClassSignature = fake_jvmti_get_class_signature,
+    .GetClassLoader = fake_jvmti_get_class_loader,
+    .Deallocate = fake_jvmti_deallocate,
+};
+
+START_TEST(test_exception_matcher_subtypes)
+{
+    JNIEnv jni = &fake_jni_functions;
+    JNIEnv *jni_env = &jni;
+    jvmtiEnv jvmti = &fake_jvmti_functions;
+    jvmtiEnv *jvmti_env = &jvmti;
+
+    const char *patterns[] = { "n.s.Base+", NULL };
+
+    mark_point();
+    T_exceptionMatcher *matcher = exception_matcher_new(patterns);
+    ck_assert_msg(NULL != matcher, "Out of memory");
+
+    /* The same base class defined by two class loaders */
+    T_fakeObject first_loader = { .alive = 1 };
+    T_fakeObject second_loader = { .alive = 1 };
+    T_fakeObject throwable = { .alive = 1, .signature = "Ljava/lang/Throwable;" };
+    T_fakeObject first_base = { .alive = 1, .super_class = &throwable, .signature = "Ln/s/Base;", .loader = &first_loader };
+    T_fakeObject first_derived = { .alive = 1, .super_class = &first_base, .signature = "Ln/s/Derived;", .loader = &first_loader };
+    T_fakeObject second_base = { .alive = 1, .super_class = &throwable, .signature = "Ln/s/Base;", .loader = &second_loader };
+    T_fakeObject second_derived = { .alive = 1, .super_class = &second_base, .signature = "Ln/s/Derived;", .loader = &second_loader };
+    T_fakeObject other = { .alive = 1, .super_class = &throwable, .signature = "Ln/s/Other;", .loader = &first_loader };
+
+    ck_assert(exception_matcher_match_class(matcher, jvmti_env, jni_env, (jclass)&first_base, "n.s.Base"));
+    ck_assert(!exception_matcher_match_class(matcher, jvmti_env, jni_env, (jclass)&other, "n.s.Other"));
+
+    /* Resolves the base class of the first loader */
+    ck_assert(exception_matcher_match_class(matcher, jvmti_env, jni_env, (jclass)&first_derived, "n.s.Derived"));
+    ck_assert(exception_matcher_match_class(matcher, jvmti_env, jni_env, (jclass)&first_derived, "n.s.Derived"));
+
+    /* Not a subclass of the resolved base class but the same class loader */
+    fake_jvmti_signature_calls = 0;
+    ck_assert(!exception_matcher_match_class(matcher, jvmti_env, jni_env, (jclass)&other, "n.s.Other"));
+    ck_assert_int_eq(fake_jvmti_signature_calls, 0);
+
+    /* Not a subclass of the resolved base class and another class loader */
+    ck_assert(exception_matcher_match_class(matcher, jvmti_env, jni_env, (jclass)&second_derived, "n.s.Derived"));
+    ck_assert(0 != fake_jvmti_signature_calls);
+
+    /* The resolved base class was unloaded */
+    first_base.alive = 0;
+    ck_assert(exception_matcher_match_class(matcher, jvmti_env, jni_env, (jclass)&second_derived, "n.s.Derived"));
+
+    /* Nothing is resolved after releasing the classes */
+    exception_matcher_release_classes(matcher, jni_env);
+    ck_assert(exception_matcher_match_class(matcher, jvmti_env, jni_env, (jclass)&second_derived, "n.s.Derived"));
+
+    exception_matcher_free(matcher, jni_env);
+}
+END_TEST
+
+START_TEST(test_class_index_find)
+{
+    JNIEnv jni = &fake_jni_functions;
+    JNIEnv *jni_env = &jni;
+
+    T_classIndex *index = class_index_new();
+    ck_assert_msg(NULL != index, "Out of memory");
+
+    /* The same class name defined by two class loaders */
+    T_fakeObject first = { .alive = 1 };
+    T_fakeObject second = { .alive = 1 };
+    T_fakeObject other = { .alive = 1 };
+
+    ck_assert(NULL == class_index_find(index, jni_env, "org.foo.Bar"));
+
+    ck_assert_int_eq(class_index_add(index, jni_env, "org.foo.Bar", (jclass)&first), 0);
+    ck_assert_int_eq(class_index_add(index, jni_env, "org.foo.Bar", (jclass)&second), 0);
+    ck_assert_int_eq(class_index_add(index, jni_env, "org.foo.Baz", (jclass)&other), 0);
+    /* Already indexed */
+    ck_assert_int_eq(class_index_add(index, jni_env, "org.foo.Bar", (jclass)&first), 0);
+    ck_assert_int_eq(class_index_size(index), 3);
+
+    ck_assert(NULL == class_index_find(index, jni_env, "org.foo"));
+    ck_assert((jclass)&first == class_index_find(index, jni_env, "org.foo.Bar"));
+    ck_assert((jclass)&other == class_index_find(index, jni_env, "org.foo.Baz"));
+
+    /* Unloaded classes are removed on lookup */
+    first.alive = 0;
+    ck_assert((jclass)&second == class_index_find(index, jni_env, "org.foo.Bar"));
+    ck_assert_int_eq(class_index_size(index), 2);
+
+    second.alive = 0;
+    ck_assert(NULL == class_index_find(index, jni_env, "org.foo.Bar"));
+    ck_assert_int_eq(class_index_size(index), 1);
+
+    class_index_free(index, jni_env);
+}
+END_TEST
+
+START_TEST(test_class_index_grow)
+{
+    JNIEnv jni = &fake_jni_functions;
+    JNIEnv *jni_env = &jni;
+
+    T_classIndex *index = class_index_new();
+    ck_assert_msg(NULL != index, "Out of memory");
+
+    static T_fakeObject classes[10000];
+    char name[32];
+    for (size_t i = 0; i < sizeof(classes)/sizeof(classes[0]); ++i)
+    {
+        classes[i].alive = 1;
+        snprintf(name, sizeof(name), "org.foo.Class%zu", i);
+        ck_assert_int_eq(class_index_add(index, jni_env, name, (jclass)(classes + i)), 0);
+    }
+
+    ck_assert_int_eq(class_index_size(index), sizeof(classes)/sizeof(classes[0]));
+
+    for (size_t i = 0; i < sizeof(classes)/sizeof(classes[0]); ++i)
+    {
+        snprintf(name, sizeof(name), "org.foo.Class%zu", i);
+        ck_assert((jclass)(classes + i) == class_index_find(index, jni_env, name));
+    }
+
+    class_index_free(index, jni_env);
+}
+END_TEST
+
+START_TEST(test_debug_methods_parse)
+{
+    JNIEnv jni = &fake_jni_functions;
+    JNIEnv *jni_env = &jni;
+
+    const char *const fqdns[] = {
+        "org.foo.Bar.getHistory",
+        "noclass",
+        "org.foo.Bar.",
+        "Baz.dump",
+        NULL,
+    };
+
+    T_debugMethods *methods = debug_methods_new(fqdns, /*timeout*/1000, /*ttl*/0);
+    ck_assert_msg(NULL != methods, "Out of memory");
+
+    /* Only names in FQDN format are accepted */
+    ck_assert_int_eq(debug_methods_count(methods), 2);
+    ck_assert_str_eq(debug_methods_class_name(methods, 0), "org.foo.Bar");
+    ck_assert_str_eq(debug_methods_class_name(methods, 1), "Baz");
+
+    /* Methods of classes which have not been prepared are unresolved */
+    const char *label = NULL;
+    jclass class = (jclass)fqdns;
+    jmethodID method = (jmethodID)fqdns;
+    ck_assert(0 != debug_methods_get(methods, jni_env, 1, &label, &class, &method));
+    ck_assert_str_eq(label, "Baz.dump");
+    ck_assert(NULL == class);
+    ck_assert(NULL == method);
+
+    /* Nothing waits for methods which are not running */
+    T_arena *arena = arena_new(1024);
+    ck_assert_msg(NULL != arena, "Out of memory");
+    ck_assert(NULL == debug_methods_invoke(methods, 0, arena));
+    arena_free(arena);
+
+    T_debugMethodStatistics stats;
+    debug_methods_statistics(methods, 0, &stats);
+    ck_assert_str_eq(stats.label, "org.foo.Bar.getHistory");
+    ck_assert_int_eq(stats.calls, 0);
+    ck_assert_int_eq(stats.timeouts, 0);
+
+    debug_methods_free(methods, jni_env);
+}
+END_TEST
+
+START_TEST(test_string_builder_append)
+{
+    T_stringBuilder *builder = string_builder_new(5000);
+    ck_assert_msg(NULL != builder, "Out of memory");
+
+    /* Appends span several chunks */
+    char expected[5001] = { 0 };
+    for (int i = 0; i < 400; ++i)
+    {
+        char frame[16];
+        snprintf(frame, sizeof(frame), "\tat %d\n", i);
+        strcat(expected, frame);
+        ck_assert_int_eq(string_builder_printf(builder, "\tat %d\n", i), 0);
+    }
+    ck_assert_int_eq(string_builder_length(builder), strlen(expected));
+
+    char *built = string_builder_finish(builder);
+    ck_assert_str_eq(built, expected);
+    free(built);
+
+    /* The finished builder is empty and reuses its chunks */
+    ck_assert_int_eq(string_builder_length(builder), 0);
+    ck_assert_int_eq(string_builder_append(builder, "Caused by: "), 0);
+    ck_assert_int_eq(string_builder_printf(builder, "%s\n", "java.io.IOException"), 0);
+    built = string_builder_finish(builder);
+    ck_assert_str_eq(built, "Caused by: java.io.IOException\n");
+    free(built);
+
+    string_builder_free(builder);
+}
+END_TEST
+
+START_TEST(test_string_builder_capacity)
+{
+    T_stringBuilder *builder = string_builder_new(10);
+    ck_assert_msg(NULL != builder, "Out of memory");
+
+    ck_assert_int_eq(string_builder_append(builder, "12345"), 0);
+    /* Appends exceeding the capacity are rejected as a whole */
+    ck_assert(0 != string_builder_printf(builder, "%s", "abcdef"));
+    ck_assert(0 != string_builder_append(builder, "abcdef"));
+    ck_assert_int_eq(string_builder_append(builder, "abcde"), 0);
+    ck_assert_int_eq(string_builder_length(builder), 10);
+
+    string_builder_truncate(builder, 3);
+    ck_assert_int_eq(string_builder_append(builder, "xy"), 0);
+
+    char *built = string_builder_finish(builder);
+    ck_assert_str_eq(built, "123xy");
+    free(built);
+
+    /* The capacity can be raised */
+    string_builder_reset(builder, 20);
+    ck_assert_int_eq(string_builder_printf(builder, "%s%s", "0123456789", "0123456789"), 0);
+    built = string_builder_finish(builder);
+    ck_assert_str_eq(built, "01234567890123456789");
+    free(built);
+
+    string_builder_free(builder);
+}
+END_TEST
+
+START_TEST(test_arena_alloc)
+{
+    T_arena *arena = arena_new(256);
+    ck_assert_msg(NULL != arena, "Out of memory");
+
+    /* Memory is aligned for any type */
+    char *first = (char *)arena_alloc(arena, 1);
+    char *second = (char *)arena_alloc(arena, 3);
+    ck_assert(NULL != first && NULL != second);
+    ck_assert_int_eq((uintptr_t)first % sizeof(void *), 0);
+    ck_assert_int_eq((uintptr_t)second % sizeof(void *), 0);
+    ck_assert(first != second);
+
+    char *copy = arena_strdup(arena, "java.lang.RuntimeException");
+    ck_assert_str_eq(copy, "java.lang.RuntimeException");
+
+    /* Allocations larger than a chunk get their own chunk */
+    char *large = (char *)arena_alloc(arena, 4096);
+    ck_assert(NULL != large);
+    memset(large, 'x', 4096);
+    ck_assert_str_eq(copy, "java.lang.RuntimeException");
+
+    arena_free(arena);
+}
+END_TEST
+
+START_TEST(test_arena_release)
+{
+    T_arena *arena = arena_new(256);
+    ck_assert_msg(NULL != arena, "Out of memory");
+
+    const T_arenaMark empty = arena_mark(arena);
+    char *kept = arena_strdup(arena, "kept");
+
+    /* Allocations after a mark are released together and their memory is
+     * reused */
+    const T_arenaMark mark = arena_mark(arena);
+    char *released = (char *)arena_alloc(arena, 100);
+    for (int i = 0; i < 10; ++i)
+    {
+        ck_assert(NULL != arena_alloc(arena, 100));
+    }
+
+    arena_release(arena, mark);
+    ck_assert(released == arena_alloc(arena, 100));
+    ck_assert_str_eq(kept, "kept");
+
+    /* A nested user releases only its own allocations */
+    const T_arenaMark nested = arena_mark(arena);
+    ck_assert(NULL != arena_alloc(arena, 1000));
+    arena_release(arena, nested);
+    ck_assert_str_eq(kept, "kept");
+
+    arena_release(arena, empty);
+    ck_assert(kept == arena_strdup(arena, "again"));
+
+    /* Built strings can be allocated from an arena */
+    T_stringBuilder *builder = string_builder_new(100);
+    ck_assert_msg(NULL != builder, "Out of memory");
+    ck_assert_int_eq(string_builder_append(builder, "Caused by: "), 0);
+    char *built = string_builder_finish_in(builder, arena);
+    ck_assert_str_eq(built, "Caused by: ");
+    ck_assert_int_eq(string_builder_length(builder), 0);
+    string_builder_free(builder);
+
+    arena_free(arena);
+}
+END_TEST
+
+START_TEST(test_string_table_intern)
+{
+    T_stringTable *table = string_table_new(64 * 1024);
+    ck_assert_msg(NULL != table, "Out of memory");
+
+    ck_assert(NULL == string_table_intern(table, NULL));
+
+    char name[32];
+    snprintf(name, sizeof(name), "java.lang.RuntimeException");
+    const char *interned = string_table_intern(table, name);
+    ck_assert(NULL != interned);
+    ck_assert(name != interned);
+    ck_assert_str_eq(interned, "java.lang.RuntimeException");
+
+    /* Equal strings share a single copy */
+    ck_assert(interned == string_table_intern(table, "java.lang.RuntimeException"));
+    ck_assert(interned != string_table_intern(table, "java.lang.Exception"));
+
+    /* Interned strings survive growth of the table */
+    for (int i = 0; i < 1000; ++i)
+    {
+        snprintf(name, sizeof(name), "a.Class%d", i);
+        ck_assert(NULL != string_table_intern(table, name));
+    }
+    ck_assert(interned == string_table_intern(table, "java.lang.RuntimeException"));
+    ck_assert_str_eq(string_table_intern(table, "a.Class0"), "a.Class0");
+
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t memory = 0;
+    string_table_statistics(table, &hits, &misses, &memory);
+    ck_assert_int_eq(hits, 3);
+    ck_assert_int_eq(misses, 1002);
+    ck_assert(0 != memory);
+
+    string_table_free(table);
+
+    /* Already interned strings are found in a full table */
+    table = string_table_new(64);
+    ck_assert_msg(NULL != table, "Out of memory");
+    interned = string_table_intern(table, "a");
+    ck_assert(NULL != interned);
+    ck_assert(NULL == string_table_intern(table, "a string which does not fit into the table"));
+    ck_assert(interned == string_table_intern(table, "a"));
+
+    string_table_free(table);
+}
+END_TEST
+
 Suite *abrt_checker_suite(void)
 {
     Suite *s = suite_create ("abrt-checker");
@@ -122,6 +1202,84 @@ Suite *abrt_checker_suite(void)
     tcase_add_test(tc_configuration, test_conf_file_no_overwrite);
     suite_add_tcase(s, tc_configuration);
 
+    /* Exception matcher test case */
+    TCase *tc_exception_matcher = tcase_create("Exception matcher");
+    tcase_add_test(tc_exception_matcher, test_exception_matcher_names);
+    tcase_add_test(tc_exception_matcher, test_exception_matcher_match_all);
+    tcase_add_test(tc_exception_matcher, test_exception_matcher_subtypes);
+    suite_add_tcase(s, tc_exception_matcher);
+
+    /* Report dispatcher test case */
+    TCase *tc_report_dispatcher = tcase_create("Report dispatcher");
+    tcase_add_test(tc_report_dispatcher, test_report_dispatcher_overflow);
+    suite_add_tcase(s, tc_report_dispatcher);
+
+    /* Rate limiter test case */
+    TCase *tc_rate_limiter = tcase_create("Rate limiter");
+    tcase_add_test(tc_rate_limiter, test_rate_limiter_burst);
+    tcase_add_test(tc_rate_limiter, test_rate_limiter_hash);
+    suite_add_tcase(s, tc_rate_limiter);
+
+    /* Fingerprint set test case */
+    TCase *tc_fingerprint_set = tcase_create("Fingerprint set");
+    tcase_add_test(tc_fingerprint_set, test_fingerprint_set_insert);
+    tcase_add_test(tc_fingerprint_set, test_fingerprint_set_eviction);
+    tcase_add_test(tc_fingerprint_set, test_fingerprint_set_expiry);
+    suite_add_tcase(s, tc_fingerprint_set);
+
+    /* Thread map test case */
+    TCase *tc_jthread_map = tcase_create("Thread map");
+    tcase_add_test(tc_jthread_map, test_jthread_map_push_pop);
+    tcase_add_test(tc_jthread_map, test_jthread_map_snapshot);
+    suite_add_tcase(s, tc_jthread_map);
+
+    /* Class location cache test case */
+    TCase *tc_class_location_cache = tcase_create("Class location cache");
+    tcase_add_test(tc_class_location_cache, test_class_location_cache_lru);
+    tcase_add_test(tc_class_location_cache, test_class_location_cache_invalidate);
+    tcase_add_test(tc_class_location_cache, test_class_location_cache_full_strings);
+    suite_add_tcase(s, tc_class_location_cache);
+
+    /* Frame cache test case */
+    TCase *tc_frame_cache = tcase_create("Frame cache");
+    tcase_add_test(tc_frame_cache, test_frame_cache_get);
+    tcase_add_test(tc_frame_cache, test_frame_cache_memory_limit);
+    suite_add_tcase(s, tc_frame_cache);
+
+    /* Line number cache test case */
+    TCase *tc_line_number_cache = tcase_create("Line number cache");
+    tcase_add_test(tc_line_number_cache, test_line_number_table_find);
+    tcase_add_test(tc_line_number_cache, test_line_number_cache);
+    suite_add_tcase(s, tc_line_number_cache);
+
+    /* Class index test case */
+    TCase *tc_class_index = tcase_create("Class index");
+    tcase_add_test(tc_class_index, test_class_index_find);
+    tcase_add_test(tc_class_index, test_class_index_grow);
+    suite_add_tcase(s, tc_class_index);
+
+    /* Debug methods test case */
+    TCase *tc_debug_methods = tcase_create("Debug methods");
+    tcase_add_test(tc_debug_methods, test_debug_methods_parse);
+    suite_add_tcase(s, tc_debug_methods);
+
+    /* String builder test case */
+    TCase *tc_string_builder = tcase_create("String builder");
+    tcase_add_test(tc_string_builder, test_string_builder_append);
+    tcase_add_test(tc_string_builder, test_string_builder_capacity);
+    suite_add_tcase(s, tc_string_builder);
+
+    /* Arena test case */
+    TCase *tc_arena = tcase_create("Arena");
+    tcase_add_test(tc_arena, test_arena_alloc);
+    tcase_add_test(tc_arena, test_arena_release);
+    suite_add_tcase(s, tc_arena);
+
+    /* String table test case */
+    TCase *tc_string_table = tcase_create("String table");
+    tcase_add_test(tc_string_table, test_string_table_intern);
+    suite_add_tcase(s, tc_string_table);
+
     return s;
 }
 